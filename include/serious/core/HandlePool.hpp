@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cassert>
+#include <compare>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace serious
+{
+
+/**
+ * @brief Index and generation of a slot in a HandlePool, typed by Tag
+ *
+ * A default constructed handle is null. The generation of a live slot is always odd, it is bumped
+ * on create and on destroy, so handles to a destroyed or recycled slot no longer compare equal.
+ */
+template <class Tag>
+struct Handle
+{
+    uint32_t index = 0;
+    uint32_t generation = 0;
+
+    inline explicit operator bool() const { return generation != 0; }
+    inline uint64_t GetKey() const { return (static_cast<uint64_t>(generation) << 32) | index; }
+    auto operator<=>(const Handle&) const = default;
+};
+
+/**
+ * @brief Dense slots addressed by generational handles
+ *
+ * Destroyed slots go to a free list and are reused by the next Create, so the arrays only grow up
+ * to the peak number of live objects. Lookups are one bounds check and one generation compare.
+ * References returned by Get are invalidated when Create grows the arrays.
+ */
+template <class T, class HandleType>
+class HandlePool final
+{
+public:
+    HandleType Create(T value)
+    {
+        uint32_t index;
+        if (!m_FreeList.empty()) {
+            index = m_FreeList.back();
+            m_FreeList.pop_back();
+            m_Items[index] = std::move(value);
+        } else {
+            index = static_cast<uint32_t>(m_Items.size());
+            m_Items.push_back(std::move(value));
+            m_Generations.push_back(0);
+        }
+        m_Generations[index]++;
+        m_Count++;
+        return {index, m_Generations[index]};
+    }
+
+    // The value is moved out to be released by the caller, the slot is recycled by a later Create
+    T Destroy(HandleType handle)
+    {
+        assert(IsValid(handle));
+        T value = std::move(m_Items[handle.index]);
+        m_Items[handle.index] = T {};
+        m_Generations[handle.index]++;
+        m_FreeList.push_back(handle.index);
+        m_Count--;
+        return value;
+    }
+
+    inline bool IsValid(HandleType handle) const
+    {
+        return handle.index < m_Generations.size() && (handle.generation & 1) && m_Generations[handle.index] == handle.generation;
+    }
+    // Null for stale handles
+    inline T* TryGet(HandleType handle) { return IsValid(handle) ? &m_Items[handle.index] : nullptr; }
+    inline const T* TryGet(HandleType handle) const { return IsValid(handle) ? &m_Items[handle.index] : nullptr; }
+    inline T& Get(HandleType handle) { assert(IsValid(handle)); return m_Items[handle.index]; }
+    inline const T& Get(HandleType handle) const { assert(IsValid(handle)); return m_Items[handle.index]; }
+
+    // Visit live slots in index order as (handle, value)
+    template <class Func>
+    void ForEach(Func&& func)
+    {
+        for (uint32_t i = 0; i < m_Items.size(); ++i) {
+            if (m_Generations[i] & 1) {
+                func(HandleType {i, m_Generations[i]}, m_Items[i]);
+            }
+        }
+    }
+    template <class Func>
+    void ForEach(Func&& func) const
+    {
+        for (uint32_t i = 0; i < m_Items.size(); ++i) {
+            if (m_Generations[i] & 1) {
+                func(HandleType {i, m_Generations[i]}, m_Items[i]);
+            }
+        }
+    }
+
+    // Every handle handed out so far becomes stale
+    void Clear()
+    {
+        m_FreeList.clear();
+        for (uint32_t i = 0; i < m_Items.size(); ++i) {
+            if (m_Generations[i] & 1) {
+                m_Items[i] = T {};
+                m_Generations[i]++;
+            }
+            m_FreeList.push_back(i);
+        }
+        m_Count = 0;
+    }
+
+    inline void Reserve(size_t capacity) { m_Items.reserve(capacity); m_Generations.reserve(capacity); }
+    inline size_t GetCount() const { return m_Count; }
+    inline size_t GetCapacity() const { return m_Items.size(); }
+private:
+    std::vector<T> m_Items;
+    std::vector<uint32_t> m_Generations;
+    std::vector<uint32_t> m_FreeList;
+    size_t m_Count = 0;
+};
+
+}
+
+template <class Tag>
+struct std::hash<serious::Handle<Tag>>
+{
+    inline size_t operator()(const serious::Handle<Tag>& handle) const
+    {
+        return std::hash<uint64_t>()(handle.GetKey());
+    }
+};
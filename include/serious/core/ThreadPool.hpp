@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace serious
+{
+
+/**
+ * @brief Fixed set of worker threads consuming a FIFO task queue
+ */
+class ThreadPool final
+{
+public:
+    // 0 picks hardware concurrency minus the calling thread
+    explicit ThreadPool(uint32_t threadCount = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Enqueue(std::function<void()> task);
+    // Block until the queue is empty and no task is running
+    void WaitIdle();
+
+    inline uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+    // Index of the calling worker in [0, GetThreadCount()), UINT32_MAX outside of the pool
+    static uint32_t GetWorkerIndex();
+private:
+    void WorkerLoop(uint32_t workerIndex);
+private:
+    std::vector<std::thread> m_Workers;
+    std::queue<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_TaskCondition;
+    std::condition_variable m_IdleCondition;
+    uint32_t m_ActiveCount;
+    bool m_Stopping;
+};
+
+}
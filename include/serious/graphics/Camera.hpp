@@ -7,6 +7,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <SDL3/SDL.h>
 
+#include <array>
+
 namespace serious
 {
 
@@ -18,6 +20,8 @@ public:
     void Update(float deltaTime);
     void SetPerspective(float fov, float aspect, float znear, float zfar);
     bool Moving() const;
+    // Left, right, bottom, top, near and far planes in world space, normals point inwards
+    std::array<glm::vec4, 6> GetFrustumPlanes() const;
     void Translate(const glm::vec3& delta);
     void Rotate(const glm::vec3& delta);
     void SetPosition(const glm::vec3& position);
@@ -1,11 +1,23 @@
 #pragma once
+#include "serious/core/HandlePool.hpp"
+
+#include <cstdint>
+#include <string>
 #include <vector>
+#include <string>
 #include <string_view>
 
+#include <glm/glm.hpp>
+
 namespace serious
 {
 
-using RHIResource = void*;
+// Null handles compare false, handles of destroyed resources are detected as stale by the RHI
+using ShaderHandle = Handle<struct ShaderTag>;
+using BufferHandle = Handle<struct BufferTag>;
+using PipelineHandle = Handle<struct PipelineTag>;
+using CullPipelineHandle = Handle<struct CullPipelineTag>;
+using TextureHandle = Handle<struct TextureTag>;
 
 struct Settings
 {
@@ -13,10 +25,26 @@ struct Settings
     unsigned int height = 600;
     bool validation = false;
     bool vsync = false;
+    // Frames recorded ahead of the GPU, more adds throughput at the cost of latency
+    unsigned int framesInFlight = 2;
+    // Pipeline cache file, loaded at Init and saved at Shutdown
+    std::string_view pipelineCachePath = "pipeline.cache";
+    // Background workers, 0 picks hardware concurrency minus one
+    unsigned int workerThreads = 0;
+    // Texture decoding workers, apart from the ones frame recording waits on
+    unsigned int decodeThreads = 2;
+    // Render without render pass and framebuffer objects when the device supports it
+    bool dynamicRendering = true;
+    // GPU timestamps around the frame and its passes, read back framesInFlight frames later
+    bool gpuProfiling = true;
+    // Pipeline statistics of the primary command buffer of each frame, when the device supports them
+    bool pipelineStatistics = false;
+    // Bytes of streamed textures handed to the uploader each frame
+    size_t textureUploadBudget = 16 * 1024 * 1024;
+    // Render into an offscreen image of width x height, no window, surface or presentation
+    bool headless = false;
 };
 
-using RHIResourceIdx = size_t;
-
 enum class ShaderStage
 {
     Vertex,
@@ -35,7 +63,22 @@ enum class BufferUsage
 {
     Vertex,
     Index,
-    Uniform
+    Uniform,
+    // Per instance vertex stream of InstanceData
+    Instance,
+    // Storage buffer read by compute passes, such as the ObjectData of an indirect pass
+    Storage
+};
+
+// How often the contents of a buffer change once it is created
+enum class BufferUpdateHint
+{
+    // Device local, updates are copied on the graphics queue from staging memory
+    Static,
+    // Host visible with a copy per frame in flight, updates reach each copy in turn
+    Dynamic,
+    // Slice of the frame allocator, undefined each frame until it is written
+    Stream
 };
 
 enum class ColorBlendingMode
@@ -47,7 +90,7 @@ enum class ColorBlendingMode
 
 struct PipelineDescription
 {
-    std::vector<RHIResourceIdx> shaders;
+    std::vector<ShaderHandle> shaders;
     ColorBlendingMode blendingMode;
 };
 
@@ -55,15 +98,112 @@ struct BufferDescription
 {
     BufferUsage usage;
     size_t size;
+    // Initial contents, ignored by stream buffers
     void* data;
+    BufferUpdateHint hint = BufferUpdateHint::Static;
+};
+
+struct TextureDescription
+{
+    std::string file;
+    // Streaming order, higher first, typically the on-screen size in pixels
+    float priority = 0.0f;
+};
+
+// Layout of the per instance vertex stream
+struct InstanceData
+{
+    glm::mat4 transform = glm::mat4(1.0f);
 };
 
 struct RenderPassDescription
 {
-    RHIResource pipeline;
-    RHIResourceIdx vertexBuffer;
-    RHIResourceIdx indexBuffer;
+    // The bound pipeline when null
+    PipelineHandle pipeline;
+    BufferHandle vertexBuffer;
+    BufferHandle indexBuffer;
     uint32_t size;
+    // Sampled through the bindless texture table, the scene texture when null
+    TextureHandle texture;
+    // Model matrix, written to the per frame uniform data of this draw
+    glm::mat4 transform = glm::mat4(1.0f);
+    // Instance buffer read by the per instance binding, a single identity instance when null
+    BufferHandle instanceBuffer;
+    uint32_t instanceCount = 1;
+};
+
+// Object of a GPU culled pass, matches the layout read by the culling shader
+struct ObjectData
+{
+    glm::mat4 transform = glm::mat4(1.0f);
+    // Object space bounding sphere, xyz center and w radius
+    glm::vec4 boundingSphere = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    uint32_t indexCount = 0;
+    uint32_t firstIndex = 0;
+    int32_t vertexOffset = 0;
+    uint32_t padding = 0;
+};
+
+// Objects culled by a compute shader, visible ones are drawn from a GPU written indirect buffer
+struct IndirectPassDescription
+{
+    PipelineHandle pipeline;
+    CullPipelineHandle cullPipeline;
+    BufferHandle vertexBuffer;
+    BufferHandle indexBuffer;
+    // Storage buffer of objectCount ObjectData
+    BufferHandle objectBuffer;
+    uint32_t objectCount;
+    // Shared by every object of the pass, the scene texture when null
+    TextureHandle texture;
+};
+
+// Summary of the last resource finalization
+struct ResourceReport
+{
+    size_t bufferCount = 0;
+    size_t textureCount = 0;
+    size_t uploadBytes = 0;
+    uint32_t submitCount = 0;
+    double milliseconds = 0.0;
+};
+
+// Draws and state binds of the last recorded frame
+struct DrawStats
+{
+    uint32_t drawCount = 0;
+    uint32_t bindsIssued = 0;
+    // Binds dropped because the same state was already bound
+    uint32_t bindsSkipped = 0;
+};
+
+// GPU time of a profiled command buffer region
+struct GpuZoneTiming
+{
+    std::string name;
+    // Nesting level, 0 for zones directly inside the frame
+    uint32_t depth = 0;
+    double milliseconds = 0.0;
+};
+
+struct GpuPipelineStatistics
+{
+    uint64_t inputAssemblyVertices = 0;
+    uint64_t inputAssemblyPrimitives = 0;
+    uint64_t vertexShaderInvocations = 0;
+    uint64_t clippingPrimitives = 0;
+    uint64_t fragmentShaderInvocations = 0;
+    uint64_t computeShaderInvocations = 0;
+};
+
+// Most recent frame whose GPU results have been read back
+struct GpuFrameProfile
+{
+    uint64_t frame = 0;
+    double milliseconds = 0.0;
+    std::vector<GpuZoneTiming> zones;
+    bool hasStatistics = false;
+    GpuPipelineStatistics statistics;
 };
 
 enum class GraphicsAPI
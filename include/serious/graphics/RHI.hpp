@@ -12,17 +12,38 @@ public:
     virtual void Init(void* window) = 0;
     // Must call at the before rendering loop
     virtual bool AssureResource() { return false; };
+    virtual ResourceReport GetResourceReport() const { return {}; }
+    virtual DrawStats GetDrawStats() const { return {}; }
+    virtual GpuFrameProfile GetGpuProfile() const { return {}; }
+    // Tightly packed RGBA8 rows of the last rendered frame, headless only
+    virtual std::vector<uint8_t> ReadbackFrame() { return {}; }
     virtual void Shutdown() = 0;
     virtual void PrepareFrame() = 0;
     virtual void SubmitFrame() = 0;
     virtual void Update() {};
     // RHI implementation maintains a structure to hold shader handles
     // and is responsible for creating and destroying them
-    virtual RHIResourceIdx CreateShader(const ShaderDescription& description) = 0;
-    virtual RHIResource CreatePipeline(const PipelineDescription& description) = 0;
-    virtual RHIResourceIdx CreateBuffer(const BufferDescription& decription) = 0;
-    virtual void BindPipeline(RHIResource pipeline) = 0;
-    virtual void DestroyPipeline(RHIResource pipeline) = 0;
+    virtual ShaderHandle CreateShader(const ShaderDescription& description) = 0;
+    // Pipelines already created from the shader keep working
+    virtual void DestroyShader(ShaderHandle shader) = 0;
+    virtual PipelineHandle CreatePipeline(const PipelineDescription& description) = 0;
+    // Returns at once, passes using the pipeline are skipped until it is ready
+    virtual PipelineHandle CreatePipelineAsync(const PipelineDescription& description) { return CreatePipeline(description); }
+    virtual bool IsPipelineReady(PipelineHandle pipeline) const { (void)pipeline; return true; }
+    virtual BufferHandle CreateBuffer(const BufferDescription& decription) = 0;
+    // Passes still referencing the buffer are skipped, its slot is reused by later buffers
+    virtual void DestroyBuffer(BufferHandle buffer) = 0;
+    // Streamed in the background, draws sample a placeholder until the upload is done
+    virtual TextureHandle CreateTexture(const TextureDescription& description) = 0;
+    // Passes still referencing the texture sample the scene texture
+    virtual void DestroyTexture(TextureHandle texture) = 0;
+    // Bytes [offset, offset + size) are seen by the next frame submitted by Update
+    virtual void UpdateBuffer(BufferHandle buffer, const void* data, size_t size, size_t offset = 0) = 0;
+    // Write only range of the buffer, null on failure. Unmap before the next Update
+    virtual void* MapBuffer(BufferHandle buffer, size_t offset, size_t size) = 0;
+    virtual void UnmapBuffer(BufferHandle buffer) = 0;
+    virtual void BindPipeline(PipelineHandle pipeline) = 0;
+    virtual void DestroyPipeline(PipelineHandle pipeline) = 0;
 
     virtual Camera& GetCamera() = 0;
     
@@ -30,6 +51,15 @@ public:
     virtual void SetClearDepth(float depth) = 0;
 
     virtual void SetPasses(const std::vector<RenderPassDescription>& descriptions) = 0;
+    // GPU culling, the CPU cost of these passes does not grow with their object count
+    virtual CullPipelineHandle CreateCullPipeline(ShaderHandle computeShader) { (void)computeShader; return {}; }
+    virtual void DestroyCullPipeline(CullPipelineHandle pipeline) { (void)pipeline; }
+    virtual void SetIndirectPasses(const std::vector<IndirectPassDescription>& descriptions) { (void)descriptions; }
+
+    // Same work as a window resize, without the window changing
+    inline void RecreateRenderTargets() { WindowResize(); }
+    // Only the render targets over the current swapchain, which is kept
+    virtual void RecreateRenderGraph() {}
 
     inline static void SetAPI(GraphicsAPI api) { s_API = api; }
 protected:
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace serious
+{
+
+struct RenderQueueEntry
+{
+    uint64_t key;
+    // Index of the draw in the submitted pass list
+    uint32_t draw;
+};
+
+/**
+ * @brief Draws ordered by 64 bit sort keys
+ *
+ * Opaque keys put pipeline, material and mesh above a front to back depth, so draws sharing
+ * state end up next to each other and near surfaces are drawn first. Blended keys come after
+ * every opaque one and put a back to front depth above the state, as required for correct
+ * blending. Ids are expected to be small and dense, they are masked to their field width.
+ */
+class RenderQueue final
+{
+public:
+    static constexpr uint32_t PipelineBits = 12;
+    static constexpr uint32_t MaterialBits = 12;
+    static constexpr uint32_t MeshBits = 15;
+    static constexpr uint32_t DepthBits = 24;
+
+    // depth is normalized to [0, 1], 0 being the nearest
+    static uint64_t MakeOpaqueKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+    static uint64_t MakeBlendedKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+    void Clear();
+    inline void Push(uint64_t key, uint32_t draw) { m_Entries.push_back({key, draw}); }
+    // LSD radix sort over 8 bit digits, digits shared by every key are skipped
+    void Sort();
+
+    inline const std::vector<RenderQueueEntry>& GetEntries() const { return m_Entries; }
+    inline size_t GetSize() const { return m_Entries.size(); }
+private:
+    std::vector<RenderQueueEntry> m_Entries;
+    std::vector<RenderQueueEntry> m_Scratch;
+};
+
+}
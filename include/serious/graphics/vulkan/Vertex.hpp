@@ -14,8 +14,12 @@ struct Vertex
     glm::vec3 normal;
     glm::vec2 texCoord;
 
-    static VkVertexInputBindingDescription GetBindingDescription();
-    static std::array<VkVertexInputAttributeDescription, 3> GetAttributeDescriptions();
+    static constexpr uint32_t VertexBinding = 0;
+    static constexpr uint32_t InstanceBinding = 1;
+
+    // Per vertex stream followed by the per instance InstanceData stream
+    static std::array<VkVertexInputBindingDescription, 2> GetBindingDescription();
+    static std::array<VkVertexInputAttributeDescription, 7> GetAttributeDescriptions();
 };
 
 }
\ No newline at end of file
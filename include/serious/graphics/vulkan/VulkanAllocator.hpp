@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <mutex>
+#include <vector>
+
+namespace serious
+{
+
+/**
+ * @brief Sub-range of device memory handed out by VulkanAllocator
+ *
+ * Dedicated allocations own their VkDeviceMemory and have blockIdx == UINT32_MAX
+ */
+struct VulkanAllocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t memoryTypeIdx = UINT32_MAX;
+    uint32_t blockIdx = UINT32_MAX;
+    // Persistently mapped pointer to offset, null if memory is not host visible
+    void* mapped = nullptr;
+};
+
+struct VulkanMemoryTypeStats
+{
+    uint32_t blockCount = 0;
+    uint32_t allocationCount = 0;
+    uint32_t dedicatedCount = 0;
+    // Bytes reserved through vkAllocateMemory (blocks and dedicated allocations)
+    VkDeviceSize reservedBytes = 0;
+    // Bytes handed out to resources
+    VkDeviceSize usedBytes = 0;
+};
+
+/**
+ * @brief Block based device memory allocator
+ *
+ * Keeps a list of large VkDeviceMemory blocks per memory type and sub-allocates
+ * buffers and images from them with first-fit placement. Resources that are
+ * too large for a block or that prefer it (render targets) get a dedicated allocation.
+ * Host visible memory is mapped once for the lifetime of the block.
+ */
+class VulkanAllocator final
+{
+public:
+    static constexpr VkDeviceSize DefaultBlockSize = 64ull * 1024 * 1024;
+
+    VulkanAllocator();
+    void Init(VkDevice device, VkPhysicalDevice gpu, VkDeviceSize blockSize = DefaultBlockSize);
+    void Destroy();
+
+    VulkanAllocation AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+    VulkanAllocation AllocateImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties, bool dedicated = false);
+    // Optimal tiling memory not tied to one resource, for images aliasing the same range
+    VulkanAllocation AllocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties);
+    // Return the sub-range to its block, or release the memory of a dedicated allocation
+    void Free(VulkanAllocation& allocation);
+
+    uint32_t FindMemoryTypeIdx(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags) const;
+    VulkanMemoryTypeStats GetStats(uint32_t memoryTypeIdx) const;
+    VulkanMemoryTypeStats GetTotalStats() const;
+    void LogStats() const;
+private:
+    enum class RangeKind : uint8_t
+    {
+        Free,
+        Linear,  // Buffers and linear images
+        Optimal  // Optimal tiling images
+    };
+
+    struct Range
+    {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        RangeKind kind;
+    };
+
+    // Ranges are sorted by offset and cover the whole block
+    struct Block
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;
+        std::vector<Range> ranges;
+    };
+
+    struct MemoryPool
+    {
+        std::vector<Block> blocks;
+        VulkanMemoryTypeStats stats;
+    };
+
+    VulkanAllocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, RangeKind kind, bool dedicated, VkBuffer buffer, VkImage image);
+    VulkanAllocation AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIdx, VkBuffer buffer, VkImage image);
+    bool AllocateFromBlock(Block& block, const VkMemoryRequirements& requirements, RangeKind kind, VkDeviceSize* offset);
+    void FreeFromBlock(Block& block, VkDeviceSize offset);
+    bool OnSamePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond) const;
+    void* MapMemory(VkDeviceMemory memory, uint32_t memoryTypeIdx);
+private:
+    VkDevice m_Device;
+    VkPhysicalDeviceMemoryProperties m_MemoryProps;
+    VkDeviceSize m_BlockSize;
+    VkDeviceSize m_BufferImageGranularity;
+    std::array<MemoryPool, VK_MAX_MEMORY_TYPES> m_Pools;
+    mutable std::mutex m_Mutex;
+};
+
+}
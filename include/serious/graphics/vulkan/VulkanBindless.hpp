@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+namespace serious
+{
+
+class VulkanDevice;
+
+/**
+ * @brief Global table of sampled textures indexed from shaders
+ *
+ * One descriptor set holds a large COMBINED_IMAGE_SAMPLER array created with
+ * UPDATE_AFTER_BIND, UPDATE_UNUSED_WHILE_PENDING and PARTIALLY_BOUND, so free slots
+ * can be written while pending frames use the set and unused slots may stay empty.
+ * Shaders receive the slot index returned by Register. A slot is never rewritten in
+ * place, released slots are recycled once the frames that might still sample them are done.
+ */
+class VulkanBindlessTable final
+{
+public:
+    static constexpr uint32_t DefaultCapacity = 16384;
+    static constexpr uint32_t InvalidIndex = UINT32_MAX;
+
+    VulkanBindlessTable();
+    void Init(VulkanDevice* device, uint32_t capacity = DefaultCapacity, uint32_t framesInFlight = 3);
+    void Destroy();
+
+    // Returns InvalidIndex when the table is full
+    uint32_t Register(VkImageView imageView, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    void Release(uint32_t index);
+    // Called once per frame, slots released framesInFlight frames ago return to the free list
+    void NextFrame();
+
+    inline bool IsEnabled() const { return m_Set != VK_NULL_HANDLE; }
+    inline VkDescriptorSetLayout GetSetLayout() const { return m_SetLayout; }
+    inline VkDescriptorSet GetSet() const { return m_Set; }
+    inline uint32_t GetCapacity() const { return m_Capacity; }
+    inline uint32_t GetCount() const { return m_NextIndex - static_cast<uint32_t>(m_FreeIndices.size() + m_Retired.size()); }
+private:
+    struct RetiredIndex
+    {
+        uint32_t index;
+        uint64_t frame;
+    };
+
+    void Write(uint32_t index, VkImageView imageView, VkSampler sampler, VkImageLayout layout);
+private:
+    VulkanDevice* m_Device;
+    VkDescriptorSetLayout m_SetLayout;
+    VkDescriptorPool m_Pool;
+    VkDescriptorSet m_Set;
+    uint32_t m_Capacity;
+    uint32_t m_FramesInFlight;
+
+    // Slots below m_NextIndex have been handed out at least once
+    uint32_t m_NextIndex;
+    std::vector<uint32_t> m_FreeIndices;
+    std::vector<RetiredIndex> m_Retired;
+    uint64_t m_Frame;
+};
+
+}
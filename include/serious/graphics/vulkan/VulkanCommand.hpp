@@ -1,12 +1,14 @@
 #pragma once
 
-#include "serious/graphics/vulkan/VulkanDevice.hpp"
+#include "serious/graphics/vulkan/VulkanUtils.hpp"
 
 #include <vulkan/vulkan.h>
 
 namespace serious
 {
 
+class VulkanQueue;
+
 class VulkanCommandBuffer final
 {
 public:
@@ -14,23 +16,48 @@ public:
 
     void BeginRenderPass(const VkRenderPassBeginInfo& renderPassInfo, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
     void EndRenderPass();
+    void BeginRendering(const VkRenderingInfo& renderingInfo);
+    void EndRendering();
     void NextSubpass(VkSubpassContents contents);
     void Begin(VkCommandBufferUsageFlags flags);
     // Begin recording a command buffer for a single use, no need to reset
     void BeginSingle();
+    // Begin a single use secondary command buffer that continues the given render pass.
+    // pipelineStatistics are the flags of the statistics query active in the primary, if any
+    void BeginSecondary(VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer, VkQueryPipelineStatisticFlags pipelineStatistics = 0);
+    // Begin a single use secondary command buffer that continues dynamic rendering with the given formats
+    void BeginSecondary(const VkCommandBufferInheritanceRenderingInfo& renderingInfo, VkQueryPipelineStatisticFlags pipelineStatistics = 0);
     void End();
     void Reset();
     void BindGraphicsPipeline(VkPipeline pipeline);
-    void BindVertexBuffer(VkBuffer buffer, uint32_t offset);
+    void BindComputePipeline(VkPipeline pipeline);
+    void BindVertexBuffer(VkBuffer buffer, uint32_t offset, uint32_t binding = 0);
     void BindIndexBuffer(VkBuffer buffer, uint32_t offset, VkIndexType type);
-    void BindDescriptorSet(VkPipelineLayout layout, const VkDescriptorSet& descriptorSet);
+    void BindDescriptorSet(VkPipelineLayout layout, const VkDescriptorSet& descriptorSet, uint32_t firstSet = 0);
+    // Bind a set with a single dynamic buffer descriptor at the given offset
+    void BindDescriptorSet(VkPipelineLayout layout, const VkDescriptorSet& descriptorSet, uint32_t firstSet, uint32_t dynamicOffset);
+    void BindComputeDescriptorSet(VkPipelineLayout layout, const VkDescriptorSet& descriptorSet, uint32_t firstSet = 0);
+    void PushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t size, const void* data, uint32_t offset = 0);
+    void FillBuffer(VkBuffer buffer, uint32_t data, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
     void CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+    void CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset);
     void CopyBufferToImage(VkBuffer buffer, VkImage image, const VkBufferImageCopy* region);
+    // Source in TRANSFER_SRC_OPTIMAL
+    void CopyImageToBuffer(VkImage image, VkBuffer buffer, const VkBufferImageCopy* region);
+    // Source in TRANSFER_SRC_OPTIMAL and destination in TRANSFER_DST_OPTIMAL
+    void BlitImage(VkImage src, VkImage dst, const VkImageBlit& region, VkFilter filter);
     void Draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance);
     void DrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+    // Read up to maxDrawCount VkDrawIndexedIndirectCommand, the actual count comes from countBuffer
+    void DrawIndexedIndirectCount(VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride);
+    void Dispatch(uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+    void ExecuteCommands(const std::vector<VkCommandBuffer>& secondaryCmdBufs);
     void PipelineMemoryBarrier(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, const VkMemoryBarrier* memory);
     void PipelineBufferBarrier(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, const VkBufferMemoryBarrier* bufferMemory);
     void PipelineImageBarrier(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, const VkImageMemoryBarrier* imageMemory);
+    void PipelineBarriers(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, const std::vector<VkBufferMemoryBarrier>& bufferMemory, const std::vector<VkImageMemoryBarrier>& imageMemory);
+    // Synchronization2 barriers, stages and accesses are given per barrier
+    void PipelineBarriers2(const std::vector<VkBufferMemoryBarrier2>& bufferMemory, const std::vector<VkImageMemoryBarrier2>& imageMemory);
     void SubmitOnceTo(VulkanQueue& queue, VkFence fence = VK_NULL_HANDLE);
 
     void SetViewport(const VkViewport& viewport);
@@ -46,8 +73,10 @@ private:
 class VulkanCommandPool final
 {
 public:
-    VulkanCommandBuffer Allocate();
+    VulkanCommandBuffer Allocate(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
     void Free(VulkanCommandBuffer& cmdBuf);
+    // Return every command buffer of the pool to the initial state at once
+    void Reset();
 private:
     VkCommandPool m_CmdPool;
     VkDevice m_Device;
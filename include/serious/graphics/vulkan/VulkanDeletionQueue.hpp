@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace serious
+{
+
+/**
+ * @brief Vulkan objects released once the last frame that may use them has completed
+ *
+ * Releases pushed while frame N is recorded, or before it is submitted, are tagged with N.
+ * Collect is handed the last frame whose fence has been waited on and runs the releases tagged
+ * up to it in push order, so destroying an object never waits on the GPU. Render thread only.
+ */
+class VulkanDeletionQueue final
+{
+public:
+    VulkanDeletionQueue();
+    // Run every release at once, the device must be idle
+    void Flush();
+
+    void Push(std::function<void()>&& release);
+    // Run the releases tagged with a frame less than or equal to completedFrame
+    void Collect(uint64_t completedFrame);
+    // Called once the current frame is submitted
+    inline void NextFrame() { m_Frame++; }
+
+    inline uint64_t GetFrame() const { return m_Frame; }
+    inline size_t GetPendingCount() const { return m_Entries.size(); }
+private:
+    struct Entry
+    {
+        uint64_t frame;
+        std::function<void()> release;
+    };
+
+    std::deque<Entry> m_Entries;
+    // Frame being recorded, the number of frames submitted so far
+    uint64_t m_Frame;
+};
+
+}
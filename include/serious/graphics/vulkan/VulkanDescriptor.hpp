@@ -7,14 +7,49 @@
 namespace serious
 {
 
-class DescriptorAllocator
+/**
+ * @brief Growable descriptor set allocator built on a list of pools
+ *
+ * Sets are bump allocated from the current pool. When it runs out with
+ * VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL the next pool is taken from
+ * the free list, or created with twice the sets of the previous one.
+ * Sets are never freed one by one, Reset returns every pool with vkResetDescriptorPool,
+ * which makes an allocator per frame in flight a cheap home for transient sets.
+ */
+class DescriptorAllocator final
 {
 public:
+    // Descriptors of a type reserved per set in each pool
+    struct PoolSizeRatio
+    {
+        VkDescriptorType type;
+        float ratio;
+    };
 
+    static constexpr uint32_t MaxSetsPerPool = 4096;
+
+    DescriptorAllocator();
+    void Init(VkDevice device, uint32_t setsPerPool, const std::vector<PoolSizeRatio>& ratios);
+    void Destroy();
+
+    VkDescriptorSet Allocate(VkDescriptorSetLayout layout, const void* pNext = nullptr);
+    void Allocate(VkDescriptorSetLayout layout, std::vector<VkDescriptorSet>& descriptorSets);
+    // Invalidate every set allocated so far and keep the pools for reuse
+    void Reset();
+
+    inline uint32_t GetPoolCount() const { return static_cast<uint32_t>(m_UsedPools.size() + m_FreePools.size()); }
+    inline uint32_t GetAllocatedSetCount() const { return m_AllocatedSetCount; }
+private:
+    VkDescriptorPool GrabPool();
+    VkDescriptorPool CreatePool(uint32_t setCount);
 private:
-    VkDevice device;
-    std::vector<VkDescriptorSetLayout> m_DescriptorSetLayouts;
-    VkDescriptorPool m_DescriptorPool;
+    VkDevice m_Device;
+    std::vector<PoolSizeRatio> m_Ratios;
+    uint32_t m_SetsPerPool;
+    // The last pool of m_UsedPools is the one allocated from
+    std::vector<VkDescriptorPool> m_UsedPools;
+    std::vector<VkDescriptorPool> m_FreePools;
+    uint32_t m_AllocatedSetCount;
 };
 
-}
\ No newline at end of file
+}
@@ -2,15 +2,21 @@
 
 #include "serious/Utils.hpp"
 #include "serious/graphics/vulkan/VulkanObjects.hpp"
+#include "serious/graphics/vulkan/VulkanAllocator.hpp"
+#include "serious/graphics/vulkan/VulkanBindless.hpp"
+#include "serious/graphics/vulkan/VulkanDeletionQueue.hpp"
+#include "serious/graphics/vulkan/VulkanDescriptor.hpp"
+#include "serious/graphics/vulkan/VulkanImageTracker.hpp"
+#include "serious/graphics/vulkan/VulkanLayoutCache.hpp"
+#include "serious/graphics/vulkan/VulkanPipelineCache.hpp"
+#include "serious/graphics/vulkan/VulkanStagingRing.hpp"
+#include "serious/graphics/vulkan/VulkanUploader.hpp"
 
 #include <vulkan/vulkan.h>
 
 namespace serious
 {
 
-class VulkanCommandPool;
-class VulkanCommandBuffer;
-
 class VulkanQueue final
 {
 public:
@@ -40,7 +46,8 @@ private:
 class VulkanDevice final
 {
 public:
-    VulkanDevice(VkInstance instance);
+    // Without presentation no swapchain extension is required, for headless rendering
+    VulkanDevice(VkInstance instance, bool presentation = true);
     ~VulkanDevice();
 
     void Destroy();
@@ -50,19 +57,27 @@ public:
     VulkanShaderModule CreateShaderModule(std::string_view file, VkShaderStageFlagBits flag, std::string_view entry);
     VulkanFence        CreateFence(VkFenceCreateFlags flags = 0);
     VkSemaphore        CreateSemaphore();
-    VulkanImage        CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling imageTiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
-    VkImageView        CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkComponentMapping mapping = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY});
+    VkSemaphore        CreateTimelineSemaphore(uint64_t initialValue = 0);
+    // Dedicated images get their own VkDeviceMemory instead of a block sub-range (render targets).
+    // Images are registered in the image tracker until DestroyImage
+    VulkanImage        CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling imageTiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, bool dedicated = false, uint32_t mipLevels = 1);
+    VkImageView        CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkComponentMapping mapping = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY}, uint32_t mipLevels = 1);
     VkFramebuffer      CreateFramebuffer(const VkExtent2D& extent, VkRenderPass renderPass, const std::vector<VkImageView>& attachments);
     VulkanCommandPool  CreateCommandPool(const VulkanQueue& queue);
     void               CreateBuffer(VulkanBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
     void               CopyToBuffer(VulkanBuffer& buffer, const void* data, VkDeviceSize size);
     void               CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize offset, VulkanCommandBuffer& tsfCmd);
-    void               CreateDeviceBuffer(VulkanBuffer& buffer, VkDeviceSize size, void* data, VkBufferUsageFlags usage, VulkanCommandBuffer& tsfCmd);
+    // Blocking copy of a 4 byte per texel color image in TRANSFER_SRC_OPTIMAL, gfxCmd from a graphics pool
+    void               ReadImage(VkImage image, const VkExtent2D& extent, void* dst, VulkanCommandBuffer& gfxCmd);
+    // Upload is submitted to the transfer queue without waiting, the returned token signals completion
+    VulkanUploadToken  CreateDeviceBuffer(VulkanBuffer& buffer, VkDeviceSize size, const void* data, VkBufferUsageFlags usage);
     void               MapBuffer(VulkanBuffer& buffer, VkDeviceSize size, VkDeviceSize offset);
     void               UnmapBuffer(VulkanBuffer& buffer);
-    void               TransitionImageLayout(VkImage image, VkImageLayout srcLayout, VkImageLayout dstLayout, VkImageAspectFlags aspectFlags, VulkanCommandBuffer& cmd);
-    void               CreateTextureImage(VulkanTexture& texture, const std::string& path, VkFormat format, VkComponentMapping mapping, VulkanCommandBuffer& gfxCmd);
-    void               CreateDepthImage(VulkanTexture& texture, const VkExtent2D& extent, VulkanCommandBuffer& gfxCmd);
+    // Full mip chain, levels missing from the pixels are generated
+    VulkanUploadToken  CreateTextureImage(VulkanTexture& texture, const VulkanTexturePixels& pixels, VkFormat format, VkComponentMapping mapping);
+    // Decode the image and the levels found next to it as <name>_mip<level><ext>, safe to call from
+    // any thread. A single error texel is returned when the image cannot be loaded
+    VulkanTexturePixels LoadTexturePixels(const std::string& path, VkFormat format) const;
 
     void DestroyImage(VulkanImage& image);
     void DestroyShaderModule(VulkanShaderModule& shaderModule);
@@ -70,11 +85,15 @@ public:
     void DestroyCommandPool(VulkanCommandPool& cmdPool);
     // Destroy buffer created by CreateBuffer and CreateDeviceBuffer
     void DestroyBuffer(VulkanBuffer& buffer);
-    // Destroy texture image created by CreateTextureImage and CreateDepthImage
+    // Destroy texture image created by CreateTextureImage
     void DestroyTextureImage(VulkanTexture& texture);
+    // Same as above once the frames recorded so far have completed, the handles are reset at once
+    void DeferDestroyBuffer(VulkanBuffer& buffer);
+    void DeferDestroyTextureImage(VulkanTexture& texture);
     
+    // Layout comes from the layout cache, identical bindings share one object
     void SetDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
-    void SetDescriptorPool(const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets);
+    // Persistent sets come from a growable allocator owned by the device
     void AllocateDescriptorSets(std::vector<VkDescriptorSet>& descriptorSets);
     void DestroyDescriptorResources();
 
@@ -82,19 +101,47 @@ public:
     inline VkPhysicalDevice           GetGpuHandle() const { return m_Gpu; }
     inline VkPhysicalDeviceProperties GetGpuProperties() const { return m_GpuProps; }
     inline VkDescriptorSetLayout      GetDescriptorSetLayout() const { return m_DescriptorSetLayout; }
+    inline DescriptorAllocator&       GetDescriptorAllocator() { return m_DescriptorAllocator; }
+    inline DescriptorSetLayoutCache&  GetDescriptorSetLayoutCache() { return m_DescriptorSetLayoutCache; }
+    inline PipelineLayoutCache&       GetPipelineLayoutCache() { return m_PipelineLayoutCache; }
+    inline VulkanBindlessTable&       GetBindlessTable() { return m_BindlessTable; }
+    inline bool                       IsBindlessSupported() const { return m_BindlessSupport; }
+    inline bool                       IsDrawIndirectCountSupported() const { return m_DrawIndirectCountSupport; }
+    inline bool                       IsDynamicRenderingSupported() const { return m_DynamicRenderingSupport; }
+    inline bool                       IsPipelineStatisticsSupported() const { return m_PipelineStatisticsSupport; }
+    inline bool                       IsInheritedQueriesSupported() const { return m_InheritedQueriesSupport; }
+    // Optimal tiling images of the format can be downsampled with linear blits
+    bool                              IsLinearBlitSupported(VkFormat format) const;
+    static uint32_t                   GetMipLevelCount(uint32_t width, uint32_t height);
+    inline VulkanAllocator&           GetAllocator() { return m_Allocator; }
+    inline VulkanImageTracker&        GetImageTracker() { return m_ImageTracker; }
+    inline VulkanDeletionQueue&       GetDeletionQueue() { return m_DeletionQueue; }
+    inline VulkanPipelineCache&       GetPipelineCache() { return m_PipelineCache; }
+    inline VulkanStagingRing&         GetStagingRing() { return m_StagingRing; }
+    inline VulkanUploader&            GetUploader() { return m_Uploader; }
     inline Ref<VulkanQueue>           GetGraphicsQueue() { return m_GraphicsQueue; }
     inline Ref<VulkanQueue>           GetComputeQueue() { return m_ComputeQueue; }
     inline Ref<VulkanQueue>           GetTransferQueue() { return m_TransferQueue; }
     inline Ref<VulkanQueue>           GetPresentQueue() { return m_PresentQueue; }
 private:
     void SelectGpu(VkInstance instance);
-    uint32_t FindMemoryTypeIdx(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags);
 private:
     VkDevice m_Device;
     VkPhysicalDevice m_Gpu;
     VkPhysicalDeviceProperties m_GpuProps;
     VkPhysicalDeviceMemoryProperties m_GpuMemoryProps;
     bool m_DeviceLocalMemorySupport;
+    bool m_BindlessSupport;
+    bool m_DrawIndirectCountSupport;
+    bool m_DynamicRenderingSupport;
+    bool m_PipelineStatisticsSupport;
+    bool m_InheritedQueriesSupport;
+    VulkanAllocator m_Allocator;
+    VulkanImageTracker m_ImageTracker;
+    VulkanDeletionQueue m_DeletionQueue;
+    VulkanPipelineCache m_PipelineCache;
+    VulkanStagingRing m_StagingRing;
+    VulkanUploader m_Uploader;
     VulkanFence m_OperationFence;
     
     Ref<VulkanQueue> m_GraphicsQueue;
@@ -102,8 +149,11 @@ private:
     Ref<VulkanQueue> m_TransferQueue;
     Ref<VulkanQueue> m_PresentQueue;
 
+    DescriptorSetLayoutCache m_DescriptorSetLayoutCache;
+    PipelineLayoutCache m_PipelineLayoutCache;
     VkDescriptorSetLayout m_DescriptorSetLayout;
-    VkDescriptorPool m_DescriptorPool;
+    VulkanBindlessTable m_BindlessTable;
+    DescriptorAllocator m_DescriptorAllocator;
 };
 
 }
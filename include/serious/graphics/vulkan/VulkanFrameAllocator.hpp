@@ -0,0 +1,76 @@
+#pragma once
+
+#include "serious/graphics/vulkan/VulkanObjects.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstring>
+
+namespace serious
+{
+
+class VulkanDevice;
+
+/**
+ * @brief Slice of the frame allocator, valid until its frame slot comes around again
+ */
+struct VulkanFrameAllocation
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    // Offset from the start of the buffer, usable directly as a dynamic offset
+    uint32_t offset = 0;
+    void* mapped = nullptr;
+};
+
+/**
+ * @brief Persistently mapped linear allocator for transient per frame data
+ *
+ * One host visible buffer is split into a region per frame in flight. Allocations are
+ * bumped inside the region of the current frame and aligned to minUniformBufferOffsetAlignment,
+ * so each one can be bound through a dynamic uniform offset. The buffer is also usable as vertex,
+ * index and copy source, for streamed buffers and staged updates. BeginFrame rewinds a region and
+ * must only be called once the fence of that frame slot has been waited on.
+ */
+class VulkanFrameAllocator final
+{
+public:
+    static constexpr VkDeviceSize DefaultFrameSize = 4ull * 1024 * 1024;
+
+    VulkanFrameAllocator();
+    void Init(VulkanDevice* device, uint32_t framesInFlight, VkDeviceSize frameSize = DefaultFrameSize);
+    void Destroy();
+
+    void BeginFrame(uint32_t frame);
+    // Returns an empty allocation (mapped == nullptr) when the frame region is exhausted.
+    // The offset is aligned to the larger of alignment and the uniform offset alignment
+    VulkanFrameAllocation Allocate(VkDeviceSize size, VkDeviceSize alignment = 1);
+    template<typename T>
+    VulkanFrameAllocation Push(const T& data)
+    {
+        VulkanFrameAllocation allocation = Allocate(sizeof(T));
+        if (allocation.mapped) {
+            memcpy(allocation.mapped, &data, sizeof(T));
+        }
+        return allocation;
+    }
+
+    inline VkBuffer GetBuffer() const { return m_Buffer.buffer; }
+    inline VkDeviceSize GetFrameSize() const { return m_FrameSize; }
+    inline VkDeviceSize GetAlignment() const { return m_Alignment; }
+    // Bytes handed out in the current frame, alignment padding included
+    inline VkDeviceSize GetUsedBytes() const { return m_Head - m_FrameBegin; }
+    inline uint32_t GetAllocationCount() const { return m_AllocationCount; }
+private:
+    VulkanDevice* m_Device;
+    VulkanBuffer m_Buffer;
+    VkDeviceSize m_FrameSize;
+    VkDeviceSize m_Alignment;
+    uint32_t m_FramesInFlight;
+    VkDeviceSize m_FrameBegin;
+    VkDeviceSize m_Head;
+    uint32_t m_AllocationCount;
+    // Warn once per frame when the region runs out
+    bool m_Exhausted;
+};
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "serious/graphics/Objects.hpp"
+#include "serious/graphics/vulkan/VulkanCommand.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace tracy
+{
+class VkCtx;
+}
+
+namespace serious
+{
+
+class VulkanDevice;
+
+/**
+ * @brief GPU timestamps and pipeline statistics of the frames in flight
+ *
+ * Every frame slot owns its query pools. BeginFrame is recorded once the fence of the slot has
+ * been waited on, so the results of the frame that last used the slot are available and are read
+ * back without waiting before the pools are reset. Zones are also forwarded to a Tracy Vulkan
+ * context when the profiler is enabled. Zones must be recorded into the primary command buffer
+ * of the frame. Secondary command buffers executed while statistics are collected must inherit
+ * GetActiveStatistics, which needs inherited queries, see CanExecuteSecondary.
+ */
+class VulkanGpuProfiler final
+{
+public:
+    static constexpr uint32_t MaxZonesPerFrame = 128;
+
+    VulkanGpuProfiler();
+    // Disabled when the graphics queue has no timestamps, the calibration of Tracy submits on cmdPool
+    void Init(VulkanDevice* device, VulkanCommandPool& cmdPool, uint32_t framesInFlight, bool pipelineStatistics);
+    void Destroy();
+
+    // Read back the previous results of the slot, reset its pools and open the frame
+    void BeginFrame(VulkanCommandBuffer& cmd, uint32_t frameIndex);
+    void EndFrame(VulkanCommandBuffer& cmd);
+    // Zones nest, returns false when the zone is dropped
+    bool BeginZone(VulkanCommandBuffer& cmd, const char* name);
+    void EndZone(VulkanCommandBuffer& cmd);
+
+    inline bool IsEnabled() const { return !m_Frames.empty(); }
+    // Flags of the statistics query open in the current frame, zero when none is
+    VkQueryPipelineStatisticFlags GetActiveStatistics() const;
+    // False when a statistics query is open and the device cannot inherit it
+    bool CanExecuteSecondary() const;
+    inline const GpuFrameProfile& GetLastProfile() const { return m_LastProfile; }
+private:
+    struct Zone
+    {
+        std::string name;
+        uint32_t depth;
+        uint32_t beginQuery;
+        uint32_t endQuery;
+    };
+
+    struct FrameQueries
+    {
+        VkQueryPool timestamps = VK_NULL_HANDLE;
+        VkQueryPool statistics = VK_NULL_HANDLE;
+        uint64_t frame = 0;
+        uint32_t queryCount = 0;
+        std::vector<Zone> zones;
+    };
+
+    void ReadBack(FrameQueries& queries);
+    uint32_t WriteTimestamp(VulkanCommandBuffer& cmd, VkPipelineStageFlags2 stage);
+private:
+    VulkanDevice* m_Device;
+    std::vector<FrameQueries> m_Frames;
+    FrameQueries* m_Current;
+    // Indices into the zones of the current frame
+    std::vector<uint32_t> m_OpenZones;
+    uint64_t m_FrameCount;
+    double m_TimestampPeriod;
+    uint64_t m_TimestampMask;
+    bool m_PipelineStatistics;
+    GpuFrameProfile m_LastProfile;
+
+    tracy::VkCtx* m_TracyContext;
+    // Storage of the open Tracy zones, one per nesting depth, reused by every frame
+    std::vector<std::byte> m_TracyZones;
+};
+
+/**
+ * @brief Zone of the GPU profiler closed at the end of the C++ scope
+ */
+class VulkanGpuScope final
+{
+public:
+    VulkanGpuScope(VulkanGpuProfiler& profiler, VulkanCommandBuffer& cmd, const char* name)
+        : m_Profiler(profiler)
+        , m_Cmd(cmd)
+        , m_Active(profiler.BeginZone(cmd, name))
+    {
+    }
+    ~VulkanGpuScope()
+    {
+        if (m_Active) {
+            m_Profiler.EndZone(m_Cmd);
+        }
+    }
+    VulkanGpuScope(const VulkanGpuScope&) = delete;
+    VulkanGpuScope& operator=(const VulkanGpuScope&) = delete;
+private:
+    VulkanGpuProfiler& m_Profiler;
+    VulkanCommandBuffer& m_Cmd;
+    bool m_Active;
+};
+
+}
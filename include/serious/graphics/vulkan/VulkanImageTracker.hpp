@@ -0,0 +1,94 @@
+#pragma once
+
+#include "serious/graphics/vulkan/VulkanCommand.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace serious
+{
+
+// Declared use of an image, each one maps to a layout, stages and accesses
+enum class VulkanImageUsage
+{
+    Undefined,
+    TransferSrc,
+    TransferDst,
+    // Read by fragment or compute shaders
+    Sampled,
+    ColorAttachment,
+    DepthAttachment,
+    Present
+};
+
+struct VulkanImageState
+{
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 access = VK_ACCESS_2_NONE;
+};
+
+/**
+ * @brief Barriers collected for one command buffer and recorded by a single vkCmdPipelineBarrier2
+ */
+class VulkanBarrierBatch final
+{
+public:
+    inline void AddImage(const VkImageMemoryBarrier2& barrier) { m_ImageBarriers.push_back(barrier); }
+    inline void AddBuffer(const VkBufferMemoryBarrier2& barrier) { m_BufferBarriers.push_back(barrier); }
+    // Record every pending barrier, does nothing when there is none
+    void Flush(VulkanCommandBuffer& cmd);
+
+    inline bool IsEmpty() const { return m_ImageBarriers.empty() && m_BufferBarriers.empty(); }
+    inline size_t GetImageBarrierCount() const { return m_ImageBarriers.size(); }
+    bool ContainsImage(VkImage image) const;
+private:
+    std::vector<VkImageMemoryBarrier2> m_ImageBarriers;
+    std::vector<VkBufferMemoryBarrier2> m_BufferBarriers;
+};
+
+/**
+ * @brief Layout and access state of every mip level and array layer of the registered images
+ *
+ * Transition compares the declared usage with the tracked state of each subresource and adds
+ * the barriers it needs to a batch, read after read in the same layout needs none. Barriers of
+ * adjacent mip levels sharing the same state are merged. Nothing is ever submitted, the batch is
+ * flushed by whoever records the command buffer. State is shared by every thread.
+ */
+class VulkanImageTracker final
+{
+public:
+    VulkanImageTracker();
+
+    void Register(VkImage image, VkImageAspectFlags aspect, uint32_t mipLevels = 1, uint32_t layerCount = 1);
+    void Unregister(VkImage image);
+    // Forget the contents, the next transition starts from UNDEFINED
+    void Discard(VkImage image);
+
+    // Whole image when range is null
+    void Transition(VulkanBarrierBatch& batch, VkImage image, VulkanImageUsage usage, const VkImageSubresourceRange* range = nullptr);
+    // Queue family release of the whole image towards usage, the returned acquire goes into the destination queue
+    VkImageMemoryBarrier2 Release(VulkanBarrierBatch& batch, VkImage image, VulkanImageUsage usage, uint32_t srcFamilyIndex, uint32_t dstFamilyIndex);
+
+    VkImageLayout GetLayout(VkImage image, uint32_t mipLevel = 0, uint32_t layer = 0) const;
+    uint32_t GetMipLevels(VkImage image) const;
+    static VulkanImageState GetUsageState(VulkanImageUsage usage);
+    static VkImageAspectFlags GetAspect(VkFormat format);
+private:
+    struct TrackedImage
+    {
+        VkImageAspectFlags aspect;
+        uint32_t mipLevels;
+        uint32_t layerCount;
+        // mipLevel * layerCount + layer
+        std::vector<VulkanImageState> subresources;
+    };
+private:
+    mutable std::mutex m_Mutex;
+    std::unordered_map<VkImage, TrackedImage> m_Images;
+};
+
+}
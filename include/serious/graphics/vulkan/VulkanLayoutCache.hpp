@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace serious
+{
+
+struct VulkanLayoutCacheStats
+{
+    uint32_t hitCount = 0;
+    uint32_t missCount = 0;
+};
+
+/**
+ * @brief Deduplicates VkDescriptorSetLayout by the hash of its bindings
+ *
+ * Bindings are compared after sorting by binding index, so declaration order does not matter.
+ * The cache owns every layout it returns.
+ */
+class DescriptorSetLayoutCache final
+{
+public:
+    DescriptorSetLayoutCache();
+    void Init(VkDevice device);
+    void Destroy();
+
+    // bindingFlags is either empty or holds one entry per binding, in the order of bindings
+    VkDescriptorSetLayout Get(
+        const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+        VkDescriptorSetLayoutCreateFlags flags = 0,
+        const std::vector<VkDescriptorBindingFlags>& bindingFlags = {});
+
+    VulkanLayoutCacheStats GetStats() const;
+private:
+    struct Binding
+    {
+        VkDescriptorSetLayoutBinding binding;
+        VkDescriptorBindingFlags flags;
+    };
+
+    struct Key
+    {
+        std::vector<Binding> bindings;
+        VkDescriptorSetLayoutCreateFlags flags;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+private:
+    VkDevice m_Device;
+    mutable std::mutex m_Mutex;
+    std::unordered_map<Key, VkDescriptorSetLayout, KeyHash> m_Layouts;
+    VulkanLayoutCacheStats m_Stats;
+};
+
+/**
+ * @brief Deduplicates VkPipelineLayout by its set layouts and push constant ranges
+ *
+ * Pipelines created with the same layout keep their descriptor bindings when switched.
+ */
+class PipelineLayoutCache final
+{
+public:
+    PipelineLayoutCache();
+    void Init(VkDevice device);
+    void Destroy();
+
+    VkPipelineLayout Get(
+        const std::vector<VkDescriptorSetLayout>& setLayouts,
+        const std::vector<VkPushConstantRange>& pushConstantRanges = {});
+
+    VulkanLayoutCacheStats GetStats() const;
+private:
+    struct Key
+    {
+        std::vector<VkDescriptorSetLayout> setLayouts;
+        std::vector<VkPushConstantRange> pushConstantRanges;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+private:
+    VkDevice m_Device;
+    mutable std::mutex m_Mutex;
+    std::unordered_map<Key, VkPipelineLayout, KeyHash> m_Layouts;
+    VulkanLayoutCacheStats m_Stats;
+};
+
+}
@@ -1,9 +1,12 @@
 #pragma once
 #include "serious/graphics/vulkan/VulkanUtils.hpp"
+#include "serious/graphics/vulkan/VulkanAllocator.hpp"
 
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 
+#include <vector>
+
 namespace serious
 {
 
@@ -13,6 +16,12 @@ struct UniformBufferObject {
     glm::mat4 proj;
 };
 
+// Pushed before every draw of a graphics pipeline
+struct DrawConstants {
+    // Bindless table slot, VulkanBindlessTable::InvalidIndex when the draw has no texture
+    uint32_t textureIndex;
+};
+
 /**
  * @brief VkFence wrapper class
  *
@@ -60,14 +69,14 @@ struct VulkanShaderModule
 struct VulkanBuffer
 {
     VkBuffer buffer = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VulkanAllocation allocation = {};
     void* mapped = nullptr;
 };
 
 struct VulkanImage
 {
     VkImage image = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VulkanAllocation allocation = {};
     VkImageView view = VK_NULL_HANDLE;
 };
 
@@ -79,11 +88,35 @@ struct VulkanTexture
 {
     uint32_t width = 0;
     uint32_t height = 0;
+    uint32_t mipLevels = 1;
     VulkanImage image = {};
     VkImageView imageView = VK_NULL_HANDLE;
     VkSampler sampler = VK_NULL_HANDLE;
 };
 
+/**
+ * @brief Decoded texture levels waiting to be uploaded
+ */
+struct VulkanTexturePixels
+{
+    // Magenta texel shown for missing or not yet loaded textures
+    static constexpr uint32_t ErrorTexel = 0xFF00FFFF;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Tightly packed RGBA8 from level 0, missing levels of the mip chain are generated on the GPU
+    std::vector<std::vector<uint32_t>> levels;
+
+    inline VkDeviceSize GetSize() const
+    {
+        VkDeviceSize size = 0;
+        for (const std::vector<uint32_t>& level : levels) {
+            size += level.size() * sizeof(uint32_t);
+        }
+        return size;
+    }
+};
+
 enum class VulkanQueueUsage
 {
     Graphics,
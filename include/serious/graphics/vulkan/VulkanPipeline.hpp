@@ -1,15 +1,28 @@
 #pragma once
 #include "serious/graphics/Objects.hpp"
 #include "serious/graphics/vulkan/VulkanDevice.hpp"
-#include "serious/graphics/vulkan/VulkanSwapchain.hpp"
 
 #include <vulkan/vulkan.h>
 
+#include <atomic>
 #include <vector>
 
 namespace serious
 {
 
+// Attachment formats a pipeline is created against when it has no render pass
+struct VulkanRenderingFormats
+{
+    VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+};
+
+/**
+ * @brief Graphics pipeline whose VkPipeline may be compiled later, possibly on another thread
+ *
+ * The layout comes from the device layout cache at construction. The pipeline itself is built by Create or
+ * CreateBatch, and IsReady turns true once it can be bound.
+ */
 class VulkanPipeline final
 {
 public:
@@ -17,16 +30,51 @@ public:
                    const std::vector<VulkanShaderModule>& shaders,
                    ColorBlendingMode blendingMode,
                    VkRenderPass renderPass,
-                   VulkanSwapchain& swapchain);
+                   const VulkanRenderingFormats& renderingFormats = {});
     ~VulkanPipeline();
+    void Create();
+    void Destroy();
+    // Compile all pipelines with a single vkCreateGraphicsPipelines call
+    static void CreateBatch(VulkanDevice* device, const std::vector<VulkanPipeline*>& pipelines);
+
+    inline bool IsReady() const { return m_Ready.load(std::memory_order_acquire); }
+    inline VkPipeline GetHandle() const { return m_Pipeline; }
+    inline VkPipelineLayout GetPipelineLayout() const { return m_PipelineLayout; }
+    inline ColorBlendingMode GetBlendingMode() const { return m_BlendingMode; }
+private:
+    VkPipeline m_Pipeline;
+    VulkanDevice* m_Device;
+    VkPipelineLayout m_PipelineLayout;
+    std::vector<VulkanShaderModule> m_Shaders;
+    ColorBlendingMode m_BlendingMode;
+    // Null for dynamic rendering, the formats are used instead
+    VkRenderPass m_RenderPass;
+    VulkanRenderingFormats m_RenderingFormats;
+    std::atomic<bool> m_Ready;
+};
+
+/**
+ * @brief Compute pipeline built from a single compute shader
+ *
+ * The layout comes from the device layout cache, like graphics pipelines.
+ */
+class VulkanComputePipeline final
+{
+public:
+    VulkanComputePipeline(VulkanDevice* device,
+                          const VulkanShaderModule& shader,
+                          const std::vector<VkDescriptorSetLayout>& setLayouts,
+                          const std::vector<VkPushConstantRange>& pushConstantRanges = {});
+    void Create();
     void Destroy();
-    
+
     inline VkPipeline GetHandle() const { return m_Pipeline; }
     inline VkPipelineLayout GetPipelineLayout() const { return m_PipelineLayout; }
 private:
     VkPipeline m_Pipeline;
     VulkanDevice* m_Device;
     VkPipelineLayout m_PipelineLayout;
+    VulkanShaderModule m_Shader;
 };
 
 }
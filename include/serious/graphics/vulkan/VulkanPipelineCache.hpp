@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <mutex>
+#include <string>
+
+namespace serious
+{
+
+struct VulkanPipelineCacheStats
+{
+    uint32_t pipelineCount = 0;
+    // Pipelines the driver reported as served from the cache
+    uint32_t hitCount = 0;
+    uint64_t hitNanoseconds = 0;
+    uint64_t missNanoseconds = 0;
+    // Compile time saved by hits, estimated from the average miss of this and previous runs
+    double savedMilliseconds = 0.0;
+    // Size of the initial data accepted at Load, 0 on a cold start
+    size_t loadedBytes = 0;
+};
+
+/**
+ * @brief Device owned VkPipelineCache persisted on disk
+ *
+ * The file starts with a small header of our own that carries the compile times
+ * of previous runs, followed by the driver blob. The blob is only used when its
+ * header matches the vendor ID, device ID and pipelineCacheUUID of the current GPU.
+ * Pipeline creation feedback is fed back through RecordFeedback to count cache hits.
+ */
+class VulkanPipelineCache final
+{
+public:
+    VulkanPipelineCache();
+    void Init(VkDevice device, const VkPhysicalDeviceProperties& gpuProps);
+    void Destroy();
+
+    // Create the cache from the file at path, an empty cache is created when it is missing or stale
+    void Load(const std::string& path);
+    void Save(const std::string& path) const;
+    void RecordFeedback(const VkPipelineCreationFeedback& feedback);
+
+    VulkanPipelineCacheStats GetStats() const;
+    void LogStats() const;
+    inline VkPipelineCache GetHandle() const { return m_Cache; }
+private:
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t dataSize;
+        uint64_t missNanoseconds;
+        uint64_t missCount;
+    };
+
+    static constexpr uint32_t FileMagic = 0x43505345; // "ESPC"
+    static constexpr uint32_t FileVersion = 1;
+
+    bool Validate(const char* data, size_t size) const;
+private:
+    VkDevice m_Device;
+    VkPhysicalDeviceProperties m_GpuProps;
+    VkPipelineCache m_Cache;
+
+    mutable std::mutex m_Mutex;
+    VulkanPipelineCacheStats m_Stats;
+    // Compile times carried over from previous runs
+    uint64_t m_HistoryMissNanoseconds;
+    uint64_t m_HistoryMissCount;
+};
+
+}
@@ -1,11 +1,17 @@
 #pragma once
 
+#include "serious/core/ThreadPool.hpp"
 #include "serious/graphics/Objects.hpp"
 #include "serious/graphics/RHI.hpp"
+#include "serious/graphics/RenderQueue.hpp"
 #include "serious/graphics/vulkan/VulkanDevice.hpp"
+#include "serious/graphics/vulkan/VulkanFrameAllocator.hpp"
+#include "serious/graphics/vulkan/VulkanGpuProfiler.hpp"
 #include "serious/graphics/vulkan/VulkanSwapchain.hpp"
 #include "serious/graphics/vulkan/VulkanCommand.hpp"
 #include "serious/graphics/vulkan/VulkanPipeline.hpp"
+#include "serious/graphics/vulkan/VulkanRenderGraph.hpp"
+#include "serious/graphics/vulkan/VulkanTextureStreamer.hpp"
 
 #include "serious/graphics/Camera.hpp"
 
@@ -19,19 +25,37 @@ public:
     virtual ~VulkanRHI() = default;
     virtual void Init(void* window) override;
     virtual bool AssureResource() override;
+    virtual ResourceReport GetResourceReport() const override { return m_ResourceReport; }
+    virtual DrawStats GetDrawStats() const override { return m_DrawStats; }
+    virtual GpuFrameProfile GetGpuProfile() const override { return m_GpuProfiler.GetLastProfile(); }
+    virtual std::vector<uint8_t> ReadbackFrame() override;
     virtual void Shutdown() override;
     virtual void PrepareFrame() override;
     virtual void SubmitFrame() override;
     virtual void Update() override;
     // Deferred buffer creation
-    virtual RHIResourceIdx CreateShader(const ShaderDescription& description) override;
-    virtual RHIResource CreatePipeline(const PipelineDescription& description) override;
-    virtual RHIResourceIdx CreateBuffer(const BufferDescription& description) override;
-    virtual void BindPipeline(RHIResource pipeline) override;
-    virtual void DestroyPipeline(RHIResource pipeline) override;
+    virtual ShaderHandle CreateShader(const ShaderDescription& description) override;
+    virtual void DestroyShader(ShaderHandle shader) override;
+    virtual PipelineHandle CreatePipeline(const PipelineDescription& description) override;
+    virtual PipelineHandle CreatePipelineAsync(const PipelineDescription& description) override;
+    virtual bool IsPipelineReady(PipelineHandle pipeline) const override;
+    virtual BufferHandle CreateBuffer(const BufferDescription& description) override;
+    virtual void DestroyBuffer(BufferHandle buffer) override;
+    virtual TextureHandle CreateTexture(const TextureDescription& description) override;
+    virtual void DestroyTexture(TextureHandle texture) override;
+    virtual void UpdateBuffer(BufferHandle buffer, const void* data, size_t size, size_t offset = 0) override;
+    virtual void* MapBuffer(BufferHandle buffer, size_t offset, size_t size) override;
+    virtual void UnmapBuffer(BufferHandle buffer) override;
+    virtual void BindPipeline(PipelineHandle pipeline) override;
+    virtual void DestroyPipeline(PipelineHandle pipeline) override;
     virtual Camera& GetCamera() override { return m_Camera; }
 
     virtual void SetPasses(const std::vector<RenderPassDescription>& descriptions) override;
+    virtual CullPipelineHandle CreateCullPipeline(ShaderHandle computeShader) override;
+    virtual void DestroyCullPipeline(CullPipelineHandle pipeline) override;
+    virtual void SetIndirectPasses(const std::vector<IndirectPassDescription>& descriptions) override;
+
+    virtual void RecreateRenderGraph() override { BuildRenderGraph(); }
 
     virtual void SetClearColor(float r, float g, float b, float a) override;
     virtual void SetClearDepth(float depth) override;
@@ -40,12 +64,52 @@ private:
     void CreateInstance();
     void CreateCommandPool();
     void CreateSyncObjects();
+    // Render finished semaphores follow the swapchain images, not the frame slots
+    void CreatePresentSemaphores();
+    // Only used for pipeline compatibility, the graph creates the render passes that are begun
     void CreateRenderPass();
-    void CreateFramebuffers();
+    // Declare the frame passes over the current swapchain and compile them
+    void BuildRenderGraph();
+    // Pipeline of a pass, the bound one for null handles. Null when stale or still compiling
+    VulkanPipeline* GetReadyPipeline(PipelineHandle pipeline) const;
+    // Scene pass of the graph, every draw in a single render pass instance
+    void RecordScene(VulkanCommandBuffer& cmd, const RenderGraphContext& context);
     void SetDescriptorResources();
+    // Transient set for the current frame, valid until its allocator is reset
+    VkDescriptorSet AllocateFrameDescriptorSet();
+    // Wait on the fence of the current frame slot and rewind its frame allocator region, once per
+    // frame. Called by Update and by the first buffer write of the frame, whichever comes first
+    void BeginFrameWrites();
+    // Bring the copy of the current frame slot of every dirty dynamic buffer up to date
+    void FlushDynamicBuffers();
+    // Copy the staged static buffer updates, before anything of the frame reads the buffers
+    void RecordBufferCopies(VulkanCommandBuffer& cmd);
+    // Write the uniforms of every draw into the frame allocator, after the frame fence
     void UpdateUniforms();
+    // Sort the drawable passes by state and depth, after the uniforms of the frame are written
+    void BuildRenderQueue();
+    // Record entries [first, last) of the render queue, viewport and scissor included
+    void RecordDraws(VulkanCommandBuffer& cmd, size_t first, size_t last, VkDescriptorSet frameDescriptorSet, DrawStats& stats);
+    // Record the pass list into secondary command buffers on the workers, one partition each
+    std::vector<VkCommandBuffer> RecordDrawsParallel(uint32_t partitionCount, VkDescriptorSet frameDescriptorSet, const RenderGraphContext& context);
+    // Grow the culling outputs of the current frame slot to the object count of each indirect pass
+    void PrepareIndirectBuffers();
+    // Reset the draw counts and cull every indirect pass, recorded outside of the render pass
+    void RecordCulling(VulkanCommandBuffer& cmd);
+    // Draw the culling outputs, viewport and scissor are expected to be set already
+    void RecordIndirectDraws(VulkanCommandBuffer& cmd, VkDescriptorSet frameDescriptorSet);
+    // Bindless slot pushed to the draws sampling the texture
+    uint32_t GetTextureBindlessIndex(TextureHandle texture) const;
+    VulkanPipeline* NewPipeline(const PipelineDescription& description);
+    // Hand pending pipelines to the workers in one batch per thread
+    void DispatchPipelines();
+    // Destroy the retired pipelines whose compile is done, and the retired shaders once no compile is left
+    void ReleaseRetired();
 private:
     Settings m_Settings;
+    ThreadPool m_ThreadPool;
+    // Long decodes never queue ahead of draw recording or pipeline compiles
+    ThreadPool m_DecodeThreadPool;
 
     VkInstance m_Instance;
     VkDebugUtilsMessengerEXT m_DebugUtilsMessenger;
@@ -54,32 +118,119 @@ private:
     VulkanSwapchain m_Swapchain;
     uint32_t m_SwapchainImageCount;
     uint32_t m_SwapchainImageIndex;
+    // Frame slots the CPU may record ahead of the GPU, independent from the swapchain depth
+    uint32_t m_FramesInFlight;
 
     VulkanCommandPool m_GfxCmdPool;
-    VulkanCommandPool m_TsfCmdPool;
     std::vector<VulkanCommandBuffer> m_GfxCmdBufs;
+    // Per frame, one pool and secondary command buffer for each recording partition
+    struct SecondaryCommands
+    {
+        std::vector<VulkanCommandPool> pools;
+        std::vector<VulkanCommandBuffer> cmdBufs;
+    };
+    std::vector<SecondaryCommands> m_SecondaryCmds;
 
     uint32_t m_CurrentFrame;
+    bool m_FrameWritesBegun;
     std::vector<VulkanFence> m_Fences;
     std::vector<VkSemaphore> m_ImageAvailableSems;
     std::vector<VkSemaphore> m_RenderFinishedSems;
+    VulkanGpuProfiler m_GpuProfiler;
 
-    VulkanTexture m_DepthImage;
+    // Settings and device agree on dynamic rendering, no render pass is created then
+    bool m_DynamicRendering;
     VkRenderPass m_RenderPass;
-    std::vector<VkFramebuffer> m_Framebuffers;
-    std::vector<VulkanShaderModule> m_ShaderModules;
-    std::vector<VkDescriptorSet> m_DescriptorSets;
-    VulkanTexture m_TextureImage;
+    VulkanRenderGraph m_RenderGraph;
+    RenderGraphResource m_BackbufferResource;
+    HandlePool<VulkanShaderModule, ShaderHandle> m_ShaderModules;
+    // Owned here, workers compiling a pipeline keep a pointer to it
+    HandlePool<std::unique_ptr<VulkanPipeline>, PipelineHandle> m_Pipelines;
+    HandlePool<std::unique_ptr<VulkanComputePipeline>, CullPipelineHandle> m_CullPipelines;
+    // Destroyed by the application while a worker was still compiling them
+    std::vector<std::unique_ptr<VulkanPipeline>> m_RetiredPipelines;
+    // Destroyed by the application, compiles in flight may still read them
+    std::vector<VulkanShaderModule> m_RetiredShaderModules;
+    std::vector<DescriptorAllocator> m_FrameDescriptorAllocators;
+    // Objects, commands, count and instances read and written by the culling shader
+    VkDescriptorSetLayout m_CullSetLayout;
+    VulkanTextureStreamer m_TextureStreamer;
+    // Sampled by the scene, the placeholder is bound until it is streamed in
+    StreamedTexture m_Texture;
     VkClearValue m_ClearValues[2];
-    std::vector<VulkanBuffer> m_UniformBuffers;
-    std::vector<void*> m_UniformBufferMapped;
+    VulkanFrameAllocator m_FrameAllocator;
+    // Dynamic uniform offset of each draw in the current frame
+    std::vector<uint32_t> m_DrawUniformOffsets;
+    RenderQueue m_RenderQueue;
+    DrawStats m_DrawStats;
     VulkanPipeline* m_BoundPipline;
+    std::vector<VulkanPipeline*> m_PendingPipelines;
     VkViewport m_Viewport;
     VkRect2D m_Scissor;
 
-    std::vector<BufferDescription> m_BufferDescriptions;
-    std::vector<VulkanBuffer> m_Buffers;
+    // Created by AssureResource from their description, stream buffers own no VkBuffer
+    struct BufferResource
+    {
+        BufferDescription description;
+        // Dynamic buffers hold one copy per frame slot, copyStride bytes apart
+        VulkanBuffer buffer;
+        VkDeviceSize copyStride = 0;
+        // Contents of a dynamic buffer, the copies of [dirtyBegin, dirtyEnd) are behind in staleCopies slots
+        std::vector<uint8_t> shadow;
+        size_t dirtyBegin = 0;
+        size_t dirtyEnd = 0;
+        uint32_t staleCopies = 0;
+        // Stream buffers, valid while streamFrame is the current frame
+        VulkanFrameAllocation streamAllocation;
+        uint64_t streamFrame = UINT64_MAX;
+        // Open MapBuffer range, static buffers also keep the staging memory it points to
+        bool mapped = false;
+        size_t mapOffset = 0;
+        size_t mapSize = 0;
+        VkBuffer stagingBuffer = VK_NULL_HANDLE;
+        VkDeviceSize stagingOffset = 0;
+    };
+    HandlePool<BufferResource, BufferHandle> m_Buffers;
+    // Streamer handle of each texture created through the RHI
+    HandlePool<StreamedTexture, TextureHandle> m_Textures;
+    // Buffer and offset bound for a draw, null for a stream buffer not written this frame
+    struct BufferBinding
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        uint32_t offset = 0;
+
+        bool operator==(const BufferBinding&) const = default;
+    };
+    BufferBinding GetBufferBinding(const BufferResource& resource) const;
+    // Static buffer updates recorded by the next frame
+    struct BufferCopy
+    {
+        VkBuffer src;
+        VkDeviceSize srcOffset;
+        VkBuffer dst;
+        VkDeviceSize dstOffset;
+        VkDeviceSize size;
+        BufferUsage usage;
+    };
+    std::vector<BufferCopy> m_PendingBufferCopies;
+    // Dynamic buffers with stale copies
+    std::vector<BufferHandle> m_DirtyBuffers;
+    // Single identity instance bound for draws without an instance buffer
+    VulkanBuffer m_DefaultInstanceBuffer;
     std::vector<RenderPassDescription> m_PassDescriptions;
+    // Culling outputs of one indirect pass
+    struct IndirectBuffers
+    {
+        VulkanBuffer commands;
+        VulkanBuffer count;
+        VulkanBuffer instances;
+        uint32_t capacity = 0;
+    };
+    std::vector<IndirectPassDescription> m_IndirectPassDescriptions;
+    // Per frame, one entry per indirect pass
+    std::vector<std::vector<IndirectBuffers>> m_IndirectBuffers;
+    std::vector<uint32_t> m_IndirectUniformOffsets;
+    ResourceReport m_ResourceReport;
 
     Camera m_Camera;
 };
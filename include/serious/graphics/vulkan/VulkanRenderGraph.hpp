@@ -0,0 +1,195 @@
+#pragma once
+
+#include "serious/graphics/vulkan/VulkanCommand.hpp"
+#include "serious/graphics/vulkan/VulkanAllocator.hpp"
+#include "serious/graphics/vulkan/VulkanImageTracker.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace serious
+{
+
+class VulkanDevice;
+class VulkanGpuProfiler;
+
+using RenderGraphResource = uint32_t;
+
+enum class RenderGraphAccess
+{
+    ColorAttachment,
+    DepthAttachment,
+    // Read by fragment shaders
+    Sampled
+};
+
+struct RenderGraphImageDescription
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {};
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+/**
+ * @brief Objects a pass needs to record, the render pass or rendering is begun by the pass itself
+ */
+struct RenderGraphContext
+{
+    // Use renderingInfo and inheritanceInfo instead of the render pass objects
+    bool dynamicRendering = false;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    // Render area and clear values included, null render pass for passes without attachments
+    VkRenderPassBeginInfo beginInfo = {};
+    VkRenderingInfo renderingInfo = {};
+    // Attachment formats for secondary command buffers continuing the rendering
+    VkCommandBufferInheritanceRenderingInfo inheritanceInfo = {};
+};
+
+struct RenderGraphStats
+{
+    uint32_t passCount = 0;
+    uint32_t culledPassCount = 0;
+    uint32_t transientImageCount = 0;
+    uint32_t memorySlotCount = 0;
+    // Transient memory without and with aliasing
+    VkDeviceSize requestedBytes = 0;
+    VkDeviceSize allocatedBytes = 0;
+    // Last Execute
+    uint32_t barrierBatchCount = 0;
+    uint32_t imageBarrierCount = 0;
+};
+
+/**
+ * @brief Frame graph of passes declaring the images they read and write
+ *
+ * Compile orders passes so that images are written before they are sampled, culls passes
+ * whose outputs are never consumed, derives load and store ops from the remaining ones and
+ * places transient images whose lifetimes do not overlap in the same memory. Execute emits one batched barrier before
+ * each pass with the layout transitions and hazards of all its resources.
+ * Imported images are owned outside of the graph and set again every frame.
+ */
+class VulkanRenderGraph final
+{
+public:
+    using ExecuteFunc = std::function<void(VulkanCommandBuffer& cmd, const RenderGraphContext& context)>;
+
+    VulkanRenderGraph();
+    // With dynamic rendering no render pass or framebuffer is ever created
+    void Init(VulkanDevice* device, bool dynamicRendering = false);
+    // Release compiled objects and forget every pass and resource
+    void Reset();
+    void Destroy();
+
+    // Imported images start each frame in initialLayout, waited on at initialStages, and end in finalLayout
+    RenderGraphResource ImportImage(
+        const std::string& name,
+        const RenderGraphImageDescription& description,
+        VkImageLayout initialLayout,
+        VkPipelineStageFlags2 initialStages,
+        VkImageLayout finalLayout);
+    void SetImportedImage(RenderGraphResource resource, VkImage image, VkImageView view);
+    // Created by Compile, contents do not survive between frames
+    RenderGraphResource CreateImage(const std::string& name, const RenderGraphImageDescription& description);
+
+    uint32_t AddPass(const std::string& name, ExecuteFunc execute);
+    // Clear values are read at every Execute, a null clear keeps the previous contents when needed
+    void WriteColor(uint32_t pass, RenderGraphResource resource, const VkClearValue* clear = nullptr);
+    void WriteDepth(uint32_t pass, RenderGraphResource resource, const VkClearValue* clear = nullptr);
+    void Read(uint32_t pass, RenderGraphResource resource);
+    // Keep a pass even when nothing consumes its outputs
+    void SetSideEffect(uint32_t pass);
+
+    void Compile();
+    void Execute(VulkanCommandBuffer& cmd);
+
+    inline VkImageView GetImageView(RenderGraphResource resource) const { return m_Resources[resource].view; }
+    inline bool IsPassCulled(uint32_t pass) const { return m_Passes[pass].culled; }
+    inline const RenderGraphStats& GetStats() const { return m_Stats; }
+    // Every executed pass becomes a GPU zone named after it, null to stop profiling
+    inline void SetProfiler(VulkanGpuProfiler* profiler) { m_Profiler = profiler; }
+private:
+    using ResourceState = VulkanImageState;
+
+    struct Resource
+    {
+        std::string name;
+        RenderGraphImageDescription description;
+        bool imported = false;
+        VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 initialStages = VK_PIPELINE_STAGE_2_NONE;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        // Compiled
+        VkImageUsageFlags usage = 0;
+        uint32_t firstPass = UINT32_MAX;
+        uint32_t lastPass = 0;
+        uint32_t slot = UINT32_MAX;
+        ResourceState state;
+    };
+
+    struct Attachment
+    {
+        RenderGraphResource resource;
+        RenderGraphAccess access;
+        const VkClearValue* clear;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        ExecuteFunc execute;
+        std::vector<Attachment> writes;
+        std::vector<RenderGraphResource> reads;
+        bool sideEffect = false;
+        // Compiled
+        bool culled = false;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkExtent2D extent = {};
+        std::vector<VkClearValue> clearValues;
+        std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers;
+        // Dynamic rendering, image views and clear values are filled at Execute
+        std::vector<VkRenderingAttachmentInfo> colorAttachments;
+        VkRenderingAttachmentInfo depthAttachment = {};
+        bool hasDepth = false;
+        std::vector<VkFormat> colorFormats;
+        VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    };
+
+    // Transient memory shared by images with disjoint lifetimes
+    struct MemorySlot
+    {
+        VkMemoryRequirements requirements = {};
+        std::vector<RenderGraphResource> resources;
+        VulkanAllocation allocation = {};
+        // Last access of any image of the slot, carried over to the next frame
+        VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 access = VK_ACCESS_2_NONE;
+    };
+
+    void SortPasses();
+    void CullPasses();
+    void AllocateTransients();
+    // Render pass object, or the rendering attachments with dynamic rendering
+    void CreateRenderPass(Pass& pass, uint32_t passIndex);
+    VkFramebuffer GetFramebuffer(Pass& pass);
+    void ReleaseCompiled();
+    static ResourceState GetTargetState(RenderGraphAccess access);
+private:
+    VulkanDevice* m_Device;
+    bool m_DynamicRendering;
+    std::vector<Resource> m_Resources;
+    std::vector<Pass> m_Passes;
+    // Pass indices in execution order, lifetimes are positions in this list
+    std::vector<uint32_t> m_Order;
+    std::vector<MemorySlot> m_Slots;
+    RenderGraphStats m_Stats;
+    VulkanGpuProfiler* m_Profiler;
+};
+
+}
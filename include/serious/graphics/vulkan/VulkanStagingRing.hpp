@@ -0,0 +1,72 @@
+#pragma once
+
+#include "serious/graphics/vulkan/VulkanObjects.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+
+namespace serious
+{
+
+class VulkanDevice;
+
+/**
+ * @brief Slice of the staging ring, valid until the value it was retired with completes
+ */
+struct VulkanStagingRegion
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+};
+
+/**
+ * @brief Persistently mapped host visible ring shared by all uploads
+ *
+ * Regions are handed out from the head. Once the copies reading them are submitted
+ * they are retired with a submission value, and the space is reclaimed from the
+ * tail when that value is known to be complete on the GPU.
+ */
+class VulkanStagingRing final
+{
+public:
+    static constexpr VkDeviceSize DefaultSize = 32ull * 1024 * 1024;
+
+    VulkanStagingRing();
+    void Init(VulkanDevice* device, VkDeviceSize size = DefaultSize);
+    void Destroy();
+
+    // Returns an empty region (mapped == nullptr) when the ring has no contiguous room for size bytes
+    VulkanStagingRegion Allocate(VkDeviceSize size, VkDeviceSize alignment);
+    // Tag every region allocated since the last call with the value signaled by their submission
+    void Retire(uint64_t value);
+    // Release retired regions whose value is less than or equal to completedValue
+    void Reclaim(uint64_t completedValue);
+
+    inline VkDeviceSize GetSize() const { return m_Size; }
+    inline VkDeviceSize GetUsedBytes() const { return m_Used; }
+    inline bool HasRetired() const { return !m_Retired.empty(); }
+    inline uint64_t GetOldestRetiredValue() const { return m_Retired.front().value; }
+private:
+    struct RetiredSpan
+    {
+        VkDeviceSize end;
+        VkDeviceSize bytes;
+        uint64_t value;
+    };
+
+    VulkanDevice* m_Device;
+    VulkanBuffer m_Buffer;
+    VkDeviceSize m_Size;
+    VkDeviceSize m_Head;
+    VkDeviceSize m_Tail;
+    // Bytes between tail and head, including padding and wrap-around waste
+    VkDeviceSize m_Used;
+    // Bytes allocated since the last Retire
+    VkDeviceSize m_OpenBytes;
+    std::deque<RetiredSpan> m_Retired;
+};
+
+}
@@ -17,6 +17,8 @@ public:
     // Create window surface and present queue
     void InitSurface(void* platformWindow);
     void Create(uint32_t* width, uint32_t* height, bool vsync);  
+    // Single offscreen image in place of the surface, copyable for readback
+    void CreateOffscreen(uint32_t width, uint32_t height);
     // Release resources
     void Cleanup();
     VkResult Present(VkSemaphore* renderCompleteSemaphore, uint32_t imageIndex);
@@ -27,8 +29,10 @@ public:
     inline VkFormat           GetColorFormat() const { return m_ColorFormat; }
     inline VkFormat           GetDepthFormat() const { return m_DepthFormat; }
     inline VkComponentMapping GetComponentMapping() const { return m_ComponentMapping; }
+    inline VkImage            GetImage(uint32_t index) const { return m_Images[index]; }
     inline VkImageView        GetImageView(uint32_t index) const { return m_ImageViews[index]; }
     inline VkSwapchainKHR     GetHandle() const { return m_Swapchain; }
+    inline bool               IsOffscreen() const { return m_OffscreenImage.image != VK_NULL_HANDLE; }
 private:
     VkSwapchainKHR m_Swapchain;
     VkInstance m_Instance;
@@ -46,6 +50,8 @@ private:
 
     std::vector<VkImage> m_Images;
     std::vector<VkImageView> m_ImageViews;
+    // Owned image when rendering without a surface
+    VulkanImage m_OffscreenImage;
 };
 
 }
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "serious/core/HandlePool.hpp"
+#include "serious/core/ThreadPool.hpp"
+#include "serious/graphics/vulkan/VulkanObjects.hpp"
+#include "serious/graphics/vulkan/VulkanUploader.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace serious
+{
+
+class VulkanDevice;
+
+// Stale once the texture is released, the slot is reused by later requests
+using StreamedTexture = Handle<struct StreamedTextureTag>;
+
+struct TextureStreamStats
+{
+    uint32_t decoding = 0;
+    uint32_t waitingUpload = 0;
+    uint32_t uploading = 0;
+    uint32_t ready = 0;
+    // Bytes handed to the uploader by the last Update
+    VkDeviceSize frameUploadBytes = 0;
+};
+
+/**
+ * @brief Textures decoded on the workers and uploaded within a per frame budget
+ *
+ * Request returns at once and enqueues the decode on the thread pool given to Init, which should
+ * not be the one frame recording waits on. Update, called once per frame on the render thread,
+ * uploads decoded textures from the highest priority down until the byte budget is spent and
+ * publishes the ones whose upload is complete. At least one texture is uploaded per frame so
+ * larger ones are never starved.
+ *
+ * Until a texture is published GetTexture returns a placeholder texel and GetBindlessIndex the
+ * slot of that placeholder. Publishing registers a fresh bindless slot, so slots sampled by the
+ * frames in flight are never rewritten. Images of released textures go through the deletion queue
+ * of the device.
+ */
+class VulkanTextureStreamer final
+{
+public:
+    VulkanTextureStreamer();
+    void Init(VulkanDevice* device, ThreadPool* threadPool, VkDeviceSize uploadBudget);
+    // The thread pool is expected to be idle and the device to have finished every frame
+    void Destroy();
+
+    StreamedTexture Request(const std::string& path, VkFormat format, VkComponentMapping mapping, float priority = 0.0f);
+    // Stale handles are ignored, the texture may still be decoding or uploading
+    void Release(StreamedTexture texture);
+    // Higher first, typically the on-screen size of the texture in pixels
+    void SetPriority(StreamedTexture texture, float priority);
+    void Update();
+
+    bool IsReady(StreamedTexture texture) const;
+    // The placeholder until the texture is ready
+    const VulkanTexture& GetTexture(StreamedTexture texture) const;
+    // VulkanBindlessTable::InvalidIndex for stale handles or without a bindless table
+    uint32_t GetBindlessIndex(StreamedTexture texture) const;
+    inline void SetUploadBudget(VkDeviceSize bytes) { m_UploadBudget = bytes; }
+    TextureStreamStats GetStats() const;
+private:
+    enum class StreamState
+    {
+        Decoding,
+        Decoded,
+        Uploading,
+        Ready
+    };
+
+    struct Entry
+    {
+        std::string path;
+        VkFormat format;
+        VkComponentMapping mapping;
+        float priority;
+        // Written by the decoding worker, read by the render thread once Decoded
+        StreamState state;
+        VulkanTexturePixels pixels;
+        VulkanTexture texture;
+        VulkanUploadToken token;
+        uint32_t bindlessIndex;
+    };
+
+    // Null for stale handles
+    Entry* Find(StreamedTexture texture) const;
+    // True while the decoding worker or the uploader still uses the entry
+    bool IsBusy(const Entry& entry) const;
+    // Defers the destruction of the resources of a released entry
+    void Reclaim(Entry& entry);
+private:
+    VulkanDevice* m_Device;
+    ThreadPool* m_ThreadPool;
+    VkDeviceSize m_UploadBudget;
+    VulkanTexture m_Placeholder;
+    uint32_t m_PlaceholderIndex;
+    // Entries are never moved so workers may keep a pointer to theirs
+    HandlePool<std::unique_ptr<Entry>, StreamedTexture> m_Textures;
+    // Released while a worker or the uploader still uses them, reclaimed by Update
+    std::vector<std::unique_ptr<Entry>> m_Released;
+    // Guards the state of every entry
+    mutable std::mutex m_Mutex;
+    VkDeviceSize m_FrameUploadBytes;
+};
+
+}
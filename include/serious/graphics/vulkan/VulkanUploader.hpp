@@ -0,0 +1,127 @@
+#pragma once
+
+#include "serious/Utils.hpp"
+#include "serious/graphics/vulkan/VulkanCommand.hpp"
+#include "serious/graphics/vulkan/VulkanImageTracker.hpp"
+#include "serious/graphics/vulkan/VulkanStagingRing.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+namespace serious
+{
+
+// Timeline semaphore value signaled when an upload batch completes, 0 is always complete
+using VulkanUploadToken = uint64_t;
+
+/**
+ * @brief What a graphics submit has to wait on before consuming uploaded resources
+ */
+struct VulkanUploadWait
+{
+    VulkanUploadToken value = 0;
+    VkPipelineStageFlags stages = 0;
+};
+
+/**
+ * @brief Upload scheduler on the transfer queue
+ *
+ * Uploads are recorded into a transfer command buffer through the staging ring and
+ * submitted by Flush, which signals a timeline semaphore and never blocks.
+ * When the transfer queue belongs to another family than graphics, every upload
+ * ends with a queue family release and the matching acquire is recorded into
+ * the next graphics command buffer by AcquireOnGraphics.
+ */
+class VulkanUploader final
+{
+public:
+    VulkanUploader();
+    void Init(VulkanDevice* device, VulkanStagingRing* stagingRing);
+    void Destroy();
+
+    // Consumer stages on the graphics queue are derived from the buffer usage
+    void UploadBuffer(VkBuffer dst, VkBufferUsageFlags usage, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+    // Upload tightly packed RGBA8 pixels of the first levels, level i being (width >> i) by (height >> i) clamped to 1.
+    // Levels of the image past the given ones are blitted from the last given level, so the format must support
+    // linear blits in that case. The image is left in SHADER_READ_ONLY_OPTIMAL
+    void UploadImage(VkImage image, uint32_t width, uint32_t height, const std::vector<const void*>& levels);
+    inline void UploadImage(VkImage image, uint32_t width, uint32_t height, const void* pixels) { UploadImage(image, width, height, std::vector<const void*> {pixels}); }
+    // Submit recorded uploads, the returned token is signaled once they are complete.
+    // Inside a batch nothing is submitted and the token of the batch submit is returned
+    VulkanUploadToken Flush();
+    // Defer every Flush until EndBatch so many uploads share a single submit
+    void BeginBatch();
+    VulkanUploadToken EndBatch();
+    bool IsComplete(VulkanUploadToken token) const;
+    void Wait(VulkanUploadToken token);
+    // Record pending queue family acquires into a graphics command buffer and return the wait the submit needs
+    VulkanUploadWait AcquireOnGraphics(VulkanCommandBuffer& gfxCmd);
+
+    inline VkSemaphore       GetSemaphore() const { return m_Timeline; }
+    inline VulkanUploadToken GetSubmittedToken() const { return m_SubmittedValue; }
+    inline uint64_t          GetUploadedBytes() const { return m_UploadedBytes; }
+    inline uint32_t          GetSubmitCount() const { return m_SubmitCount; }
+    inline bool              NeedsOwnershipTransfer() const { return m_SrcFamilyIndex != m_DstFamilyIndex; }
+private:
+    template <class Barrier>
+    struct PendingAcquire
+    {
+        Barrier barrier;
+        VulkanUploadToken value;
+    };
+
+    // Mip levels blitted on the graphics queue once ownership of the image is acquired
+    struct PendingMips
+    {
+        VkImage image;
+        uint32_t width;
+        uint32_t height;
+        uint32_t baseLevel;
+        VulkanUploadToken value;
+    };
+
+    struct InFlightCmd
+    {
+        VulkanCommandBuffer cmd;
+        VulkanUploadToken value;
+    };
+
+    void BeginRecording();
+    VulkanUploadToken Submit();
+    VulkanStagingRegion AcquireStaging(VkDeviceSize size, VkDeviceSize alignment);
+    uint64_t GetCompletedValue() const;
+    void Recycle();
+    // Blit every level from baseLevel on from the previous one and leave the image sampled
+    void RecordMipBlits(VulkanCommandBuffer& cmd, VulkanBarrierBatch& batch, VkImage image, uint32_t width, uint32_t height, uint32_t baseLevel);
+private:
+    VulkanDevice* m_Device;
+    VulkanStagingRing* m_StagingRing;
+    Ref<VulkanQueue> m_Queue;
+    uint32_t m_SrcFamilyIndex;
+    uint32_t m_DstFamilyIndex;
+
+    VulkanCommandPool m_CmdPool;
+    VulkanCommandBuffer m_Cmd;
+    bool m_Recording;
+    std::vector<InFlightCmd> m_InFlightCmds;
+    std::vector<VulkanCommandBuffer> m_FreeCmds;
+
+    VkSemaphore m_Timeline;
+    VulkanUploadToken m_SubmittedValue;
+    VulkanUploadToken m_GraphicsWaitedValue;
+    VkPipelineStageFlags m_RecordingStages;
+    VkPipelineStageFlags m_SubmittedStages;
+    // Barriers of the transfer command buffer. Releases and final transitions are left pending
+    // until the next image transition or Submit, so consecutive uploads share one barrier call
+    VulkanBarrierBatch m_Barriers;
+    std::vector<PendingAcquire<VkBufferMemoryBarrier2>> m_BufferAcquires;
+    std::vector<PendingAcquire<VkImageMemoryBarrier2>> m_ImageAcquires;
+    std::vector<PendingMips> m_PendingMips;
+
+    uint32_t m_BatchDepth;
+    uint64_t m_UploadedBytes;
+    uint32_t m_SubmitCount;
+};
+
+}
@@ -3,6 +3,7 @@
 #include "serious/graphics/vulkan/VulkanRHI.hpp"
 #include "serious/geo/StaticMesh.hpp"
 
+#include <fstream>
 #include <memory>
 
 #include <SDL3/SDL.h>
@@ -52,11 +53,11 @@ public:
         Camera& camera = rhi->GetCamera();
         camera.SetRotationSpeed(0.1f);
 
-        RHIResourceIdx vertShader = rhi->CreateShader({
+        ShaderHandle vertShader = rhi->CreateShader({
             .file  = "D:/w6rsty/dev/Cpp/serious/shaders/grid_vert.spv",
             .stage = ShaderStage::Vertex
         });
-        RHIResourceIdx fragShader = rhi->CreateShader({
+        ShaderHandle fragShader = rhi->CreateShader({
             .file  = "D:/w6rsty/dev/Cpp/serious/shaders/grid_frag.spv",
             .stage = ShaderStage::Fragment
         });
@@ -66,15 +67,18 @@ public:
             .shaders = {vertShader, fragShader},
             .blendingMode = ColorBlendingMode::AlphaBlending
         };
-        pipeline = rhi->CreatePipeline(pipelineDescription);
+        pipeline = rhi->CreatePipelineAsync(pipelineDescription);
         rhi->BindPipeline(pipeline);
+        // Only the compile reads them, the RHI keeps them until it is done
+        rhi->DestroyShader(vertShader);
+        rhi->DestroyShader(fragShader);
 
-        RHIResourceIdx vertexBuffer = rhi->CreateBuffer({
+        BufferHandle vertexBuffer = rhi->CreateBuffer({
             .usage = BufferUsage::Vertex,
             .size  = sizeof(Vertex) * mesh::Plane::vertices.size(),
             .data  = mesh::Plane::vertices.data()
         });
-        RHIResourceIdx indexBuffer = rhi->CreateBuffer({
+        BufferHandle indexBuffer = rhi->CreateBuffer({
             .usage = BufferUsage::Index,
             .size  = sizeof(uint32_t) * mesh::Plane::indices.size(),
             .data  = mesh::Plane::indices.data()
@@ -82,14 +86,88 @@ public:
 
         RenderPassDescription pass = {
             .pipeline = pipeline,
-            .vertexBuffer = vertShader,
+            .vertexBuffer = vertexBuffer,
             .indexBuffer = indexBuffer,
-            .size = (uint32_t)mesh::Plane::indices.size()
+            .size = (uint32_t)mesh::Plane::indices.size(),
+            .transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(100.0f))
         };
 
         rhi->SetPasses({pass});
     }
 
+    void SetDynamicRendering(bool enabled) { settings.dynamicRendering = enabled; }
+    // Must be set before SetupGraphics, SetupWindow is skipped then
+    void SetHeadless(bool enabled) { settings.headless = enabled; }
+
+    // Render a fixed number of frames without a window and save the last one as a binary PPM
+    void RunHeadless(uint32_t frameCount, const std::string& path)
+    {
+        if (!rhi->AssureResource()) {
+            SEError("Uncompleted resources");
+            return;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < frameCount; ++i) {
+            rhi->Update();
+        }
+        std::vector<uint8_t> pixels = rhi->ReadbackFrame();
+        double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        SEInfo("Headless: {} frame(s) in {:.2f} ms", frameCount, totalMs);
+        if (pixels.empty()) {
+            SEError("No frame to read back");
+            return;
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            SEError("Failed to open {}", path);
+            return;
+        }
+        file << "P6\n" << settings.width << " " << settings.height << "\n255\n";
+        for (size_t i = 0; i < pixels.size(); i += 4) {
+            file.write(reinterpret_cast<const char*>(&pixels[i]), 3);
+        }
+        SEInfo("Saved frame to {}", path);
+    }
+
+    // Time startup and forced render target recreation of the selected rendering path
+    void BenchmarkRenderTargets(uint32_t resizeCount)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        SetupGraphics();
+        if (!rhi->AssureResource()) {
+            SEError("Uncompleted resources");
+            return;
+        }
+        double startupMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        // Swapchain recreation is the same for both paths and dwarfs the render targets, so the
+        // render targets are timed on their own and the full resize is reported apart
+        double targetsMs = 0.0;
+        double worstTargetsMs = 0.0;
+        double resizeMs = 0.0;
+        for (uint32_t i = 0; i < resizeCount; ++i) {
+            auto targetsStart = std::chrono::high_resolution_clock::now();
+            rhi->RecreateRenderGraph();
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - targetsStart).count();
+            targetsMs += elapsedMs;
+            worstTargetsMs = std::max(worstTargetsMs, elapsedMs);
+
+            auto resizeStart = std::chrono::high_resolution_clock::now();
+            rhi->RecreateRenderTargets();
+            resizeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - resizeStart).count();
+        }
+        const double average = resizeCount > 0 ? 1.0 / resizeCount : 0.0;
+        SEInfo("{}: startup {:.2f} ms, render targets {:.3f} ms average, {:.3f} ms worst, resize with swapchain {:.3f} ms average over {} resize(s)",
+            settings.dynamicRendering ? "Dynamic rendering" : "Render pass objects",
+            startupMs,
+            targetsMs * average,
+            worstTargetsMs,
+            resizeMs * average,
+            resizeCount
+        );
+    }
+
     void Run()
     {
         if (!rhi->AssureResource()) {
@@ -192,7 +270,7 @@ private:
     SDL_Window* window = nullptr;
 
     std::unique_ptr<RHI> rhi;
-    RHIResource pipeline;
+    PipelineHandle pipeline;
     int clickx, clicky;
 
     bool running = false;
@@ -1,7 +1,30 @@
 #include "application.hpp"
 
+#include <string>
+#include <string_view>
+
 int main(int argc, char* argv[])
 {
+    // Compare startup and resize cost of render pass objects against dynamic rendering
+    if (argc > 1 && std::string_view(argv[1]) == "--benchmark-render-targets") {
+        for (bool dynamicRendering : {false, true}) {
+            Application app;
+            app.SetDynamicRendering(dynamicRendering);
+            app.SetupWindow();
+            app.BenchmarkRenderTargets(100);
+        }
+        return 0;
+    }
+
+    // Render without SDL video or a surface, for CI and machines without a display
+    if (argc > 1 && std::string_view(argv[1]) == "--headless") {
+        Application app;
+        app.SetHeadless(true);
+        app.SetupGraphics();
+        app.RunHeadless(argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 60, argc > 3 ? argv[3] : "frame.ppm");
+        return 0;
+    }
+
     Application app;
     app.SetupWindow();
     app.SetupGraphics();
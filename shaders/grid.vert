@@ -3,6 +3,8 @@
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
+// Per instance transform, locations 3 to 6
+layout(location = 3) in mat4 inInstance;
 
 layout(location = 0) out vec3 vPosition;
 layout(location = 1) out vec2 vTexCoord;
@@ -14,7 +16,7 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
 } ubo;
 
 void main() {
-    vec4 pos = vec4(inPosition, 1.0);
+    vec4 pos = inInstance * vec4(inPosition, 1.0);
     gl_Position = ubo.proj * ubo.view * ubo.model * pos;
     vPosition = vec3(ubo.model * pos);
     vTexCoord = inTexCoord;
@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 vNormal;
 layout(location = 1) in vec2 vTexCoord;
@@ -6,14 +7,23 @@ layout(location = 1) in vec2 vTexCoord;
 layout(location = 0) out vec4 outColor;
 
 layout(binding = 1) uniform sampler2D texSampler;
+// Bindless texture table, needs a device with descriptor indexing
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(push_constant) uniform Draw {
+    uint textureIndex;
+} draw;
+
+const uint InvalidTextureIndex = 0xFFFFFFFFu;
 
 void main() {
     // vec3 lightPos = vec3(2.0, 2.0, 2.0);
-    // vec3 texCoolor = texture(texSampler, vTexCoord).rgb;
     // vec3 normal = normalize(vNormal);
     // vec3 lightDir = normalize(lightPos - vNormal);
     // float diff = max(dot(normal, lightDir), 0.0);
-    // vec3 diffuse = diff * texCoolor;
-    vec3 diffuse = vec3(1.0, 0.0, 1.0);
+    // Draws without a texture of their own sample the scene texture
+    vec3 diffuse = draw.textureIndex == InvalidTextureIndex
+        ? texture(texSampler, vTexCoord).rgb
+        : texture(textures[nonuniformEXT(draw.textureIndex)], vTexCoord).rgb;
     outColor = vec4(pow(diffuse, vec3(1.0 / 2.2)), 1.0);
 }
@@ -0,0 +1,83 @@
+#include "serious/core/ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace serious
+{
+
+static thread_local uint32_t s_WorkerIndex = UINT32_MAX;
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+    : m_Workers({})
+    , m_Tasks({})
+    , m_ActiveCount(0)
+    , m_Stopping(false)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+    m_Workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stopping = true;
+    }
+    m_TaskCondition.notify_all();
+    for (std::thread& worker : m_Workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Tasks.push(std::move(task));
+    }
+    m_TaskCondition.notify_one();
+}
+
+void ThreadPool::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_IdleCondition.wait(lock, [this] { return m_Tasks.empty() && m_ActiveCount == 0; });
+}
+
+uint32_t ThreadPool::GetWorkerIndex()
+{
+    return s_WorkerIndex;
+}
+
+void ThreadPool::WorkerLoop(uint32_t workerIndex)
+{
+    s_WorkerIndex = workerIndex;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_TaskCondition.wait(lock, [this] { return m_Stopping || !m_Tasks.empty(); });
+            if (m_Stopping && m_Tasks.empty()) {
+                return;
+            }
+            task = std::move(m_Tasks.front());
+            m_Tasks.pop();
+            m_ActiveCount++;
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_ActiveCount--;
+            if (m_Tasks.empty() && m_ActiveCount == 0) {
+                m_IdleCondition.notify_all();
+            }
+        }
+    }
+}
+
+}
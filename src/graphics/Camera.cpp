@@ -41,6 +41,23 @@ void Camera::SetPerspective(float fov_, float aspect_, float znear_, float zfar_
     matrices.projection[1][1] *= -1.0f;
 }
 
+std::array<glm::vec4, 6> Camera::GetFrustumPlanes() const {
+    // Gribb-Hartmann extraction from the rows of the view projection matrix, depth range is [0, 1]
+    glm::mat4 m = glm::transpose(matrices.projection * matrices.view);
+    std::array<glm::vec4, 6> planes = {
+        m[3] + m[0],
+        m[3] - m[0],
+        m[3] + m[1],
+        m[3] - m[1],
+        m[2],
+        m[3] - m[2],
+    };
+    for (glm::vec4& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+}
+
 bool Camera::Moving() const {
     return keys.forward || keys.backward || keys.left || keys.right || keys.up || keys.down;
 }
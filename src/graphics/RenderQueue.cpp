@@ -0,0 +1,79 @@
+#include "serious/graphics/RenderQueue.hpp"
+
+#include <Tracy.hpp>
+
+#include <algorithm>
+#include <array>
+
+namespace serious
+{
+
+static constexpr uint64_t Mask(uint32_t bits)
+{
+    return (1ull << bits) - 1;
+}
+
+static inline uint64_t QuantizeDepth(float depth)
+{
+    const float clamped = std::clamp(depth, 0.0f, 1.0f);
+    return static_cast<uint64_t>(clamped * static_cast<float>(Mask(RenderQueue::DepthBits))) & Mask(RenderQueue::DepthBits);
+}
+
+static inline uint64_t PackState(uint32_t pipeline, uint32_t material, uint32_t mesh)
+{
+    return ((pipeline & Mask(RenderQueue::PipelineBits)) << (RenderQueue::MaterialBits + RenderQueue::MeshBits))
+        | ((material & Mask(RenderQueue::MaterialBits)) << RenderQueue::MeshBits)
+        | (mesh & Mask(RenderQueue::MeshBits));
+}
+
+// [63] blended | [62..24] pipeline, material, mesh | [23..0] depth
+uint64_t RenderQueue::MakeOpaqueKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+    return (PackState(pipeline, material, mesh) << DepthBits) | QuantizeDepth(depth);
+}
+
+// [63] blended | [62..39] inverted depth | [38..0] pipeline, material, mesh
+uint64_t RenderQueue::MakeBlendedKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+    constexpr uint32_t stateBits = PipelineBits + MaterialBits + MeshBits;
+    return (1ull << 63)
+        | ((Mask(DepthBits) - QuantizeDepth(depth)) << stateBits)
+        | PackState(pipeline, material, mesh);
+}
+
+void RenderQueue::Clear()
+{
+    m_Entries.clear();
+}
+
+void RenderQueue::Sort()
+{
+    ZoneScoped;
+    const size_t count = m_Entries.size();
+    if (count < 2) {
+        return;
+    }
+    m_Scratch.resize(count);
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        std::array<size_t, 256> offsets = {};
+        for (const RenderQueueEntry& entry : m_Entries) {
+            offsets[(entry.key >> shift) & 0xFF]++;
+        }
+        // Every key has the same digit, the pass would only copy
+        if (offsets[(m_Entries[0].key >> shift) & 0xFF] == count) {
+            continue;
+        }
+        size_t sum = 0;
+        for (size_t& offset : offsets) {
+            size_t bucket = offset;
+            offset = sum;
+            sum += bucket;
+        }
+        for (const RenderQueueEntry& entry : m_Entries) {
+            m_Scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+        }
+        m_Entries.swap(m_Scratch);
+    }
+}
+
+}
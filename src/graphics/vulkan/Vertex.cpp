@@ -1,39 +1,53 @@
 #include "serious/graphics/vulkan/Vertex.hpp"
+#include "serious/graphics/Objects.hpp"
 
 namespace serious
 {
 
-VkVertexInputBindingDescription Vertex::GetBindingDescription()
+std::array<VkVertexInputBindingDescription, 2> Vertex::GetBindingDescription()
 {
-    VkVertexInputBindingDescription bindingDescription {};
-    bindingDescription.binding = 0;
-    bindingDescription.stride = sizeof(Vertex);
-    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    std::array<VkVertexInputBindingDescription, 2> bindingDescriptions {};
+    bindingDescriptions[0].binding = VertexBinding;
+    bindingDescriptions[0].stride = sizeof(Vertex);
+    bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-    return bindingDescription;
+    bindingDescriptions[1].binding = InstanceBinding;
+    bindingDescriptions[1].stride = sizeof(InstanceData);
+    bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    return bindingDescriptions;
 }
 
-std::array<VkVertexInputAttributeDescription, 3> Vertex::GetAttributeDescriptions()
+std::array<VkVertexInputAttributeDescription, 7> Vertex::GetAttributeDescriptions()
 {
-    std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions {};
+    std::array<VkVertexInputAttributeDescription, 7> attributeDescriptions {};
 
     // position
-    attributeDescriptions[0].binding = 0;
+    attributeDescriptions[0].binding = VertexBinding;
     attributeDescriptions[0].location = 0;
     attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
     attributeDescriptions[0].offset = offsetof(Vertex, position);
 
     // Color
-    attributeDescriptions[1].binding = 0;
+    attributeDescriptions[1].binding = VertexBinding;
     attributeDescriptions[1].location = 1;
     attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
     attributeDescriptions[1].offset = offsetof(Vertex, normal);
 
-    attributeDescriptions[2].binding = 0;
+    attributeDescriptions[2].binding = VertexBinding;
     attributeDescriptions[2].location = 2;
     attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
     attributeDescriptions[2].offset = offsetof(Vertex, texCoord);    
 
+    // Instance transform, one location per matrix column
+    for (uint32_t column = 0; column < 4; ++column) {
+        VkVertexInputAttributeDescription& attribute = attributeDescriptions[3 + column];
+        attribute.binding = InstanceBinding;
+        attribute.location = 3 + column;
+        attribute.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        attribute.offset = static_cast<uint32_t>(offsetof(InstanceData, transform) + sizeof(glm::vec4) * column);
+    }
+
     return attributeDescriptions;
 }
 
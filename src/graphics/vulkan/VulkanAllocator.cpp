@@ -0,0 +1,399 @@
+#include "serious/graphics/vulkan/VulkanAllocator.hpp"
+#include "serious/graphics/vulkan/VulkanUtils.hpp"
+
+#include <Tracy.hpp>
+
+#include <algorithm>
+
+namespace serious
+{
+
+static inline VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+VulkanAllocator::VulkanAllocator()
+    : m_Device(VK_NULL_HANDLE)
+    , m_MemoryProps({})
+    , m_BlockSize(DefaultBlockSize)
+    , m_BufferImageGranularity(1)
+    , m_Pools({})
+{
+}
+
+void VulkanAllocator::Init(VkDevice device, VkPhysicalDevice gpu, VkDeviceSize blockSize)
+{
+    m_Device = device;
+    m_BlockSize = blockSize;
+
+    VkPhysicalDeviceProperties gpuProps;
+    vkGetPhysicalDeviceProperties(gpu, &gpuProps);
+    vkGetPhysicalDeviceMemoryProperties(gpu, &m_MemoryProps);
+    m_BufferImageGranularity = std::max<VkDeviceSize>(gpuProps.limits.bufferImageGranularity, 1);
+    SEInfo("-- Memory block size: {} MiB, buffer image granularity: {}", m_BlockSize >> 20, m_BufferImageGranularity);
+}
+
+void VulkanAllocator::Destroy()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (uint32_t i = 0; i < m_MemoryProps.memoryTypeCount; ++i) {
+        MemoryPool& pool = m_Pools[i];
+        if (pool.stats.allocationCount > 0) {
+            SEWarn("Memory type {} still has {} live allocation(s) on destroy", i, pool.stats.allocationCount);
+        }
+        for (Block& block : pool.blocks) {
+            if (block.memory != VK_NULL_HANDLE) {
+                vkFreeMemory(m_Device, block.memory, nullptr);
+            }
+        }
+        pool = {};
+    }
+}
+
+VulkanAllocation VulkanAllocator::AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties)
+{
+    VkBufferMemoryRequirementsInfo2 requirementsInfo {};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.buffer = buffer;
+
+    VkMemoryDedicatedRequirements dedicatedRequirements {};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 requirements {};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicatedRequirements;
+    vkGetBufferMemoryRequirements2(m_Device, &requirementsInfo, &requirements);
+
+    bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+    return Allocate(requirements.memoryRequirements, properties, RangeKind::Linear, dedicated, buffer, VK_NULL_HANDLE);
+}
+
+VulkanAllocation VulkanAllocator::AllocateImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties, bool dedicated)
+{
+    VkImageMemoryRequirementsInfo2 requirementsInfo {};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.image = image;
+
+    VkMemoryDedicatedRequirements dedicatedRequirements {};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 requirements {};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicatedRequirements;
+    vkGetImageMemoryRequirements2(m_Device, &requirementsInfo, &requirements);
+
+    dedicated = dedicated || dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+    RangeKind kind = tiling == VK_IMAGE_TILING_OPTIMAL ? RangeKind::Optimal : RangeKind::Linear;
+    return Allocate(requirements.memoryRequirements, properties, kind, dedicated, VK_NULL_HANDLE, image);
+}
+
+VulkanAllocation VulkanAllocator::AllocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties)
+{
+    return Allocate(requirements, properties, RangeKind::Optimal, false, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+VulkanAllocation VulkanAllocator::Allocate(
+    const VkMemoryRequirements& requirements,
+    VkMemoryPropertyFlags properties,
+    RangeKind kind,
+    bool dedicated,
+    VkBuffer buffer,
+    VkImage image)
+{
+    ZoneScoped;
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    uint32_t memoryTypeIdx = FindMemoryTypeIdx(requirements.memoryTypeBits, properties);
+    if (memoryTypeIdx == UINT32_MAX) {
+        SEFatal("No memory type satisfies the allocation requirements");
+    }
+    // Big resources would waste most of a block, give them their own memory
+    if (dedicated || requirements.size > m_BlockSize / 2) {
+        return AllocateDedicated(requirements, memoryTypeIdx, buffer, image);
+    }
+
+    MemoryPool& pool = m_Pools[memoryTypeIdx];
+    VkDeviceSize offset = 0;
+    uint32_t blockIdx = UINT32_MAX;
+    uint32_t emptySlot = UINT32_MAX;
+    for (uint32_t i = 0; i < pool.blocks.size(); ++i) {
+        Block& block = pool.blocks[i];
+        if (block.memory == VK_NULL_HANDLE) {
+            emptySlot = i;
+            continue;
+        }
+        if (AllocateFromBlock(block, requirements, kind, &offset)) {
+            blockIdx = i;
+            break;
+        }
+    }
+
+    if (blockIdx == UINT32_MAX) {
+        Block block;
+        block.size = m_BlockSize;
+        VkMemoryAllocateInfo allocateInfo {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocateInfo.allocationSize = block.size;
+        allocateInfo.memoryTypeIndex = memoryTypeIdx;
+        if (vkAllocateMemory(m_Device, &allocateInfo, nullptr, &block.memory) != VK_SUCCESS) {
+            SEWarn("Failed to allocate memory block of type {}, using dedicated allocation", memoryTypeIdx);
+            return AllocateDedicated(requirements, memoryTypeIdx, buffer, image);
+        }
+        block.mapped = MapMemory(block.memory, memoryTypeIdx);
+        block.ranges.push_back({0, block.size, RangeKind::Free});
+        AllocateFromBlock(block, requirements, kind, &offset);
+
+        if (emptySlot != UINT32_MAX) {
+            blockIdx = emptySlot;
+            pool.blocks[blockIdx] = std::move(block);
+        } else {
+            blockIdx = static_cast<uint32_t>(pool.blocks.size());
+            pool.blocks.push_back(std::move(block));
+        }
+        pool.stats.blockCount++;
+        pool.stats.reservedBytes += m_BlockSize;
+        SETrace("Allocate memory block {} of type {} ({} MiB)", blockIdx, memoryTypeIdx, m_BlockSize >> 20);
+    }
+
+    const Block& block = pool.blocks[blockIdx];
+    VulkanAllocation allocation;
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    allocation.size = requirements.size;
+    allocation.memoryTypeIdx = memoryTypeIdx;
+    allocation.blockIdx = blockIdx;
+    allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+
+    pool.stats.allocationCount++;
+    pool.stats.usedBytes += requirements.size;
+    return allocation;
+}
+
+VulkanAllocation VulkanAllocator::AllocateDedicated(
+    const VkMemoryRequirements& requirements,
+    uint32_t memoryTypeIdx,
+    VkBuffer buffer,
+    VkImage image)
+{
+    VkMemoryDedicatedAllocateInfo dedicatedInfo {};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.buffer = buffer;
+    dedicatedInfo.image = image;
+
+    VkMemoryAllocateInfo allocateInfo {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.pNext = &dedicatedInfo;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = memoryTypeIdx;
+
+    VulkanAllocation allocation;
+    VK_CHECK_RESULT(vkAllocateMemory(m_Device, &allocateInfo, nullptr, &allocation.memory));
+    allocation.offset = 0;
+    allocation.size = requirements.size;
+    allocation.memoryTypeIdx = memoryTypeIdx;
+    allocation.blockIdx = UINT32_MAX;
+    allocation.mapped = MapMemory(allocation.memory, memoryTypeIdx);
+
+    VulkanMemoryTypeStats& stats = m_Pools[memoryTypeIdx].stats;
+    stats.allocationCount++;
+    stats.dedicatedCount++;
+    stats.reservedBytes += requirements.size;
+    stats.usedBytes += requirements.size;
+    return allocation;
+}
+
+bool VulkanAllocator::AllocateFromBlock(Block& block, const VkMemoryRequirements& requirements, RangeKind kind, VkDeviceSize* offset)
+{
+    const VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+    for (size_t i = 0; i < block.ranges.size(); ++i) {
+        const Range range = block.ranges[i];
+        if (range.kind != RangeKind::Free || range.size < requirements.size) {
+            continue;
+        }
+
+        VkDeviceSize start = AlignUp(range.offset, alignment);
+        // Linear and optimal resources must not share a bufferImageGranularity page
+        for (size_t j = i; j-- > 0;) {
+            const Range& prev = block.ranges[j];
+            if (!OnSamePage(prev.offset + prev.size, start)) {
+                break;
+            }
+            if (prev.kind != RangeKind::Free && prev.kind != kind) {
+                start = AlignUp(start, m_BufferImageGranularity);
+                break;
+            }
+        }
+        const VkDeviceSize end = start + requirements.size;
+        const VkDeviceSize rangeEnd = range.offset + range.size;
+        if (end > rangeEnd) {
+            continue;
+        }
+        bool conflict = false;
+        for (size_t j = i + 1; j < block.ranges.size(); ++j) {
+            const Range& next = block.ranges[j];
+            if (!OnSamePage(end, next.offset)) {
+                break;
+            }
+            if (next.kind != RangeKind::Free && next.kind != kind) {
+                conflict = true;
+                break;
+            }
+        }
+        if (conflict) {
+            continue;
+        }
+
+        std::vector<Range> split;
+        if (start > range.offset) {
+            split.push_back({range.offset, start - range.offset, RangeKind::Free});
+        }
+        split.push_back({start, requirements.size, kind});
+        if (rangeEnd > end) {
+            split.push_back({end, rangeEnd - end, RangeKind::Free});
+        }
+        auto it = block.ranges.erase(block.ranges.begin() + static_cast<std::ptrdiff_t>(i));
+        block.ranges.insert(it, split.begin(), split.end());
+        *offset = start;
+        return true;
+    }
+    return false;
+}
+
+void VulkanAllocator::Free(VulkanAllocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    MemoryPool& pool = m_Pools[allocation.memoryTypeIdx];
+    pool.stats.allocationCount--;
+    pool.stats.usedBytes -= allocation.size;
+
+    if (allocation.blockIdx == UINT32_MAX) {
+        vkFreeMemory(m_Device, allocation.memory, nullptr);
+        pool.stats.dedicatedCount--;
+        pool.stats.reservedBytes -= allocation.size;
+        allocation = {};
+        return;
+    }
+
+    Block& block = pool.blocks[allocation.blockIdx];
+    FreeFromBlock(block, allocation.offset);
+
+    // Keep one empty block around per memory type to avoid allocation ping-pong
+    if (block.ranges.size() == 1) {
+        bool hasOtherEmptyBlock = false;
+        for (const Block& other : pool.blocks) {
+            if ((&other != &block) && (other.memory != VK_NULL_HANDLE) && (other.ranges.size() == 1)) {
+                hasOtherEmptyBlock = true;
+                break;
+            }
+        }
+        if (hasOtherEmptyBlock) {
+            vkFreeMemory(m_Device, block.memory, nullptr);
+            block = {};
+            pool.stats.blockCount--;
+            pool.stats.reservedBytes -= m_BlockSize;
+        }
+    }
+    allocation = {};
+}
+
+void VulkanAllocator::FreeFromBlock(Block& block, VkDeviceSize offset)
+{
+    auto it = std::lower_bound(
+        block.ranges.begin(),
+        block.ranges.end(),
+        offset,
+        [](const Range& range, VkDeviceSize value) { return range.offset < value; }
+    );
+    if (it == block.ranges.end() || it->offset != offset || it->kind == RangeKind::Free) {
+        SEError("Freeing memory range at offset {} which is not allocated", offset);
+        return;
+    }
+    it->kind = RangeKind::Free;
+
+    // Merge with free neighbours
+    auto next = it + 1;
+    if (next != block.ranges.end() && next->kind == RangeKind::Free) {
+        it->size += next->size;
+        block.ranges.erase(next);
+    }
+    if (it != block.ranges.begin()) {
+        auto prev = it - 1;
+        if (prev->kind == RangeKind::Free) {
+            prev->size += it->size;
+            block.ranges.erase(it);
+        }
+    }
+}
+
+bool VulkanAllocator::OnSamePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond) const
+{
+    const VkDeviceSize pageMask = ~(m_BufferImageGranularity - 1);
+    return ((endOfFirst - 1) & pageMask) == (startOfSecond & pageMask);
+}
+
+void* VulkanAllocator::MapMemory(VkDeviceMemory memory, uint32_t memoryTypeIdx)
+{
+    if (!(m_MemoryProps.memoryTypes[memoryTypeIdx].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+        return nullptr;
+    }
+    void* mapped = nullptr;
+    VK_CHECK_RESULT(vkMapMemory(m_Device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+    return mapped;
+}
+
+uint32_t VulkanAllocator::FindMemoryTypeIdx(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags) const
+{
+    for (uint32_t i = 0; i < m_MemoryProps.memoryTypeCount; ++i) {
+        if ((typeFilter & (1u << i)) && ((m_MemoryProps.memoryTypes[i].propertyFlags & propertyFlags) == propertyFlags)) {
+            return i;
+        }
+    }
+    SEWarn("Failed to find asked memory type");
+    return UINT32_MAX;
+}
+
+VulkanMemoryTypeStats VulkanAllocator::GetStats(uint32_t memoryTypeIdx) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Pools[memoryTypeIdx].stats;
+}
+
+VulkanMemoryTypeStats VulkanAllocator::GetTotalStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    VulkanMemoryTypeStats total;
+    for (uint32_t i = 0; i < m_MemoryProps.memoryTypeCount; ++i) {
+        const VulkanMemoryTypeStats& stats = m_Pools[i].stats;
+        total.blockCount += stats.blockCount;
+        total.allocationCount += stats.allocationCount;
+        total.dedicatedCount += stats.dedicatedCount;
+        total.reservedBytes += stats.reservedBytes;
+        total.usedBytes += stats.usedBytes;
+    }
+    return total;
+}
+
+void VulkanAllocator::LogStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (uint32_t i = 0; i < m_MemoryProps.memoryTypeCount; ++i) {
+        const VulkanMemoryTypeStats& stats = m_Pools[i].stats;
+        if (stats.reservedBytes == 0) {
+            continue;
+        }
+        SEInfo(
+            "-- Memory type {}: {} block(s) | {} dedicated | {} allocation(s) | {:.2f}/{:.2f} MiB used",
+            i,
+            stats.blockCount,
+            stats.dedicatedCount,
+            stats.allocationCount,
+            static_cast<double>(stats.usedBytes) / (1024.0 * 1024.0),
+            static_cast<double>(stats.reservedBytes) / (1024.0 * 1024.0)
+        );
+    }
+}
+
+}
@@ -0,0 +1,144 @@
+#include "serious/graphics/vulkan/VulkanBindless.hpp"
+#include "serious/graphics/vulkan/VulkanDevice.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace serious
+{
+
+VulkanBindlessTable::VulkanBindlessTable()
+    : m_Device(nullptr)
+    , m_SetLayout(VK_NULL_HANDLE)
+    , m_Pool(VK_NULL_HANDLE)
+    , m_Set(VK_NULL_HANDLE)
+    , m_Capacity(0)
+    , m_FramesInFlight(0)
+    , m_NextIndex(0)
+    , m_FreeIndices({})
+    , m_Retired({})
+    , m_Frame(0)
+{
+}
+
+void VulkanBindlessTable::Init(VulkanDevice* device, uint32_t capacity, uint32_t framesInFlight)
+{
+    m_Device = device;
+    m_FramesInFlight = framesInFlight;
+
+    // Software implementations such as lavapipe report much smaller limits than desktop GPUs
+    VkPhysicalDeviceVulkan12Properties props12 {};
+    props12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 props {};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props.pNext = &props12;
+    vkGetPhysicalDeviceProperties2(m_Device->GetGpuHandle(), &props);
+    // One sampler per stage is left for the regular descriptor set bound next to the table
+    m_Capacity = std::min({
+        capacity,
+        props12.maxDescriptorSetUpdateAfterBindSampledImages - 1,
+        props12.maxDescriptorSetUpdateAfterBindSamplers - 1,
+        props12.maxPerStageDescriptorUpdateAfterBindSampledImages - 1,
+        props12.maxPerStageDescriptorUpdateAfterBindSamplers - 1
+    });
+    SEInfo("-- Bindless texture table: {} slot(s)", m_Capacity);
+
+    VkDescriptorSetLayoutBinding binding {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = m_Capacity;
+    binding.stageFlags = VK_SHADER_STAGE_ALL;
+    m_SetLayout = m_Device->GetDescriptorSetLayoutCache().Get(
+        {binding},
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+        // Frames in flight keep sampling their slots while new slots are written
+        {VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT}
+    );
+
+    VkDescriptorPoolSize poolSize {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_Capacity};
+    VkDescriptorPoolCreateInfo poolInfo {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(m_Device->GetHandle(), &poolInfo, nullptr, &m_Pool));
+
+    VkDescriptorSetAllocateInfo allocInfo {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_Pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &m_SetLayout;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_Device->GetHandle(), &allocInfo, &m_Set));
+}
+
+void VulkanBindlessTable::Destroy()
+{
+    if (m_Pool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(m_Device->GetHandle(), m_Pool, nullptr);
+    }
+    // The layout is owned by the layout cache
+    m_SetLayout = VK_NULL_HANDLE;
+    m_Pool = VK_NULL_HANDLE;
+    m_Set = VK_NULL_HANDLE;
+    m_FreeIndices.clear();
+    m_Retired.clear();
+    m_NextIndex = 0;
+}
+
+uint32_t VulkanBindlessTable::Register(VkImageView imageView, VkSampler sampler, VkImageLayout layout)
+{
+    uint32_t index;
+    if (!m_FreeIndices.empty()) {
+        index = m_FreeIndices.back();
+        m_FreeIndices.pop_back();
+    } else if (m_NextIndex < m_Capacity) {
+        index = m_NextIndex++;
+    } else {
+        SEWarn("Bindless texture table is full ({} slot(s))", m_Capacity);
+        return InvalidIndex;
+    }
+    Write(index, imageView, sampler, layout);
+    return index;
+}
+
+void VulkanBindlessTable::Release(uint32_t index)
+{
+    if (index == InvalidIndex) {
+        return;
+    }
+    assert(index < m_NextIndex);
+    m_Retired.push_back({index, m_Frame});
+}
+
+void VulkanBindlessTable::NextFrame()
+{
+    m_Frame++;
+    // Retired slots are ordered by frame, the oldest ones are at the front
+    size_t recycled = 0;
+    while (recycled < m_Retired.size() && m_Retired[recycled].frame + m_FramesInFlight <= m_Frame) {
+        m_FreeIndices.push_back(m_Retired[recycled].index);
+        recycled++;
+    }
+    m_Retired.erase(m_Retired.begin(), m_Retired.begin() + static_cast<std::ptrdiff_t>(recycled));
+}
+
+void VulkanBindlessTable::Write(uint32_t index, VkImageView imageView, VkSampler sampler, VkImageLayout layout)
+{
+    VkDescriptorImageInfo imageInfo {};
+    imageInfo.imageLayout = layout;
+    imageInfo.imageView = imageView;
+    imageInfo.sampler = sampler;
+
+    VkWriteDescriptorSet descriptorWrite {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = m_Set;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = index;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(m_Device->GetHandle(), 1, &descriptorWrite, 0, nullptr);
+}
+
+}
@@ -1,16 +1,17 @@
 #include "serious/graphics/vulkan/VulkanCommand.hpp"
+#include "serious/graphics/vulkan/VulkanDevice.hpp"
 
 namespace serious
 {
 
-VulkanCommandBuffer VulkanCommandPool::Allocate()
+VulkanCommandBuffer VulkanCommandPool::Allocate(VkCommandBufferLevel level)
 {
     VulkanCommandBuffer cmdBuf;
 
     VkCommandBufferAllocateInfo allocInfo {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = m_CmdPool; 
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.level = level;
     allocInfo.commandBufferCount = 1;
     VK_CHECK_RESULT(vkAllocateCommandBuffers(m_Device, &allocInfo, &cmdBuf.m_CmdBuf));
     return cmdBuf;
@@ -21,6 +22,11 @@ void VulkanCommandPool::Free(VulkanCommandBuffer& cmdBuf)
     vkFreeCommandBuffers(m_Device, m_CmdPool, 1, &cmdBuf.m_CmdBuf);
 }
 
+void VulkanCommandPool::Reset()
+{
+    VK_CHECK_RESULT(vkResetCommandPool(m_Device, m_CmdPool, 0));
+}
+
 VulkanCommandBuffer::VulkanCommandBuffer()
     : m_CmdBuf(VK_NULL_HANDLE)
 {
@@ -36,6 +42,16 @@ void VulkanCommandBuffer::EndRenderPass()
     vkCmdEndRenderPass(m_CmdBuf);
 }
 
+void VulkanCommandBuffer::BeginRendering(const VkRenderingInfo& renderingInfo)
+{
+    vkCmdBeginRendering(m_CmdBuf, &renderingInfo);
+}
+
+void VulkanCommandBuffer::EndRendering()
+{
+    vkCmdEndRendering(m_CmdBuf);
+}
+
 void VulkanCommandBuffer::NextSubpass(VkSubpassContents contents)
 {
     vkCmdNextSubpass(m_CmdBuf, contents);
@@ -57,6 +73,36 @@ void VulkanCommandBuffer::BeginSingle()
     VK_CHECK_RESULT(vkBeginCommandBuffer(m_CmdBuf, &cmdBufBegin));
 }
 
+void VulkanCommandBuffer::BeginSecondary(VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer, VkQueryPipelineStatisticFlags pipelineStatistics)
+{
+    VkCommandBufferInheritanceInfo inheritanceInfo {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = subpass;
+    inheritanceInfo.framebuffer = framebuffer;
+    inheritanceInfo.pipelineStatistics = pipelineStatistics;
+
+    VkCommandBufferBeginInfo cmdBufBegin {};
+    cmdBufBegin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBufBegin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    cmdBufBegin.pInheritanceInfo = &inheritanceInfo;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_CmdBuf, &cmdBufBegin));
+}
+
+void VulkanCommandBuffer::BeginSecondary(const VkCommandBufferInheritanceRenderingInfo& renderingInfo, VkQueryPipelineStatisticFlags pipelineStatistics)
+{
+    VkCommandBufferInheritanceInfo inheritanceInfo {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.pNext = &renderingInfo;
+    inheritanceInfo.pipelineStatistics = pipelineStatistics;
+
+    VkCommandBufferBeginInfo cmdBufBegin {};
+    cmdBufBegin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBufBegin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    cmdBufBegin.pInheritanceInfo = &inheritanceInfo;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_CmdBuf, &cmdBufBegin));
+}
+
 void VulkanCommandBuffer::End()
 {
     VK_CHECK_RESULT(vkEndCommandBuffer(m_CmdBuf));
@@ -72,11 +118,16 @@ void VulkanCommandBuffer::BindGraphicsPipeline(VkPipeline pipeline)
     vkCmdBindPipeline(m_CmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 }
 
-void VulkanCommandBuffer::BindVertexBuffer(VkBuffer buffer, uint32_t offset)
+void VulkanCommandBuffer::BindComputePipeline(VkPipeline pipeline)
+{
+    vkCmdBindPipeline(m_CmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+}
+
+void VulkanCommandBuffer::BindVertexBuffer(VkBuffer buffer, uint32_t offset, uint32_t binding)
 {
     VkBuffer vertexBuffer[] = {buffer};
     VkDeviceSize dataOffset[] = {offset};
-    vkCmdBindVertexBuffers(m_CmdBuf, 0, 1, vertexBuffer, dataOffset);
+    vkCmdBindVertexBuffers(m_CmdBuf, binding, 1, vertexBuffer, dataOffset);
 }
 
 void VulkanCommandBuffer::BindIndexBuffer(VkBuffer buffer, uint32_t offset, VkIndexType type)
@@ -95,6 +146,21 @@ void VulkanCommandBuffer::DrawIndexed(uint32_t indexCount, uint32_t instanceCoun
     vkCmdDrawIndexed(m_CmdBuf, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
 }
 
+void VulkanCommandBuffer::DrawIndexedIndirectCount(VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride)
+{
+    vkCmdDrawIndexedIndirectCount(m_CmdBuf, buffer, offset, countBuffer, countOffset, maxDrawCount, stride);
+}
+
+void VulkanCommandBuffer::Dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    vkCmdDispatch(m_CmdBuf, groupCountX, groupCountY, groupCountZ);
+}
+
+void VulkanCommandBuffer::ExecuteCommands(const std::vector<VkCommandBuffer>& secondaryCmdBufs)
+{
+    vkCmdExecuteCommands(m_CmdBuf, static_cast<uint32_t>(secondaryCmdBufs.size()), secondaryCmdBufs.data());
+}
+
 void VulkanCommandBuffer::PipelineMemoryBarrier(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, const VkMemoryBarrier* memory)
 {
     vkCmdPipelineBarrier(m_CmdBuf, srcStageMask, dstStageMask, 0, 1, memory, 0, nullptr, 0, nullptr);
@@ -110,11 +176,41 @@ void VulkanCommandBuffer::PipelineImageBarrier(VkPipelineStageFlags srcStageMask
     vkCmdPipelineBarrier(m_CmdBuf, srcStageMask, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, imageMemory);
 }
 
+void VulkanCommandBuffer::PipelineBarriers(
+    VkPipelineStageFlags srcStageMask,
+    VkPipelineStageFlags dstStageMask,
+    const std::vector<VkBufferMemoryBarrier>& bufferMemory,
+    const std::vector<VkImageMemoryBarrier>& imageMemory)
+{
+    vkCmdPipelineBarrier(
+        m_CmdBuf, srcStageMask, dstStageMask, 0,
+        0, nullptr,
+        static_cast<uint32_t>(bufferMemory.size()), bufferMemory.data(),
+        static_cast<uint32_t>(imageMemory.size()), imageMemory.data()
+    );
+}
+
+void VulkanCommandBuffer::PipelineBarriers2(const std::vector<VkBufferMemoryBarrier2>& bufferMemory, const std::vector<VkImageMemoryBarrier2>& imageMemory)
+{
+    VkDependencyInfo dependencyInfo {};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferMemory.size());
+    dependencyInfo.pBufferMemoryBarriers = bufferMemory.data();
+    dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageMemory.size());
+    dependencyInfo.pImageMemoryBarriers = imageMemory.data();
+    vkCmdPipelineBarrier2(m_CmdBuf, &dependencyInfo);
+}
+
 void VulkanCommandBuffer::CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize offset)
+{
+    CopyBuffer(src, dst, size, offset, offset);
+}
+
+void VulkanCommandBuffer::CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset)
 {
     VkBufferCopy copyRegion {};
-    copyRegion.srcOffset = offset;
-    copyRegion.dstOffset = offset;
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
     copyRegion.size = size;
 
     vkCmdCopyBuffer(m_CmdBuf, src, dst, 1, &copyRegion);
@@ -125,9 +221,29 @@ void VulkanCommandBuffer::CopyBufferToImage(VkBuffer buffer, VkImage image, cons
     vkCmdCopyBufferToImage(m_CmdBuf, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, region);
 }
 
-void VulkanCommandBuffer::BindDescriptorSet(VkPipelineLayout layout, const VkDescriptorSet& descriptorSet)
+void VulkanCommandBuffer::CopyImageToBuffer(VkImage image, VkBuffer buffer, const VkBufferImageCopy* region)
+{
+    vkCmdCopyImageToBuffer(m_CmdBuf, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, region);
+}
+
+void VulkanCommandBuffer::BlitImage(VkImage src, VkImage dst, const VkImageBlit& region, VkFilter filter)
+{
+    vkCmdBlitImage(m_CmdBuf, src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, filter);
+}
+
+void VulkanCommandBuffer::BindDescriptorSet(VkPipelineLayout layout, const VkDescriptorSet& descriptorSet, uint32_t firstSet)
+{
+    vkCmdBindDescriptorSets(m_CmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, firstSet, 1, &descriptorSet, 0, nullptr);
+}
+
+void VulkanCommandBuffer::BindDescriptorSet(VkPipelineLayout layout, const VkDescriptorSet& descriptorSet, uint32_t firstSet, uint32_t dynamicOffset)
+{
+    vkCmdBindDescriptorSets(m_CmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, firstSet, 1, &descriptorSet, 1, &dynamicOffset);
+}
+
+void VulkanCommandBuffer::FillBuffer(VkBuffer buffer, uint32_t data, VkDeviceSize size, VkDeviceSize offset)
 {
-    vkCmdBindDescriptorSets(m_CmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdFillBuffer(m_CmdBuf, buffer, offset, size, data);
 }
 
 void VulkanCommandBuffer::SubmitOnceTo(VulkanQueue& queue, VkFence fence)
@@ -138,7 +254,6 @@ void VulkanCommandBuffer::SubmitOnceTo(VulkanQueue& queue, VkFence fence)
     submitInfo.pCommandBuffers = &m_CmdBuf;
     
     queue.Submit(submitInfo, fence);
-    queue.WaitIdle();
 }
 
 void VulkanCommandBuffer::SetViewport(const VkViewport& viewport)
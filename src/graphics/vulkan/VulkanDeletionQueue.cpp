@@ -0,0 +1,40 @@
+#include "serious/graphics/vulkan/VulkanDeletionQueue.hpp"
+
+#include <Tracy.hpp>
+
+namespace serious
+{
+
+VulkanDeletionQueue::VulkanDeletionQueue()
+    : m_Entries({})
+    , m_Frame(0)
+{
+}
+
+void VulkanDeletionQueue::Flush()
+{
+    for (Entry& entry : m_Entries) {
+        entry.release();
+    }
+    m_Entries.clear();
+}
+
+void VulkanDeletionQueue::Push(std::function<void()>&& release)
+{
+    m_Entries.push_back({m_Frame, std::move(release)});
+}
+
+void VulkanDeletionQueue::Collect(uint64_t completedFrame)
+{
+    if (m_Entries.empty() || m_Entries.front().frame > completedFrame) {
+        return;
+    }
+    ZoneScoped;
+    // Tags only grow along the queue
+    while (!m_Entries.empty() && m_Entries.front().frame <= completedFrame) {
+        m_Entries.front().release();
+        m_Entries.pop_front();
+    }
+}
+
+}
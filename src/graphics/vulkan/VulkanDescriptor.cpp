@@ -1,8 +1,116 @@
 #include "serious/graphics/vulkan/VulkanDescriptor.hpp"
+#include "serious/graphics/vulkan/VulkanUtils.hpp"
+
+#include <algorithm>
 
 namespace serious
 {
 
+DescriptorAllocator::DescriptorAllocator()
+    : m_Device(VK_NULL_HANDLE)
+    , m_Ratios({})
+    , m_SetsPerPool(0)
+    , m_UsedPools({})
+    , m_FreePools({})
+    , m_AllocatedSetCount(0)
+{
+}
+
+void DescriptorAllocator::Init(VkDevice device, uint32_t setsPerPool, const std::vector<PoolSizeRatio>& ratios)
+{
+    m_Device = device;
+    m_SetsPerPool = setsPerPool;
+    m_Ratios = ratios;
+    m_UsedPools.push_back(CreatePool(m_SetsPerPool));
+}
+
+void DescriptorAllocator::Destroy()
+{
+    for (VkDescriptorPool pool : m_UsedPools) {
+        vkDestroyDescriptorPool(m_Device, pool, nullptr);
+    }
+    for (VkDescriptorPool pool : m_FreePools) {
+        vkDestroyDescriptorPool(m_Device, pool, nullptr);
+    }
+    m_UsedPools.clear();
+    m_FreePools.clear();
+    m_AllocatedSetCount = 0;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout, const void* pNext)
+{
+    if (m_UsedPools.empty()) {
+        m_UsedPools.push_back(GrabPool());
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.pNext = pNext;
+    allocInfo.descriptorPool = m_UsedPools.back();
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VkResult result = vkAllocateDescriptorSets(m_Device, &allocInfo, &descriptorSet);
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        // Current pool is full, move on to the next one
+        m_UsedPools.push_back(GrabPool());
+        allocInfo.descriptorPool = m_UsedPools.back();
+        result = vkAllocateDescriptorSets(m_Device, &allocInfo, &descriptorSet);
+    }
+    VK_CHECK_RESULT(result);
+    m_AllocatedSetCount++;
+    return descriptorSet;
+}
+
+void DescriptorAllocator::Allocate(VkDescriptorSetLayout layout, std::vector<VkDescriptorSet>& descriptorSets)
+{
+    for (VkDescriptorSet& descriptorSet : descriptorSets) {
+        descriptorSet = Allocate(layout);
+    }
+}
+
+void DescriptorAllocator::Reset()
+{
+    for (VkDescriptorPool pool : m_UsedPools) {
+        VK_CHECK_RESULT(vkResetDescriptorPool(m_Device, pool, 0));
+        m_FreePools.push_back(pool);
+    }
+    m_UsedPools.clear();
+    m_AllocatedSetCount = 0;
+}
+
+VkDescriptorPool DescriptorAllocator::GrabPool()
+{
+    if (!m_FreePools.empty()) {
+        VkDescriptorPool pool = m_FreePools.back();
+        m_FreePools.pop_back();
+        return pool;
+    }
+    m_SetsPerPool = std::min(m_SetsPerPool * 2, MaxSetsPerPool);
+    return CreatePool(m_SetsPerPool);
+}
+
+VkDescriptorPool DescriptorAllocator::CreatePool(uint32_t setCount)
+{
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    poolSizes.reserve(m_Ratios.size());
+    for (const PoolSizeRatio& ratio : m_Ratios) {
+        poolSizes.push_back({
+            ratio.type,
+            std::max(1u, static_cast<uint32_t>(ratio.ratio * static_cast<float>(setCount)))
+        });
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = setCount;
 
+    VkDescriptorPool pool;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &pool));
+    return pool;
+}
 
-}
\ No newline at end of file
+}
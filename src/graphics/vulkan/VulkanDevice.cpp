@@ -6,8 +6,14 @@
 #include <stb_image.h>
 #include <Tracy.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <string>
 #include <string_view>
+#include <vector>
 
 namespace serious
 {
@@ -38,18 +44,26 @@ void VulkanQueue::WaitIdle()
     VK_CHECK_RESULT(vkQueueWaitIdle(m_Queue));
 }
 
-VulkanDevice::VulkanDevice(VkInstance instance)
+VulkanDevice::VulkanDevice(VkInstance instance, bool presentation)
     : m_Device(VK_NULL_HANDLE)
     , m_Gpu(VK_NULL_HANDLE)
     , m_GpuProps({})
     , m_GpuMemoryProps({})
     , m_DeviceLocalMemorySupport(false)
+    , m_BindlessSupport(false)
+    , m_DrawIndirectCountSupport(false)
+    , m_DynamicRenderingSupport(false)
+    , m_PipelineStatisticsSupport(false)
+    , m_InheritedQueriesSupport(false)
     , m_GraphicsQueue(nullptr)
     , m_ComputeQueue(nullptr)
     , m_TransferQueue(nullptr)
     , m_PresentQueue(nullptr)
+    , m_DescriptorSetLayoutCache({})
+    , m_PipelineLayoutCache({})
     , m_DescriptorSetLayout(VK_NULL_HANDLE)
-    , m_DescriptorPool(VK_NULL_HANDLE)
+    , m_BindlessTable({})
+    , m_DescriptorAllocator({})
 {
     SelectGpu(instance);
     vkGetPhysicalDeviceMemoryProperties(m_Gpu, &m_GpuMemoryProps);
@@ -65,9 +79,10 @@ VulkanDevice::VulkanDevice(VkInstance instance)
     vkEnumerateDeviceExtensionProperties(m_Gpu, nullptr, &deviceExtensionCount, nullptr);
     std::vector<VkExtensionProperties> supportedDeviceExtensions(deviceExtensionCount);
     vkEnumerateDeviceExtensionProperties(m_Gpu, nullptr, &deviceExtensionCount, supportedDeviceExtensions.data());
-    std::vector<const char*> deviceExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME  
-    };
+    std::vector<const char*> deviceExtensions;
+    if (presentation) {
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
     if (!validateExtension(deviceExtensions, supportedDeviceExtensions)) {
         SEFatal("Required device extensions not found");
     }
@@ -144,11 +159,74 @@ VulkanDevice::VulkanDevice(VkInstance instance)
         }
     }
 
+    VkPhysicalDeviceVulkan13Features supportedFeatures13 = {};
+    supportedFeatures13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    VkPhysicalDeviceVulkan12Features supportedFeatures12 = {};
+    supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    supportedFeatures12.pNext = &supportedFeatures13;
+    VkPhysicalDeviceFeatures2 supportedFeatures = {};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &supportedFeatures12;
+    vkGetPhysicalDeviceFeatures2(m_Gpu, &supportedFeatures);
+    if (!supportedFeatures12.timelineSemaphore) {
+        SEFatal("Timeline semaphores not supported");
+    }
+    if (!supportedFeatures13.synchronization2) {
+        SEFatal("Synchronization2 not supported");
+    }
+    m_BindlessSupport = supportedFeatures12.runtimeDescriptorArray
+        && supportedFeatures12.descriptorBindingPartiallyBound
+        && supportedFeatures12.descriptorBindingSampledImageUpdateAfterBind
+        && supportedFeatures12.descriptorBindingUpdateUnusedWhilePending
+        && supportedFeatures12.shaderSampledImageArrayNonUniformIndexing;
+    if (m_BindlessSupport) {
+        SEInfo("-- Descriptor indexing supported");
+    } else {
+        SEWarn("Descriptor indexing not supported, bindless textures disabled");
+    }
+    // The cull shader selects the instance transform of each draw through firstInstance
+    m_DrawIndirectCountSupport = supportedFeatures12.drawIndirectCount
+        && supportedFeatures.features.multiDrawIndirect
+        && supportedFeatures.features.drawIndirectFirstInstance;
+    if (!m_DrawIndirectCountSupport) {
+        SEWarn("Indirect draw count or first instance not supported, GPU culled passes disabled");
+    }
+    m_DynamicRenderingSupport = supportedFeatures13.dynamicRendering;
+    if (!m_DynamicRenderingSupport) {
+        SEWarn("Dynamic rendering not supported, falling back to render pass objects");
+    }
+    m_PipelineStatisticsSupport = supportedFeatures.features.pipelineStatisticsQuery;
+    // Statistics queries stay active across secondary command buffers executed inside them
+    m_InheritedQueriesSupport = m_PipelineStatisticsSupport && supportedFeatures.features.inheritedQueries;
+
     VkPhysicalDeviceFeatures deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE; // enable anisotropy manually
+    deviceFeatures.multiDrawIndirect = m_DrawIndirectCountSupport;
+    deviceFeatures.drawIndirectFirstInstance = m_DrawIndirectCountSupport;
+    deviceFeatures.pipelineStatisticsQuery = m_PipelineStatisticsSupport;
+    deviceFeatures.inheritedQueries = m_InheritedQueriesSupport;
+
+    VkPhysicalDeviceVulkan12Features deviceFeatures12 = {};
+    deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    deviceFeatures12.timelineSemaphore = VK_TRUE; // upload completion tokens
+    // Bindless texture table
+    deviceFeatures12.runtimeDescriptorArray = m_BindlessSupport;
+    deviceFeatures12.descriptorBindingPartiallyBound = m_BindlessSupport;
+    deviceFeatures12.descriptorBindingSampledImageUpdateAfterBind = m_BindlessSupport;
+    deviceFeatures12.descriptorBindingUpdateUnusedWhilePending = m_BindlessSupport;
+    deviceFeatures12.shaderSampledImageArrayNonUniformIndexing = m_BindlessSupport;
+    // GPU culled passes
+    deviceFeatures12.drawIndirectCount = m_DrawIndirectCountSupport;
+
+    VkPhysicalDeviceVulkan13Features deviceFeatures13 = {};
+    deviceFeatures13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    deviceFeatures13.dynamicRendering = m_DynamicRenderingSupport;
+    deviceFeatures13.synchronization2 = VK_TRUE; // image tracker and render graph barriers
+    deviceFeatures12.pNext = &deviceFeatures13;
 
     VkDeviceCreateInfo deviceInfo = {};
     deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceInfo.pNext = &deviceFeatures12;
     deviceInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
     deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
     deviceInfo.queueCreateInfoCount = queueFamilyInfos.size();
@@ -167,7 +245,17 @@ VulkanDevice::VulkanDevice(VkInstance instance)
     }
     m_TransferQueue = CreateRef<VulkanQueue>(this, transferQueueFamilyIndex, VulkanQueueUsage::Transfer);
 
+    m_Allocator.Init(m_Device, m_Gpu);
+    m_PipelineCache.Init(m_Device, m_GpuProps);
     m_OperationFence = VulkanFence(m_Device);
+    m_StagingRing.Init(this);
+    m_Uploader.Init(this, &m_StagingRing);
+    m_DescriptorSetLayoutCache.Init(m_Device);
+    m_PipelineLayoutCache.Init(m_Device);
+    m_DescriptorAllocator.Init(m_Device, 16, {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f}
+    });
 }
 
 VulkanDevice::~VulkanDevice()
@@ -176,7 +264,24 @@ VulkanDevice::~VulkanDevice()
 
 void VulkanDevice::Destroy()
 {
+    // Deferred releases still reference the allocator and the image tracker
+    m_DeletionQueue.Flush();
     DestroyFence(m_OperationFence);
+    m_Uploader.Destroy();
+    m_StagingRing.Destroy();
+    VulkanLayoutCacheStats setLayoutStats = m_DescriptorSetLayoutCache.GetStats();
+    VulkanLayoutCacheStats pipelineLayoutStats = m_PipelineLayoutCache.GetStats();
+    SEInfo("-- Layout cache: set layouts {} hit(s) / {} miss(es), pipeline layouts {} hit(s) / {} miss(es)",
+        setLayoutStats.hitCount, setLayoutStats.missCount,
+        pipelineLayoutStats.hitCount, pipelineLayoutStats.missCount
+    );
+    m_BindlessTable.Destroy();
+    m_PipelineLayoutCache.Destroy();
+    m_DescriptorSetLayoutCache.Destroy();
+    m_PipelineCache.LogStats();
+    m_PipelineCache.Destroy();
+    m_Allocator.LogStats();
+    m_Allocator.Destroy();
     vkDestroyDevice(m_Device, nullptr);
 }
 
@@ -242,12 +347,28 @@ VkSemaphore VulkanDevice::CreateSemaphore()
     return semaphore;
 }
 
+VkSemaphore VulkanDevice::CreateTimelineSemaphore(uint64_t initialValue)
+{
+    VkSemaphore semaphore;
+    VkSemaphoreTypeCreateInfo semaphoreTypeInfo = {};
+    semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeInfo.initialValue = initialValue;
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &semaphoreTypeInfo;
+    VK_CHECK_RESULT(vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &semaphore));
+    return semaphore;
+}
+
 VulkanImage VulkanDevice::CreateImage(
     uint32_t width, uint32_t height,
     VkFormat format,
     VkImageTiling imageTiling,
     VkImageUsageFlags usage,
-    VkMemoryPropertyFlags properties)
+    VkMemoryPropertyFlags properties,
+    bool dedicated,
+    uint32_t mipLevels)
 {
     VulkanImage image;
 
@@ -257,7 +378,7 @@ VulkanImage VulkanDevice::CreateImage(
     imageInfo.extent.width = width;
     imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = 1;
     imageInfo.format = format;
     imageInfo.tiling = imageTiling;
@@ -267,30 +388,26 @@ VulkanImage VulkanDevice::CreateImage(
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     VK_CHECK_RESULT(vkCreateImage(m_Device, &imageInfo, nullptr, &image.image));
 
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(m_Device, image.image, &memRequirements);
-
-    VkMemoryAllocateInfo allocateInfo {};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.allocationSize = memRequirements.size;
-    allocateInfo.memoryTypeIndex = FindMemoryTypeIdx(memRequirements.memoryTypeBits, properties);
-    VK_CHECK_RESULT(vkAllocateMemory(m_Device, &allocateInfo, nullptr, &image.memory));
-    vkBindImageMemory(m_Device, image.image, image.memory, 0);
+    image.allocation = m_Allocator.AllocateImage(image.image, imageTiling, properties, dedicated);
+    VK_CHECK_RESULT(vkBindImageMemory(m_Device, image.image, image.allocation.memory, image.allocation.offset));
+    m_ImageTracker.Register(image.image, VulkanImageTracker::GetAspect(format), mipLevels);
 
     return image;
 }
 
 void VulkanDevice::DestroyImage(VulkanImage& image)
 {
+    m_ImageTracker.Unregister(image.image);
     vkDestroyImage(m_Device, image.image, nullptr);
-    vkFreeMemory(m_Device, image.memory, nullptr);
+    m_Allocator.Free(image.allocation);
 }
 
 VkImageView VulkanDevice::CreateImageView(
     VkImage image,
     VkFormat format,
     VkImageAspectFlags aspectFlags,
-    VkComponentMapping mapping)
+    VkComponentMapping mapping,
+    uint32_t mipLevels)
 {
     VkImageView imageView;
     VkImageViewCreateInfo viewInfo {};
@@ -301,7 +418,7 @@ VkImageView VulkanDevice::CreateImageView(
     viewInfo.components = mapping;
     viewInfo.subresourceRange.aspectMask = aspectFlags;
     viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.levelCount = mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
     VK_CHECK_RESULT(vkCreateImageView(m_Device, &viewInfo, nullptr, &imageView));
@@ -352,16 +469,8 @@ void VulkanDevice::CreateBuffer(
 
     VK_CHECK_RESULT(vkCreateBuffer(m_Device, &bufferInfo, nullptr, &buffer.buffer));
 
-    VkMemoryRequirements memoryRequirements {};
-    vkGetBufferMemoryRequirements(m_Device, buffer.buffer, &memoryRequirements);
-    
-    VkMemoryAllocateInfo allocateInfo {};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.allocationSize = memoryRequirements.size;
-    allocateInfo.memoryTypeIndex = FindMemoryTypeIdx(memoryRequirements.memoryTypeBits, properties);
-
-    VK_CHECK_RESULT(vkAllocateMemory(m_Device, &allocateInfo, nullptr, &buffer.memory));
-    vkBindBufferMemory(m_Device, buffer.buffer, buffer.memory, 0);
+    buffer.allocation = m_Allocator.AllocateBuffer(buffer.buffer, properties);
+    VK_CHECK_RESULT(vkBindBufferMemory(m_Device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset));
 }
 
 void VulkanDevice::CopyToBuffer(VulkanBuffer& buffer, const void* data, VkDeviceSize size)
@@ -373,7 +482,8 @@ void VulkanDevice::CopyToBuffer(VulkanBuffer& buffer, const void* data, VkDevice
 void VulkanDevice::DestroyBuffer(VulkanBuffer& buffer)
 {
     vkDestroyBuffer(m_Device, buffer.buffer, nullptr);
-    vkFreeMemory(m_Device, buffer.memory, nullptr);
+    m_Allocator.Free(buffer.allocation);
+    buffer.mapped = nullptr;
 }
 
 void VulkanDevice::CopyBuffer(
@@ -391,142 +501,249 @@ void VulkanDevice::CopyBuffer(
     m_OperationFence.WaitAndReset();
 }
 
-void VulkanDevice::CreateDeviceBuffer(
+void VulkanDevice::ReadImage(
+    VkImage image,
+    const VkExtent2D& extent,
+    void* dst,
+    VulkanCommandBuffer& gfxCmd)
+{
+    const VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    VulkanBuffer readback;
+    CreateBuffer(readback, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    gfxCmd.BeginSingle();
+    VulkanBarrierBatch barriers;
+    // Writes of earlier submissions were made available when the image left its last usage
+    VkImageMemoryBarrier2 imageBarrier {};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    imageBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+    imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    imageBarrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = image;
+    imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    barriers.AddImage(imageBarrier);
+    barriers.Flush(gfxCmd);
+
+    VkBufferImageCopy region {};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {extent.width, extent.height, 1};
+    gfxCmd.CopyImageToBuffer(image, readback.buffer, &region);
+
+    VkBufferMemoryBarrier2 hostBarrier {};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+    hostBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    hostBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    hostBarrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = readback.buffer;
+    hostBarrier.size = VK_WHOLE_SIZE;
+    barriers.AddBuffer(hostBarrier);
+    barriers.Flush(gfxCmd);
+    gfxCmd.End();
+
+    gfxCmd.SubmitOnceTo(*m_GraphicsQueue, m_OperationFence.m_Fence);
+    m_OperationFence.WaitAndReset();
+
+    MapBuffer(readback, size, 0);
+    memcpy(dst, readback.mapped, size);
+    UnmapBuffer(readback);
+    DestroyBuffer(readback);
+}
+
+VulkanUploadToken VulkanDevice::CreateDeviceBuffer(
     VulkanBuffer& buffer,
     VkDeviceSize size,
-    void* data,
-    VkBufferUsageFlags usage,
-    VulkanCommandBuffer& tsfCmd)
+    const void* data,
+    VkBufferUsageFlags usage)
 {
     if (m_DeviceLocalMemorySupport) {
-        VulkanBuffer stagingBuffer;
-        CreateBuffer(stagingBuffer, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        MapBuffer(stagingBuffer, size, 0);
-        CopyToBuffer(stagingBuffer, data, size);
-        UnmapBuffer(stagingBuffer);
         CreateBuffer(buffer, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        CopyBuffer(stagingBuffer.buffer, buffer.buffer, size, 0, tsfCmd);
-        DestroyBuffer(stagingBuffer);
+        m_Uploader.UploadBuffer(buffer.buffer, usage, 0, data, size);
+        return m_Uploader.Flush();
     } else {
         SEWarn("Device local memory not supported, using host visible memory");
         CreateBuffer(buffer, size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        MapBuffer(buffer, size, 0);
+        CopyToBuffer(buffer, data, size);
+        UnmapBuffer(buffer);
+        return 0;
     }
 }
 
 void VulkanDevice::MapBuffer(VulkanBuffer& buffer, VkDeviceSize size, VkDeviceSize offset)
 {
-    VK_CHECK_RESULT(vkMapMemory(m_Device, buffer.memory, offset, size, 0, &buffer.mapped));
+    // Host visible blocks are persistently mapped by the allocator
+    (void)size;
+    assert(buffer.allocation.mapped);
+    buffer.mapped = static_cast<char*>(buffer.allocation.mapped) + offset;
 }
 
 void VulkanDevice::UnmapBuffer(VulkanBuffer& buffer)
 {
-    vkUnmapMemory(m_Device, buffer.memory);
+    buffer.mapped = nullptr;
 }
 
-void VulkanDevice::TransitionImageLayout(
-    VkImage image,
-    VkImageLayout srcLayout,
-    VkImageLayout dstLayout,
-    VkImageAspectFlags aspectFlags,
-    VulkanCommandBuffer& cmd)
-{
-    cmd.BeginSingle();
-
-    VkImageMemoryBarrier barrier {};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = srcLayout;
-    barrier.newLayout = dstLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange.aspectMask = aspectFlags;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-
-    VkPipelineStageFlags srcStage = 0;
-    VkPipelineStageFlags dstStage = 0;
-    if ((srcLayout == VK_IMAGE_LAYOUT_UNDEFINED) && (dstLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if ((srcLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) && (dstLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)){
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else if ((srcLayout == VK_IMAGE_LAYOUT_UNDEFINED) && (dstLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-        srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        dstStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    } else {
-        SEError("Unsupported layout transition");
+static bool IsSrgbFormat(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+            return true;
+        default:
+            return false;
     }
-    cmd.PipelineImageBarrier(srcStage, dstStage, &barrier);
-    cmd.End();
+}
 
-    cmd.SubmitOnceTo(*m_GraphicsQueue, m_OperationFence.m_Fence);
-    m_OperationFence.WaitAndReset();
+static float SrgbToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
 }
 
-void VulkanDevice::CreateTextureImage(
-    VulkanTexture& texture,
-    const std::string& path,
-    VkFormat format,
-    VkComponentMapping mapping,
-    VulkanCommandBuffer& gfxCmd)
+static float LinearToSrgb(float value)
 {
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// 2x2 box filter of RGBA8 pixels, odd edges reuse the last row or column. sRGB color channels are
+// averaged in linear space, alpha is always linear
+static std::vector<uint32_t> DownsampleRGBA8(const uint32_t* src, uint32_t width, uint32_t height, bool srgb)
+{
+    static const std::array<float, 256> srgbToLinear = [] {
+        std::array<float, 256> table {};
+        for (uint32_t i = 0; i < table.size(); ++i) {
+            table[i] = SrgbToLinear(static_cast<float>(i) / 255.0f);
+        }
+        return table;
+    }();
+    const uint32_t dstWidth = std::max(1u, width >> 1);
+    const uint32_t dstHeight = std::max(1u, height >> 1);
+    std::vector<uint32_t> dst(static_cast<size_t>(dstWidth) * dstHeight);
+    for (uint32_t y = 0; y < dstHeight; ++y) {
+        const uint32_t y0 = std::min(y * 2, height - 1);
+        const uint32_t y1 = std::min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < dstWidth; ++x) {
+            const uint32_t x0 = std::min(x * 2, width - 1);
+            const uint32_t x1 = std::min(x * 2 + 1, width - 1);
+            const uint32_t texels[4] = {src[y0 * width + x0], src[y0 * width + x1], src[y1 * width + x0], src[y1 * width + x1]};
+            uint32_t result = 0;
+            for (uint32_t shift = 0; shift < 32; shift += 8) {
+                if (srgb && shift < 24) {
+                    float sum = 0.0f;
+                    for (uint32_t texel : texels) {
+                        sum += srgbToLinear[(texel >> shift) & 0xFF];
+                    }
+                    const float value = std::clamp(LinearToSrgb(sum * 0.25f), 0.0f, 1.0f);
+                    result |= static_cast<uint32_t>(value * 255.0f + 0.5f) << shift;
+                    continue;
+                }
+                uint32_t sum = 2;
+                for (uint32_t texel : texels) {
+                    sum += (texel >> shift) & 0xFF;
+                }
+                result |= (sum / 4) << shift;
+            }
+            dst[y * dstWidth + x] = result;
+        }
+    }
+    return dst;
+}
+
+VulkanTexturePixels VulkanDevice::LoadTexturePixels(const std::string& path, VkFormat format) const
+{
+    ZoneScoped;
+    VulkanTexturePixels result;
     int width, height, channels;
     stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
     if (!pixels) {
         SEWarn("Failed to load image {}", path);
-        width = 1;
-        height = 1;
-        static constexpr uint32_t errorColor = 0xFF00FFFF;
-        pixels = (stbi_uc*)(&errorColor);
+        result.width = 1;
+        result.height = 1;
+        result.levels.push_back({VulkanTexturePixels::ErrorTexel});
+        return result;
+    }
+    const auto takeLevel = [&result](stbi_uc* levelPixels, uint32_t levelWidth, uint32_t levelHeight) {
+        const uint32_t* texels = reinterpret_cast<const uint32_t*>(levelPixels);
+        result.levels.emplace_back(texels, texels + static_cast<size_t>(levelWidth) * levelHeight);
+        stbi_image_free(levelPixels);
+    };
+    result.width = static_cast<uint32_t>(width);
+    result.height = static_cast<uint32_t>(height);
+    takeLevel(pixels, result.width, result.height);
+    const uint32_t mipLevels = GetMipLevelCount(result.width, result.height);
+
+    // Precomputed levels stop at the first missing file or mismatching size
+    const size_t extension = path.find_last_of('.');
+    const std::string stem = path.substr(0, extension);
+    const std::string suffix = extension == std::string::npos ? "" : path.substr(extension);
+    while (result.levels.size() < mipLevels) {
+        const uint32_t level = static_cast<uint32_t>(result.levels.size());
+        const std::string levelPath = stem + "_mip" + std::to_string(level) + suffix;
+        const uint32_t levelWidth = std::max(1u, result.width >> level);
+        const uint32_t levelHeight = std::max(1u, result.height >> level);
+        int loadedWidth, loadedHeight;
+        stbi_uc* levelPixels = stbi_load(levelPath.c_str(), &loadedWidth, &loadedHeight, &channels, STBI_rgb_alpha);
+        if (!levelPixels) {
+            break;
+        }
+        if (static_cast<uint32_t>(loadedWidth) != levelWidth || static_cast<uint32_t>(loadedHeight) != levelHeight) {
+            SEWarn("Ignoring mip level {} with unexpected size", levelPath);
+            stbi_image_free(levelPixels);
+            break;
+        }
+        takeLevel(levelPixels, levelWidth, levelHeight);
+    }
+    // Formats without linear blits get the remaining levels downsampled here
+    if (!IsLinearBlitSupported(format)) {
+        const bool srgb = IsSrgbFormat(format);
+        while (result.levels.size() < mipLevels) {
+            const uint32_t level = static_cast<uint32_t>(result.levels.size());
+            result.levels.push_back(DownsampleRGBA8(
+                result.levels.back().data(),
+                std::max(1u, result.width >> (level - 1)),
+                std::max(1u, result.height >> (level - 1)),
+                srgb
+            ));
+        }
     }
-    texture.width = static_cast<uint32_t>(width);
-    texture.height = static_cast<uint32_t>(height);
-    VkDeviceSize imageSize = static_cast<VkDeviceSize>(width * height * 4);
-    VulkanBuffer stagingBuffer;
-    CreateBuffer(stagingBuffer, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    MapBuffer(stagingBuffer, imageSize, 0);
-    CopyToBuffer(stagingBuffer, pixels, imageSize);
-    UnmapBuffer(stagingBuffer);
-    stbi_image_free(pixels);
+    return result;
+}
+
+VulkanUploadToken VulkanDevice::CreateTextureImage(
+    VulkanTexture& texture,
+    const VulkanTexturePixels& pixels,
+    VkFormat format,
+    VkComponentMapping mapping)
+{
+    texture.width = pixels.width;
+    texture.height = pixels.height;
+    texture.mipLevels = GetMipLevelCount(texture.width, texture.height);
 
     texture.image = CreateImage(
         texture.width, texture.height,
         format, VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        m_DeviceLocalMemorySupport ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        m_DeviceLocalMemorySupport ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        false,
+        texture.mipLevels
     );
-    TransitionImageLayout(texture.image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, gfxCmd);
-    gfxCmd.BeginSingle();
-    VkBufferImageCopy region {};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = {texture.width, texture.height, 1};
-    gfxCmd.CopyBufferToImage(stagingBuffer.buffer, texture.image.image, &region);
-    gfxCmd.End();
-    gfxCmd.SubmitOnceTo(*m_GraphicsQueue, m_OperationFence.m_Fence);
-    m_OperationFence.WaitAndReset();
-    TransitionImageLayout(texture.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, gfxCmd);
-    DestroyBuffer(stagingBuffer);
+    // Pixels are copied into the staging ring while recording
+    std::vector<const void*> levels;
+    levels.reserve(pixels.levels.size());
+    for (const std::vector<uint32_t>& level : pixels.levels) {
+        levels.push_back(level.data());
+    }
+    m_Uploader.UploadImage(texture.image.image, texture.width, texture.height, levels);
+    VulkanUploadToken token = m_Uploader.Flush();
 
-    texture.imageView = CreateImageView(texture.image.image, format, VK_IMAGE_ASPECT_COLOR_BIT, mapping);
+    texture.imageView = CreateImageView(texture.image.image, format, VK_IMAGE_ASPECT_COLOR_BIT, mapping, texture.mipLevels);
 
     VkSamplerCreateInfo samplerInfo {};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -544,23 +761,29 @@ void VulkanDevice::CreateTextureImage(
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
     VK_CHECK_RESULT(vkCreateSampler(m_Device, &samplerInfo, nullptr, &texture.sampler));
+    return token;
 }
 
-void VulkanDevice::CreateDepthImage(VulkanTexture& texture, const VkExtent2D& extent, VulkanCommandBuffer& gfxCmd)
+bool VulkanDevice::IsLinearBlitSupported(VkFormat format) const
 {
-    texture.image = CreateImage(
-        extent.width, extent.height,
-        VK_FORMAT_D32_SFLOAT,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        m_DeviceLocalMemorySupport ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-    );
-    TransitionImageLayout(texture.image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT, gfxCmd);
-    texture.imageView = CreateImageView(texture.image.image, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(m_Gpu, format, &properties);
+    const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT
+        | VK_FORMAT_FEATURE_BLIT_DST_BIT
+        | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & required) == required;
 }
 
+uint32_t VulkanDevice::GetMipLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size >>= 1) {
+        levels++;
+    }
+    return levels;
+}
 
 void VulkanDevice::DestroyTextureImage(VulkanTexture& texture)
 {
@@ -571,52 +794,43 @@ void VulkanDevice::DestroyTextureImage(VulkanTexture& texture)
     DestroyImage(texture.image);
 }
 
-void VulkanDevice::DestroyCommandPool(VulkanCommandPool& cmdPool)
+void VulkanDevice::DeferDestroyBuffer(VulkanBuffer& buffer)
 {
-    vkDestroyCommandPool(m_Device, cmdPool.m_CmdPool, nullptr);
+    m_DeletionQueue.Push([this, released = buffer]() mutable {
+        DestroyBuffer(released);
+    });
+    buffer = {};
 }
 
-void VulkanDevice::SetDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+void VulkanDevice::DeferDestroyTextureImage(VulkanTexture& texture)
+{
+    m_DeletionQueue.Push([this, released = texture]() mutable {
+        DestroyTextureImage(released);
+    });
+    texture = {};
+}
+
+void VulkanDevice::DestroyCommandPool(VulkanCommandPool& cmdPool)
 {
-    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo {};
-    descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    descriptorSetLayoutInfo.pBindings = bindings.data();
-    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_Device, &descriptorSetLayoutInfo, nullptr, &m_DescriptorSetLayout));
+    vkDestroyCommandPool(m_Device, cmdPool.m_CmdPool, nullptr);
 }
 
-void VulkanDevice::SetDescriptorPool(const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets)
+void VulkanDevice::SetDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
 {
-    VkDescriptorPoolCreateInfo poolInfo {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-    poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = maxSets;
-    VK_CHECK_RESULT(vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool));
+    m_DescriptorSetLayout = m_DescriptorSetLayoutCache.Get(bindings);
 }
 
 void VulkanDevice::AllocateDescriptorSets(std::vector<VkDescriptorSet>& descriptorSets)
 {
-    assert(m_DescriptorPool != VK_NULL_HANDLE);
     assert(m_DescriptorSetLayout != VK_NULL_HANDLE);
-
-    std::vector<VkDescriptorSetLayout> layouts(descriptorSets.size(), m_DescriptorSetLayout);
-    VkDescriptorSetAllocateInfo allocInfo {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = m_DescriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(descriptorSets.size());
-    allocInfo.pSetLayouts = layouts.data();
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_Device, &allocInfo, descriptorSets.data()));
+    m_DescriptorAllocator.Allocate(m_DescriptorSetLayout, descriptorSets);
 }
 
 void VulkanDevice::DestroyDescriptorResources()
 {
-    if (m_DescriptorPool != VK_NULL_HANDLE) {
-        vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
-    }
-    if (m_DescriptorSetLayout != VK_NULL_HANDLE) {
-        vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, nullptr);
-    }
+    m_DescriptorAllocator.Destroy();
+    // The layout itself is owned by the layout cache
+    m_DescriptorSetLayout = VK_NULL_HANDLE;
 }
 
 void VulkanDevice::SelectGpu(VkInstance instance)
@@ -656,15 +870,4 @@ void VulkanDevice::SelectGpu(VkInstance instance)
     SETrace("Using gpu(0x{:x}): {} score: {}", (size_t)m_Gpu, m_GpuProps.deviceName, highestScore);
 }
 
-uint32_t VulkanDevice::FindMemoryTypeIdx(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags)
-{
-    for (uint32_t i = 0; i < m_GpuMemoryProps.memoryTypeCount; ++i) {
-        if ((typeFilter & (1 << i)) && (m_GpuMemoryProps.memoryTypes[i].propertyFlags & propertyFlags)) {
-            return i;
-        }
-    }
-    SEWarn("Failed to find asked memory type");
-    return UINT32_MAX;   
-}
-
 }
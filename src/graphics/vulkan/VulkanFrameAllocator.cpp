@@ -0,0 +1,86 @@
+#include "serious/graphics/vulkan/VulkanFrameAllocator.hpp"
+#include "serious/graphics/vulkan/VulkanDevice.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace serious
+{
+
+static inline VkDeviceSize AlignTo(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+VulkanFrameAllocator::VulkanFrameAllocator()
+    : m_Device(nullptr)
+    , m_Buffer({})
+    , m_FrameSize(0)
+    , m_Alignment(1)
+    , m_FramesInFlight(0)
+    , m_FrameBegin(0)
+    , m_Head(0)
+    , m_AllocationCount(0)
+    , m_Exhausted(false)
+{
+}
+
+void VulkanFrameAllocator::Init(VulkanDevice* device, uint32_t framesInFlight, VkDeviceSize frameSize)
+{
+    m_Device = device;
+    m_FramesInFlight = framesInFlight;
+    m_Alignment = std::max<VkDeviceSize>(m_Device->GetGpuProperties().limits.minUniformBufferOffsetAlignment, 1);
+    // Every region starts on an aligned offset
+    m_FrameSize = AlignTo(frameSize, m_Alignment);
+    m_Device->CreateBuffer(
+        m_Buffer,
+        m_FrameSize * m_FramesInFlight,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    );
+    m_Device->MapBuffer(m_Buffer, m_FrameSize * m_FramesInFlight, 0);
+    m_FrameBegin = 0;
+    m_Head = 0;
+    SEInfo("-- Frame allocator: {} x {} KiB, {} byte alignment", m_FramesInFlight, m_FrameSize / 1024, m_Alignment);
+}
+
+void VulkanFrameAllocator::Destroy()
+{
+    if (m_Buffer.buffer != VK_NULL_HANDLE) {
+        m_Device->DestroyBuffer(m_Buffer);
+    }
+    m_Buffer = {};
+}
+
+void VulkanFrameAllocator::BeginFrame(uint32_t frame)
+{
+    assert(frame < m_FramesInFlight);
+    m_FrameBegin = m_FrameSize * frame;
+    m_Head = m_FrameBegin;
+    m_AllocationCount = 0;
+    m_Exhausted = false;
+}
+
+VulkanFrameAllocation VulkanFrameAllocator::Allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    VkDeviceSize offset = AlignTo(m_Head, std::max(m_Alignment, alignment));
+    if (offset + size > m_FrameBegin + m_FrameSize) {
+        if (m_Exhausted) {
+            return {};
+        }
+        m_Exhausted = true;
+        SEWarn("Frame allocator exhausted, {} byte(s) requested with {} byte(s) left", size, m_FrameBegin + m_FrameSize - m_Head);
+        return {};
+    }
+    m_Head = offset + size;
+    m_AllocationCount++;
+
+    VulkanFrameAllocation allocation;
+    allocation.buffer = m_Buffer.buffer;
+    allocation.offset = static_cast<uint32_t>(offset);
+    allocation.mapped = static_cast<char*>(m_Buffer.mapped) + offset;
+    return allocation;
+}
+
+}
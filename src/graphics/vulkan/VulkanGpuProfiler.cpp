@@ -0,0 +1,265 @@
+#include "serious/graphics/vulkan/VulkanGpuProfiler.hpp"
+#include "serious/graphics/vulkan/VulkanDevice.hpp"
+#include "serious/io/log.hpp"
+
+#include <Tracy.hpp>
+#include <TracyVulkan.hpp>
+
+#include <cstring>
+#include <new>
+
+namespace serious
+{
+
+// Same order as the statistic flags below
+static constexpr VkQueryPipelineStatisticFlags StatisticFlags =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+static constexpr uint32_t StatisticCount = 6;
+// Frame begin and end around the zones
+static constexpr uint32_t TimestampCapacity = 2 + VulkanGpuProfiler::MaxZonesPerFrame * 2;
+
+VulkanGpuProfiler::VulkanGpuProfiler()
+    : m_Device(nullptr)
+    , m_Frames({})
+    , m_Current(nullptr)
+    , m_OpenZones({})
+    , m_FrameCount(0)
+    , m_TimestampPeriod(0.0)
+    , m_TimestampMask(0)
+    , m_PipelineStatistics(false)
+    , m_LastProfile({})
+    , m_TracyContext(nullptr)
+    , m_TracyZones({})
+{
+}
+
+void VulkanGpuProfiler::Init(VulkanDevice* device, VulkanCommandPool& cmdPool, uint32_t framesInFlight, bool pipelineStatistics)
+{
+    m_Device = device;
+    VkPhysicalDevice gpu = m_Device->GetGpuHandle();
+    const VkPhysicalDeviceLimits& limits = m_Device->GetGpuProperties().limits;
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, families.data());
+    const uint32_t validBits = families[m_Device->GetGraphicsQueue()->GetFamilyIndex()].timestampValidBits;
+    if (validBits == 0 || limits.timestampPeriod == 0.0f) {
+        SEWarn("GPU profiling disabled, the graphics queue has no timestamps");
+        return;
+    }
+    m_TimestampPeriod = limits.timestampPeriod;
+    m_TimestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+    m_PipelineStatistics = pipelineStatistics && m_Device->IsPipelineStatisticsSupported();
+    if (pipelineStatistics && !m_PipelineStatistics) {
+        SEWarn("Pipeline statistics queries not supported");
+    }
+    if (m_PipelineStatistics && !m_Device->IsInheritedQueriesSupported()) {
+        SEWarn("Inherited queries not supported, draws are recorded inline while collecting pipeline statistics");
+    }
+
+    VkDevice handle = m_Device->GetHandle();
+    m_Frames.resize(framesInFlight);
+    for (FrameQueries& queries : m_Frames) {
+        VkQueryPoolCreateInfo poolInfo {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = TimestampCapacity;
+        VK_CHECK_RESULT(vkCreateQueryPool(handle, &poolInfo, nullptr, &queries.timestamps));
+        queries.zones.reserve(MaxZonesPerFrame);
+        if (m_PipelineStatistics) {
+            poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            poolInfo.queryCount = 1;
+            poolInfo.pipelineStatistics = StatisticFlags;
+            VK_CHECK_RESULT(vkCreateQueryPool(handle, &poolInfo, nullptr, &queries.statistics));
+        }
+    }
+
+    VulkanCommandBuffer calibrationCmd = cmdPool.Allocate();
+    m_TracyContext = TracyVkContext(gpu, handle, m_Device->GetGraphicsQueue()->GetHandle(), calibrationCmd.GetHandle());
+    cmdPool.Free(calibrationCmd);
+#ifdef TRACY_ENABLE
+    // Zones never outnumber the timestamps of a frame, so no zone allocates while recording
+    static_assert(alignof(tracy::VkCtxScope) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+    m_TracyZones.resize(MaxZonesPerFrame * sizeof(tracy::VkCtxScope));
+#endif
+    SEInfo("-- GPU profiling: {:.2f} ns per tick, {} valid bit(s){}", m_TimestampPeriod, validBits, m_PipelineStatistics ? ", pipeline statistics" : "");
+}
+
+void VulkanGpuProfiler::Destroy()
+{
+    if (m_TracyContext) {
+        TracyVkDestroy(m_TracyContext);
+        m_TracyContext = nullptr;
+    }
+    VkDevice handle = m_Device ? m_Device->GetHandle() : VK_NULL_HANDLE;
+    for (FrameQueries& queries : m_Frames) {
+        vkDestroyQueryPool(handle, queries.timestamps, nullptr);
+        if (queries.statistics != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(handle, queries.statistics, nullptr);
+        }
+    }
+    m_Frames.clear();
+    m_TracyZones.clear();
+}
+
+void VulkanGpuProfiler::BeginFrame(VulkanCommandBuffer& cmd, uint32_t frameIndex)
+{
+    if (!IsEnabled()) {
+        return;
+    }
+    ZoneScoped;
+    FrameQueries& queries = m_Frames[frameIndex];
+    if (queries.queryCount > 0) {
+        ReadBack(queries);
+    }
+    // Tracy reads back its own queries the same way, outside of any render pass
+    TracyVkCollect(m_TracyContext, cmd.GetHandle());
+
+    vkCmdResetQueryPool(cmd.GetHandle(), queries.timestamps, 0, TimestampCapacity);
+    if (queries.statistics != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(cmd.GetHandle(), queries.statistics, 0, 1);
+    }
+    queries.frame = m_FrameCount++;
+    queries.queryCount = 0;
+    queries.zones.clear();
+    m_Current = &queries;
+    m_OpenZones.clear();
+
+    WriteTimestamp(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT);
+    if (queries.statistics != VK_NULL_HANDLE) {
+        vkCmdBeginQuery(cmd.GetHandle(), queries.statistics, 0, 0);
+    }
+}
+
+void VulkanGpuProfiler::EndFrame(VulkanCommandBuffer& cmd)
+{
+    if (!m_Current) {
+        return;
+    }
+    while (!m_OpenZones.empty()) {
+        SEWarn("GPU zone {} left open at the end of the frame", m_Current->zones[m_OpenZones.back()].name);
+        EndZone(cmd);
+    }
+    if (m_Current->statistics != VK_NULL_HANDLE) {
+        vkCmdEndQuery(cmd.GetHandle(), m_Current->statistics, 0);
+    }
+    WriteTimestamp(cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT);
+    m_Current = nullptr;
+}
+
+bool VulkanGpuProfiler::BeginZone(VulkanCommandBuffer& cmd, const char* name)
+{
+    if (!m_Current || m_Current->queryCount + 2 > TimestampCapacity - 1) {
+        return false;
+    }
+    Zone zone;
+    zone.name = name;
+    zone.depth = static_cast<uint32_t>(m_OpenZones.size());
+    zone.beginQuery = WriteTimestamp(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT);
+    zone.endQuery = UINT32_MAX;
+    const uint32_t depth = zone.depth;
+    m_OpenZones.push_back(static_cast<uint32_t>(m_Current->zones.size()));
+    m_Current->zones.push_back(std::move(zone));
+#ifdef TRACY_ENABLE
+    new (m_TracyZones.data() + depth * sizeof(tracy::VkCtxScope)) tracy::VkCtxScope(
+        m_TracyContext,
+        __LINE__, __FILE__, strlen(__FILE__),
+        name, strlen(name),
+        name, strlen(name),
+        cmd.GetHandle(), true
+    );
+#endif
+    return true;
+}
+
+void VulkanGpuProfiler::EndZone(VulkanCommandBuffer& cmd)
+{
+    if (!m_Current || m_OpenZones.empty()) {
+        return;
+    }
+#ifdef TRACY_ENABLE
+    const size_t offset = (m_OpenZones.size() - 1) * sizeof(tracy::VkCtxScope);
+    std::launder(reinterpret_cast<tracy::VkCtxScope*>(m_TracyZones.data() + offset))->~VkCtxScope();
+#endif
+    m_Current->zones[m_OpenZones.back()].endQuery = WriteTimestamp(cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT);
+    m_OpenZones.pop_back();
+}
+
+void VulkanGpuProfiler::ReadBack(FrameQueries& queries)
+{
+    // The fence of the slot has been waited on, nothing here blocks
+    std::vector<uint64_t> results(static_cast<size_t>(queries.queryCount) * 2);
+    VkResult result = vkGetQueryPoolResults(
+        m_Device->GetHandle(), queries.timestamps,
+        0, queries.queryCount,
+        results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+    );
+    if (result != VK_SUCCESS && result != VK_NOT_READY) {
+        VK_CHECK_RESULT(result);
+    }
+    const auto available = [&results](uint32_t query) { return results[query * 2 + 1] != 0; };
+    const auto elapsed = [this, &results](uint32_t begin, uint32_t end) {
+        const uint64_t ticks = ((results[end * 2] - results[begin * 2]) & m_TimestampMask);
+        return static_cast<double>(ticks) * m_TimestampPeriod / 1e6;
+    };
+
+    GpuFrameProfile profile;
+    profile.frame = queries.frame;
+    const uint32_t frameEnd = queries.queryCount - 1;
+    if (available(0) && available(frameEnd)) {
+        profile.milliseconds = elapsed(0, frameEnd);
+    }
+    profile.zones.reserve(queries.zones.size());
+    for (const Zone& zone : queries.zones) {
+        if (zone.endQuery == UINT32_MAX || !available(zone.beginQuery) || !available(zone.endQuery)) {
+            continue;
+        }
+        profile.zones.push_back({zone.name, zone.depth, elapsed(zone.beginQuery, zone.endQuery)});
+    }
+
+    if (queries.statistics != VK_NULL_HANDLE) {
+        uint64_t statistics[StatisticCount + 1] = {};
+        result = vkGetQueryPoolResults(
+            m_Device->GetHandle(), queries.statistics,
+            0, 1,
+            sizeof(statistics), statistics, sizeof(statistics),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+        );
+        if (result == VK_SUCCESS && statistics[StatisticCount] != 0) {
+            profile.hasStatistics = true;
+            profile.statistics.inputAssemblyVertices = statistics[0];
+            profile.statistics.inputAssemblyPrimitives = statistics[1];
+            profile.statistics.vertexShaderInvocations = statistics[2];
+            profile.statistics.clippingPrimitives = statistics[3];
+            profile.statistics.fragmentShaderInvocations = statistics[4];
+            profile.statistics.computeShaderInvocations = statistics[5];
+        }
+    }
+    m_LastProfile = std::move(profile);
+    TracyPlot("GPU frame (ms)", m_LastProfile.milliseconds);
+}
+
+VkQueryPipelineStatisticFlags VulkanGpuProfiler::GetActiveStatistics() const
+{
+    return m_Current && m_Current->statistics != VK_NULL_HANDLE ? StatisticFlags : 0;
+}
+
+bool VulkanGpuProfiler::CanExecuteSecondary() const
+{
+    return GetActiveStatistics() == 0 || m_Device->IsInheritedQueriesSupported();
+}
+
+uint32_t VulkanGpuProfiler::WriteTimestamp(VulkanCommandBuffer& cmd, VkPipelineStageFlags2 stage)
+{
+    const uint32_t query = m_Current->queryCount++;
+    vkCmdWriteTimestamp2(cmd.GetHandle(), stage, m_Current->timestamps, query);
+    return query;
+}
+
+}
@@ -0,0 +1,257 @@
+#include "serious/graphics/vulkan/VulkanImageTracker.hpp"
+#include "serious/io/log.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+namespace serious
+{
+
+static constexpr VkAccessFlags2 WriteAccessMask =
+    VK_ACCESS_2_TRANSFER_WRITE_BIT |
+    VK_ACCESS_2_SHADER_WRITE_BIT |
+    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+static inline bool operator==(const VulkanImageState& a, const VulkanImageState& b)
+{
+    return a.layout == b.layout && a.stages == b.stages && a.access == b.access;
+}
+
+void VulkanBarrierBatch::Flush(VulkanCommandBuffer& cmd)
+{
+    if (IsEmpty()) {
+        return;
+    }
+    cmd.PipelineBarriers2(m_BufferBarriers, m_ImageBarriers);
+    m_ImageBarriers.clear();
+    m_BufferBarriers.clear();
+}
+
+bool VulkanBarrierBatch::ContainsImage(VkImage image) const
+{
+    return std::any_of(m_ImageBarriers.begin(), m_ImageBarriers.end(), [image](const VkImageMemoryBarrier2& barrier) {
+        return barrier.image == image;
+    });
+}
+
+VulkanImageTracker::VulkanImageTracker()
+    : m_Images({})
+{
+}
+
+void VulkanImageTracker::Register(VkImage image, VkImageAspectFlags aspect, uint32_t mipLevels, uint32_t layerCount)
+{
+    std::lock_guard lock(m_Mutex);
+    TrackedImage& tracked = m_Images[image];
+    tracked.aspect = aspect;
+    tracked.mipLevels = mipLevels;
+    tracked.layerCount = layerCount;
+    tracked.subresources.assign(static_cast<size_t>(mipLevels) * layerCount, VulkanImageState {});
+}
+
+void VulkanImageTracker::Unregister(VkImage image)
+{
+    std::lock_guard lock(m_Mutex);
+    m_Images.erase(image);
+}
+
+void VulkanImageTracker::Discard(VkImage image)
+{
+    std::lock_guard lock(m_Mutex);
+    auto it = m_Images.find(image);
+    if (it == m_Images.end()) {
+        return;
+    }
+    // Pending accesses still have to complete before the memory is written again
+    for (VulkanImageState& state : it->second.subresources) {
+        state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+}
+
+void VulkanImageTracker::Transition(VulkanBarrierBatch& batch, VkImage image, VulkanImageUsage usage, const VkImageSubresourceRange* range)
+{
+    std::lock_guard lock(m_Mutex);
+    auto it = m_Images.find(image);
+    if (it == m_Images.end()) {
+        SEError("Transition of an untracked image");
+        return;
+    }
+    TrackedImage& tracked = it->second;
+    const uint32_t baseMip = range ? range->baseMipLevel : 0;
+    const uint32_t mipCount = range && range->levelCount != VK_REMAINING_MIP_LEVELS ? range->levelCount : tracked.mipLevels - baseMip;
+    const uint32_t baseLayer = range ? range->baseArrayLayer : 0;
+    const uint32_t layerCount = range && range->layerCount != VK_REMAINING_ARRAY_LAYERS ? range->layerCount : tracked.layerCount - baseLayer;
+    assert(baseMip + mipCount <= tracked.mipLevels && baseLayer + layerCount <= tracked.layerCount);
+
+    const VulkanImageState target = GetUsageState(usage);
+    const bool targetWrites = (target.access & WriteAccessMask) != 0;
+    // Barriers and the state each one transitions from, adjacent subresources in the same state are merged
+    std::vector<VkImageMemoryBarrier2> barriers;
+    std::vector<VulkanImageState> previous;
+    size_t lastMipBarrier = SIZE_MAX;
+    for (uint32_t mip = baseMip; mip < baseMip + mipCount; ++mip) {
+        const size_t mipBegin = barriers.size();
+        for (uint32_t layer = baseLayer; layer < baseLayer + layerCount; ++layer) {
+            VulkanImageState& state = tracked.subresources[mip * tracked.layerCount + layer];
+            const bool hazard = state.layout != target.layout || targetWrites || (state.access & WriteAccessMask);
+            if (!hazard) {
+                // Read after read only widens the scope the next barrier waits on
+                state.stages |= target.stages;
+                state.access |= target.access;
+                continue;
+            }
+            if (barriers.size() > mipBegin && previous.back() == state) {
+                VkImageSubresourceRange& last = barriers.back().subresourceRange;
+                if (last.baseArrayLayer + last.layerCount == layer) {
+                    last.layerCount++;
+                    state = target;
+                    continue;
+                }
+            }
+            VkImageMemoryBarrier2 barrier {};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrier.srcStageMask = state.stages;
+            barrier.srcAccessMask = state.access & WriteAccessMask;
+            barrier.dstStageMask = target.stages;
+            barrier.dstAccessMask = target.access;
+            barrier.oldLayout = state.layout;
+            barrier.newLayout = target.layout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = image;
+            barrier.subresourceRange = {tracked.aspect, mip, 1, layer, 1};
+            barriers.push_back(barrier);
+            previous.push_back(state);
+            state = target;
+        }
+        if (barriers.size() != mipBegin + 1) {
+            lastMipBarrier = SIZE_MAX;
+            continue;
+        }
+        // A single barrier for this mip extends the single barrier of the previous one when they match
+        if (lastMipBarrier != SIZE_MAX && previous[lastMipBarrier] == previous.back()) {
+            VkImageSubresourceRange& below = barriers[lastMipBarrier].subresourceRange;
+            const VkImageSubresourceRange& current = barriers.back().subresourceRange;
+            if (below.baseMipLevel + below.levelCount == mip
+                && below.baseArrayLayer == current.baseArrayLayer
+                && below.layerCount == current.layerCount) {
+                below.levelCount++;
+                barriers.pop_back();
+                previous.pop_back();
+                continue;
+            }
+        }
+        lastMipBarrier = barriers.size() - 1;
+    }
+    for (const VkImageMemoryBarrier2& barrier : barriers) {
+        batch.AddImage(barrier);
+    }
+}
+
+VkImageMemoryBarrier2 VulkanImageTracker::Release(VulkanBarrierBatch& batch, VkImage image, VulkanImageUsage usage, uint32_t srcFamilyIndex, uint32_t dstFamilyIndex)
+{
+    std::lock_guard lock(m_Mutex);
+    TrackedImage& tracked = m_Images.at(image);
+    const VulkanImageState target = GetUsageState(usage);
+    // The whole image is expected to be in one state, as after an upload
+    VulkanImageState& first = tracked.subresources.front();
+
+    VkImageMemoryBarrier2 release {};
+    release.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    release.srcStageMask = first.stages;
+    release.srcAccessMask = first.access & WriteAccessMask;
+    release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+    release.dstAccessMask = VK_ACCESS_2_NONE;
+    release.oldLayout = first.layout;
+    release.newLayout = target.layout;
+    release.srcQueueFamilyIndex = srcFamilyIndex;
+    release.dstQueueFamilyIndex = dstFamilyIndex;
+    release.image = image;
+    release.subresourceRange = {tracked.aspect, 0, tracked.mipLevels, 0, tracked.layerCount};
+    batch.AddImage(release);
+
+    VkImageMemoryBarrier2 acquire = release;
+    acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+    acquire.srcAccessMask = VK_ACCESS_2_NONE;
+    acquire.dstStageMask = target.stages;
+    acquire.dstAccessMask = target.access;
+    for (VulkanImageState& state : tracked.subresources) {
+        state = target;
+    }
+    return acquire;
+}
+
+VkImageLayout VulkanImageTracker::GetLayout(VkImage image, uint32_t mipLevel, uint32_t layer) const
+{
+    std::lock_guard lock(m_Mutex);
+    auto it = m_Images.find(image);
+    if (it == m_Images.end()) {
+        return VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+    return it->second.subresources[mipLevel * it->second.layerCount + layer].layout;
+}
+
+uint32_t VulkanImageTracker::GetMipLevels(VkImage image) const
+{
+    std::lock_guard lock(m_Mutex);
+    auto it = m_Images.find(image);
+    return it == m_Images.end() ? 0 : it->second.mipLevels;
+}
+
+VulkanImageState VulkanImageTracker::GetUsageState(VulkanImageUsage usage)
+{
+    switch (usage) {
+        case VulkanImageUsage::Undefined:
+            return {};
+        case VulkanImageUsage::TransferSrc:
+            return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT};
+        case VulkanImageUsage::TransferDst:
+            return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT};
+        case VulkanImageUsage::Sampled:
+            return {
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+            };
+        case VulkanImageUsage::ColorAttachment:
+            return {
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT
+            };
+        case VulkanImageUsage::DepthAttachment:
+            return {
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+            };
+        case VulkanImageUsage::Present:
+            // Visibility to the presentation engine comes from the semaphore
+            return {VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE};
+    }
+    return {};
+}
+
+VkImageAspectFlags VulkanImageTracker::GetAspect(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        case VK_FORMAT_S8_UINT:
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+}
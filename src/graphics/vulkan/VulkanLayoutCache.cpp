@@ -0,0 +1,213 @@
+#include "serious/graphics/vulkan/VulkanLayoutCache.hpp"
+#include "serious/graphics/vulkan/VulkanUtils.hpp"
+
+#include <algorithm>
+#include <functional>
+
+namespace serious
+{
+
+static inline void HashCombine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+// ------------------------
+// DescriptorSetLayoutCache
+// ------------------------
+DescriptorSetLayoutCache::DescriptorSetLayoutCache()
+    : m_Device(VK_NULL_HANDLE)
+    , m_Layouts({})
+    , m_Stats({})
+{
+}
+
+void DescriptorSetLayoutCache::Init(VkDevice device)
+{
+    m_Device = device;
+}
+
+void DescriptorSetLayoutCache::Destroy()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (auto& [key, layout] : m_Layouts) {
+        vkDestroyDescriptorSetLayout(m_Device, layout, nullptr);
+    }
+    m_Layouts.clear();
+}
+
+VkDescriptorSetLayout DescriptorSetLayoutCache::Get(
+    const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+    VkDescriptorSetLayoutCreateFlags flags,
+    const std::vector<VkDescriptorBindingFlags>& bindingFlags)
+{
+    Key key;
+    key.flags = flags;
+    key.bindings.reserve(bindings.size());
+    for (size_t i = 0; i < bindings.size(); ++i) {
+        key.bindings.push_back({bindings[i], bindingFlags.empty() ? 0 : bindingFlags[i]});
+    }
+    std::sort(key.bindings.begin(), key.bindings.end(), [](const Binding& a, const Binding& b) {
+        return a.binding.binding < b.binding.binding;
+    });
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Layouts.find(key);
+    if (it != m_Layouts.end()) {
+        m_Stats.hitCount++;
+        return it->second;
+    }
+    m_Stats.missCount++;
+
+    std::vector<VkDescriptorSetLayoutBinding> sortedBindings;
+    std::vector<VkDescriptorBindingFlags> sortedFlags;
+    for (const Binding& binding : key.bindings) {
+        sortedBindings.push_back(binding.binding);
+        sortedFlags.push_back(binding.flags);
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo {};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = static_cast<uint32_t>(sortedFlags.size());
+    bindingFlagsInfo.pBindingFlags = sortedFlags.data();
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo {};
+    descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutInfo.pNext = bindingFlags.empty() ? nullptr : &bindingFlagsInfo;
+    descriptorSetLayoutInfo.flags = flags;
+    descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(sortedBindings.size());
+    descriptorSetLayoutInfo.pBindings = sortedBindings.data();
+
+    VkDescriptorSetLayout layout;
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_Device, &descriptorSetLayoutInfo, nullptr, &layout));
+    m_Layouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+VulkanLayoutCacheStats DescriptorSetLayoutCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Stats;
+}
+
+bool DescriptorSetLayoutCache::Key::operator==(const Key& other) const
+{
+    if (flags != other.flags || bindings.size() != other.bindings.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < bindings.size(); ++i) {
+        const VkDescriptorSetLayoutBinding& a = bindings[i].binding;
+        const VkDescriptorSetLayoutBinding& b = other.bindings[i].binding;
+        if (a.binding != b.binding
+            || a.descriptorType != b.descriptorType
+            || a.descriptorCount != b.descriptorCount
+            || a.stageFlags != b.stageFlags
+            || a.pImmutableSamplers != b.pImmutableSamplers
+            || bindings[i].flags != other.bindings[i].flags) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t DescriptorSetLayoutCache::KeyHash::operator()(const Key& key) const
+{
+    size_t seed = std::hash<uint32_t>()(key.flags);
+    for (const Binding& binding : key.bindings) {
+        HashCombine(seed, binding.binding.binding);
+        HashCombine(seed, static_cast<size_t>(binding.binding.descriptorType));
+        HashCombine(seed, binding.binding.descriptorCount);
+        HashCombine(seed, binding.binding.stageFlags);
+        HashCombine(seed, std::hash<const void*>()(binding.binding.pImmutableSamplers));
+        HashCombine(seed, binding.flags);
+    }
+    return seed;
+}
+
+// -------------------
+// PipelineLayoutCache
+// -------------------
+PipelineLayoutCache::PipelineLayoutCache()
+    : m_Device(VK_NULL_HANDLE)
+    , m_Layouts({})
+    , m_Stats({})
+{
+}
+
+void PipelineLayoutCache::Init(VkDevice device)
+{
+    m_Device = device;
+}
+
+void PipelineLayoutCache::Destroy()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (auto& [key, layout] : m_Layouts) {
+        vkDestroyPipelineLayout(m_Device, layout, nullptr);
+    }
+    m_Layouts.clear();
+}
+
+VkPipelineLayout PipelineLayoutCache::Get(
+    const std::vector<VkDescriptorSetLayout>& setLayouts,
+    const std::vector<VkPushConstantRange>& pushConstantRanges)
+{
+    Key key {setLayouts, pushConstantRanges};
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Layouts.find(key);
+    if (it != m_Layouts.end()) {
+        m_Stats.hitCount++;
+        return it->second;
+    }
+    m_Stats.missCount++;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+    pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+    VkPipelineLayout layout;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &layout));
+    m_Layouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+VulkanLayoutCacheStats PipelineLayoutCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Stats;
+}
+
+bool PipelineLayoutCache::Key::operator==(const Key& other) const
+{
+    if (setLayouts != other.setLayouts || pushConstantRanges.size() != other.pushConstantRanges.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < pushConstantRanges.size(); ++i) {
+        const VkPushConstantRange& a = pushConstantRanges[i];
+        const VkPushConstantRange& b = other.pushConstantRanges[i];
+        if (a.stageFlags != b.stageFlags || a.offset != b.offset || a.size != b.size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t PipelineLayoutCache::KeyHash::operator()(const Key& key) const
+{
+    size_t seed = 0;
+    for (VkDescriptorSetLayout setLayout : key.setLayouts) {
+        HashCombine(seed, std::hash<const void*>()(setLayout));
+    }
+    for (const VkPushConstantRange& range : key.pushConstantRanges) {
+        HashCombine(seed, range.stageFlags);
+        HashCombine(seed, range.offset);
+        HashCombine(seed, range.size);
+    }
+    return seed;
+}
+
+}
@@ -2,6 +2,8 @@
 #include "serious/graphics/Objects.hpp"
 #include "serious/graphics/vulkan/Vertex.hpp"
 
+#include <Tracy.hpp>
+
 #include <array>
 
 namespace serious
@@ -12,43 +14,65 @@ VulkanPipeline::VulkanPipeline(
     const std::vector<VulkanShaderModule>& shaders,
     ColorBlendingMode blendingMode,
     VkRenderPass renderPass,
-    VulkanSwapchain& swapchain)
+    const VulkanRenderingFormats& renderingFormats)
     : m_Pipeline(VK_NULL_HANDLE)
     , m_Device(device)
     , m_PipelineLayout(VK_NULL_HANDLE)
+    , m_Shaders(shaders)
+    , m_BlendingMode(blendingMode)
+    , m_RenderPass(renderPass)
+    , m_RenderingFormats(renderingFormats)
+    , m_Ready(false)
 {
+    // Shared with every pipeline using the same set layouts, set 1 is the bindless texture table
+    std::vector<VkDescriptorSetLayout> setLayouts = {m_Device->GetDescriptorSetLayout()};
+    if (m_Device->GetBindlessTable().IsEnabled()) {
+        setLayouts.push_back(m_Device->GetBindlessTable().GetSetLayout());
+    }
+    VkPushConstantRange pushConstantRange {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawConstants);
+    m_PipelineLayout = m_Device->GetPipelineLayoutCache().Get(setLayouts, {pushConstantRange});
+}
+
+VulkanPipeline::~VulkanPipeline()
+{
+}
+
+void VulkanPipeline::Create()
+{
+    CreateBatch(m_Device, {this});
+}
+
+void VulkanPipeline::CreateBatch(VulkanDevice* device, const std::vector<VulkanPipeline*>& pipelines)
+{
+    ZoneScoped;
+    if (pipelines.empty()) {
+        return;
+    }
+
+    // Fixed function state shared by every pipeline of the batch
     auto vtxBindingDescriptions = Vertex::GetBindingDescription();
     auto vtxAttributeDescriptions = Vertex::GetAttributeDescriptions();
 
     VkPipelineVertexInputStateCreateInfo vtxInputState {};
     vtxInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vtxInputState.vertexBindingDescriptionCount = 1;
-    vtxInputState.pVertexBindingDescriptions = &vtxBindingDescriptions;
+    vtxInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vtxBindingDescriptions.size());
+    vtxInputState.pVertexBindingDescriptions = vtxBindingDescriptions.data();
     vtxInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vtxAttributeDescriptions.size());
-    vtxInputState.pVertexAttributeDescriptions = vtxAttributeDescriptions.data(); 
+    vtxInputState.pVertexAttributeDescriptions = vtxAttributeDescriptions.data();
 
     VkPipelineInputAssemblyStateCreateInfo inputAsmState {};
     inputAsmState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     inputAsmState.primitiveRestartEnable = VK_FALSE;
     inputAsmState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 
-    VkExtent2D extent = swapchain.GetExtent();
-    VkViewport viewport {};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = extent.width;
-    viewport.height = extent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    VkRect2D scissor;
-    scissor.offset = {0, 0};
-    scissor.extent = extent;
+    // Viewport and scissor are dynamic, only their count matters here
     VkPipelineViewportStateCreateInfo viewportState {};
     viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
     viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
 
     VkPipelineRasterizationStateCreateInfo rastState {};
     rastState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -64,45 +88,6 @@ VulkanPipeline::VulkanPipeline(
     multiSampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
     multiSampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-    VkPipelineColorBlendAttachmentState colorBlendAttachment {};
-    colorBlendAttachment.blendEnable = blendingMode == ColorBlendingMode::None ? VK_FALSE : VK_TRUE;
-    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    switch (blendingMode) {
-        case ColorBlendingMode::Additive:
-            colorBlendAttachment.blendEnable = VK_TRUE;
-            colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-            colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
-            colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-            break;
-        case ColorBlendingMode::AlphaBlending:
-            colorBlendAttachment.blendEnable = VK_TRUE;
-            colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-            colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-            colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-            break;
-        default:
-            break;
-    }
-    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-    
-    VkPipelineColorBlendStateCreateInfo colorBlendState = {};
-    colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlendState.attachmentCount = 1;
-    colorBlendState.pAttachments = &colorBlendAttachment;
-    colorBlendState.logicOpEnable = VK_FALSE;
-
-    std::vector<VkPipelineShaderStageCreateInfo> shaderStageInfos(shaders.size());
-    for (size_t i = 0; i <  shaderStageInfos.size(); ++i) {
-        const VulkanShaderModule& shaderModule = shaders[i];
-        VkPipelineShaderStageCreateInfo& shaderStageInfo = shaderStageInfos[i];
-        shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shaderStageInfo.module = shaderModule.handle;
-        shaderStageInfo.stage = shaderModule.stage;
-        shaderStageInfo.pName = shaderModule.entry.data();
-    }
-
     VkPipelineDepthStencilStateCreateInfo depthStencilState {};
     depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencilState.depthTestEnable = VK_TRUE;
@@ -110,15 +95,7 @@ VulkanPipeline::VulkanPipeline(
     depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
     depthStencilState.depthBoundsTestEnable = VK_FALSE;
 
-    VkDescriptorSetLayout descriptorsetLayout = m_Device->GetDescriptorSetLayout();
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorsetLayout;
-    VK_CHECK_RESULT(vkCreatePipelineLayout(m_Device->GetHandle(), &pipelineLayoutInfo, nullptr, &m_PipelineLayout));
-
-    std::vector<VkDynamicState> dynamicStates = {
+    std::array<VkDynamicState, 2> dynamicStates = {
         VK_DYNAMIC_STATE_VIEWPORT,
         VK_DYNAMIC_STATE_SCISSOR,
     };
@@ -128,33 +105,170 @@ VulkanPipeline::VulkanPipeline(
     dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
     dynamicState.pDynamicStates = dynamicStates.data();
 
-    VkGraphicsPipelineCreateInfo pipelineInfo {};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.pVertexInputState = &vtxInputState;
-    pipelineInfo.pInputAssemblyState = &inputAsmState;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rastState;
-    pipelineInfo.pMultisampleState = &multiSampleState;
-    pipelineInfo.pColorBlendState = &colorBlendState;
-    pipelineInfo.stageCount = shaderStageInfos.size();
-    pipelineInfo.pStages = shaderStageInfos.data();
-    pipelineInfo.pDepthStencilState = &depthStencilState;
-    pipelineInfo.layout = m_PipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.pDynamicState = &dynamicState;
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_Device->GetHandle(), nullptr, 1, &pipelineInfo, nullptr, &m_Pipeline));
+    // Per pipeline state, sized up front so the create infos can point into it
+    struct PipelineState
+    {
+        std::vector<VkPipelineShaderStageCreateInfo> shaderStageInfos;
+        VkPipelineColorBlendAttachmentState colorBlendAttachment;
+        VkPipelineColorBlendStateCreateInfo colorBlendState;
+        VkPipelineCreationFeedback pipelineFeedback;
+        std::vector<VkPipelineCreationFeedback> stageFeedbacks;
+        VkPipelineCreationFeedbackCreateInfo feedbackInfo;
+        VkPipelineRenderingCreateInfo renderingInfo;
+    };
+    std::vector<PipelineState> states(pipelines.size());
+    std::vector<VkGraphicsPipelineCreateInfo> pipelineInfos(pipelines.size());
+    std::vector<VkPipeline> handles(pipelines.size(), VK_NULL_HANDLE);
+
+    for (size_t p = 0; p < pipelines.size(); ++p) {
+        const VulkanPipeline& pipeline = *pipelines[p];
+        PipelineState& state = states[p];
+
+        VkPipelineColorBlendAttachmentState& colorBlendAttachment = state.colorBlendAttachment;
+        colorBlendAttachment = {};
+        colorBlendAttachment.blendEnable = pipeline.m_BlendingMode == ColorBlendingMode::None ? VK_FALSE : VK_TRUE;
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        switch (pipeline.m_BlendingMode) {
+            case ColorBlendingMode::Additive:
+                colorBlendAttachment.blendEnable = VK_TRUE;
+                colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+                colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+                colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+                break;
+            case ColorBlendingMode::AlphaBlending:
+                colorBlendAttachment.blendEnable = VK_TRUE;
+                colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+                colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+                colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+                break;
+            default:
+                break;
+        }
+        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+        state.colorBlendState = {};
+        state.colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        state.colorBlendState.attachmentCount = 1;
+        state.colorBlendState.pAttachments = &state.colorBlendAttachment;
+        state.colorBlendState.logicOpEnable = VK_FALSE;
+
+        state.shaderStageInfos.resize(pipeline.m_Shaders.size(), {});
+        for (size_t i = 0; i < state.shaderStageInfos.size(); ++i) {
+            const VulkanShaderModule& shaderModule = pipeline.m_Shaders[i];
+            VkPipelineShaderStageCreateInfo& shaderStageInfo = state.shaderStageInfos[i];
+            shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            shaderStageInfo.module = shaderModule.handle;
+            shaderStageInfo.stage = shaderModule.stage;
+            shaderStageInfo.pName = shaderModule.entry.data();
+        }
+
+        // Creation feedback tells whether the pipeline was served from the cache
+        state.pipelineFeedback = {};
+        state.stageFeedbacks.resize(state.shaderStageInfos.size(), {});
+        state.feedbackInfo = {};
+        state.feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+        state.feedbackInfo.pPipelineCreationFeedback = &state.pipelineFeedback;
+        state.feedbackInfo.pipelineStageCreationFeedbackCount = static_cast<uint32_t>(state.stageFeedbacks.size());
+        state.feedbackInfo.pPipelineStageCreationFeedbacks = state.stageFeedbacks.data();
+
+        // Without a render pass the attachment formats are given directly
+        state.renderingInfo = {};
+        state.renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        state.renderingInfo.pNext = &state.feedbackInfo;
+        state.renderingInfo.colorAttachmentCount = 1;
+        state.renderingInfo.pColorAttachmentFormats = &pipeline.m_RenderingFormats.colorFormat;
+        state.renderingInfo.depthAttachmentFormat = pipeline.m_RenderingFormats.depthFormat;
+
+        VkGraphicsPipelineCreateInfo& pipelineInfo = pipelineInfos[p];
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = pipeline.m_RenderPass != VK_NULL_HANDLE ? static_cast<const void*>(&state.feedbackInfo) : &state.renderingInfo;
+        pipelineInfo.pVertexInputState = &vtxInputState;
+        pipelineInfo.pInputAssemblyState = &inputAsmState;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rastState;
+        pipelineInfo.pMultisampleState = &multiSampleState;
+        pipelineInfo.pColorBlendState = &state.colorBlendState;
+        pipelineInfo.stageCount = static_cast<uint32_t>(state.shaderStageInfos.size());
+        pipelineInfo.pStages = state.shaderStageInfos.data();
+        pipelineInfo.pDepthStencilState = &depthStencilState;
+        pipelineInfo.layout = pipeline.m_PipelineLayout;
+        pipelineInfo.renderPass = pipeline.m_RenderPass;
+        pipelineInfo.pDynamicState = &dynamicState;
+    }
+
+    VulkanPipelineCache& pipelineCache = device->GetPipelineCache();
+    VK_CHECK_RESULT(vkCreateGraphicsPipelines(
+        device->GetHandle(),
+        pipelineCache.GetHandle(),
+        static_cast<uint32_t>(pipelineInfos.size()),
+        pipelineInfos.data(),
+        nullptr,
+        handles.data()
+    ));
+
+    for (size_t p = 0; p < pipelines.size(); ++p) {
+        pipelineCache.RecordFeedback(states[p].pipelineFeedback);
+        pipelines[p]->m_Pipeline = handles[p];
+        pipelines[p]->m_Ready.store(true, std::memory_order_release);
+    }
 }
 
-VulkanPipeline::~VulkanPipeline()
+void VulkanPipeline::Destroy()
 {
+    // Frames in flight may still bind it
+    m_Device->GetDeletionQueue().Push([device = m_Device->GetHandle(), pipeline = m_Pipeline] {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    });
+    m_Pipeline = VK_NULL_HANDLE;
+    m_Ready.store(false, std::memory_order_release);
 }
 
-void VulkanPipeline::Destroy()
+VulkanComputePipeline::VulkanComputePipeline(
+    VulkanDevice* device,
+    const VulkanShaderModule& shader,
+    const std::vector<VkDescriptorSetLayout>& setLayouts,
+    const std::vector<VkPushConstantRange>& pushConstantRanges)
+    : m_Pipeline(VK_NULL_HANDLE)
+    , m_Device(device)
+    , m_PipelineLayout(VK_NULL_HANDLE)
+    , m_Shader(shader)
+{
+    m_PipelineLayout = m_Device->GetPipelineLayoutCache().Get(setLayouts, pushConstantRanges);
+}
+
+void VulkanComputePipeline::Create()
+{
+    ZoneScoped;
+    VkPipelineShaderStageCreateInfo shaderStageInfo {};
+    shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageInfo.module = m_Shader.handle;
+    shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStageInfo.pName = m_Shader.entry.data();
+
+    VkPipelineCreationFeedback pipelineFeedback {};
+    VkPipelineCreationFeedbackCreateInfo feedbackInfo {};
+    feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+    feedbackInfo.pPipelineCreationFeedback = &pipelineFeedback;
+
+    VkComputePipelineCreateInfo pipelineInfo {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &feedbackInfo;
+    pipelineInfo.stage = shaderStageInfo;
+    pipelineInfo.layout = m_PipelineLayout;
+
+    VulkanPipelineCache& pipelineCache = m_Device->GetPipelineCache();
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_Device->GetHandle(), pipelineCache.GetHandle(), 1, &pipelineInfo, nullptr, &m_Pipeline));
+    pipelineCache.RecordFeedback(pipelineFeedback);
+}
+
+void VulkanComputePipeline::Destroy()
 {
-    m_Device->WaitIdle();
-    VkDevice deviceHandle = m_Device->GetHandle();
-    vkDestroyPipelineLayout(deviceHandle, m_PipelineLayout, nullptr);
-    vkDestroyPipeline(deviceHandle, m_Pipeline, nullptr);
+    m_Device->GetDeletionQueue().Push([device = m_Device->GetHandle(), pipeline = m_Pipeline] {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    });
+    m_Pipeline = VK_NULL_HANDLE;
 }
-    
+
 }
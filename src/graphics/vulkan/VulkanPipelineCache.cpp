@@ -0,0 +1,170 @@
+#include "serious/graphics/vulkan/VulkanPipelineCache.hpp"
+#include "serious/graphics/vulkan/VulkanUtils.hpp"
+#include "serious/io/file.hpp"
+
+#include <Tracy.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace serious
+{
+
+VulkanPipelineCache::VulkanPipelineCache()
+    : m_Device(VK_NULL_HANDLE)
+    , m_GpuProps({})
+    , m_Cache(VK_NULL_HANDLE)
+    , m_Stats({})
+    , m_HistoryMissNanoseconds(0)
+    , m_HistoryMissCount(0)
+{
+}
+
+void VulkanPipelineCache::Init(VkDevice device, const VkPhysicalDeviceProperties& gpuProps)
+{
+    m_Device = device;
+    m_GpuProps = gpuProps;
+}
+
+void VulkanPipelineCache::Destroy()
+{
+    if (m_Cache != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(m_Device, m_Cache, nullptr);
+        m_Cache = VK_NULL_HANDLE;
+    }
+}
+
+void VulkanPipelineCache::Load(const std::string& path)
+{
+    ZoneScoped;
+    Destroy();
+
+    std::string content;
+    if (std::filesystem::exists(path)) {
+        content = ReadFile(path);
+    }
+
+    const char* initialData = nullptr;
+    size_t initialSize = 0;
+    if (content.size() >= sizeof(FileHeader)) {
+        FileHeader header;
+        memcpy(&header, content.data(), sizeof(FileHeader));
+        const char* data = content.data() + sizeof(FileHeader);
+        const size_t size = content.size() - sizeof(FileHeader);
+        if (header.magic == FileMagic && header.version == FileVersion && header.dataSize == size && Validate(data, size)) {
+            initialData = data;
+            initialSize = size;
+            m_HistoryMissNanoseconds = header.missNanoseconds;
+            m_HistoryMissCount = header.missCount;
+        } else {
+            SEWarn("Pipeline cache {} is stale or corrupted, starting cold", path);
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = initialSize;
+    cacheInfo.pInitialData = initialData;
+    VK_CHECK_RESULT(vkCreatePipelineCache(m_Device, &cacheInfo, nullptr, &m_Cache));
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stats.loadedBytes = initialSize;
+    SEInfo("-- Pipeline cache: {} ({} byte(s))", initialSize > 0 ? "warm" : "cold", initialSize);
+}
+
+void VulkanPipelineCache::Save(const std::string& path) const
+{
+    ZoneScoped;
+    if (m_Cache == VK_NULL_HANDLE) {
+        return;
+    }
+    size_t size = 0;
+    VK_CHECK_RESULT(vkGetPipelineCacheData(m_Device, m_Cache, &size, nullptr));
+    std::vector<char> data(size);
+    VK_CHECK_RESULT(vkGetPipelineCacheData(m_Device, m_Cache, &size, data.data()));
+
+    FileHeader header {};
+    header.magic = FileMagic;
+    header.version = FileVersion;
+    header.dataSize = size;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        header.missNanoseconds = m_HistoryMissNanoseconds + m_Stats.missNanoseconds;
+        header.missCount = m_HistoryMissCount + (m_Stats.pipelineCount - m_Stats.hitCount);
+    }
+
+    // Write next to the target and rename, so an interrupted save never leaves a truncated cache
+    const std::string tmpPath = path + ".tmp";
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        SEWarn("failed to open file: {}", tmpPath);
+        return;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+    file.write(data.data(), static_cast<std::streamsize>(size));
+    file.close();
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        SEWarn("Failed to save pipeline cache {}: {}", path, ec.message());
+    }
+}
+
+void VulkanPipelineCache::RecordFeedback(const VkPipelineCreationFeedback& feedback)
+{
+    if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stats.pipelineCount++;
+    if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) {
+        m_Stats.hitCount++;
+        m_Stats.hitNanoseconds += feedback.duration;
+    } else {
+        m_Stats.missNanoseconds += feedback.duration;
+    }
+}
+
+VulkanPipelineCacheStats VulkanPipelineCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    VulkanPipelineCacheStats stats = m_Stats;
+    const uint64_t missCount = m_HistoryMissCount + (stats.pipelineCount - stats.hitCount);
+    if (missCount > 0 && stats.hitCount > 0) {
+        const double averageMiss = static_cast<double>(m_HistoryMissNanoseconds + stats.missNanoseconds) / static_cast<double>(missCount);
+        const double saved = averageMiss * stats.hitCount - static_cast<double>(stats.hitNanoseconds);
+        stats.savedMilliseconds = saved > 0.0 ? saved / 1e6 : 0.0;
+    }
+    return stats;
+}
+
+void VulkanPipelineCache::LogStats() const
+{
+    VulkanPipelineCacheStats stats = GetStats();
+    SEInfo(
+        "-- Pipeline cache: {}/{} hit(s) | {:.2f} ms compiling | ~{:.2f} ms saved",
+        stats.hitCount,
+        stats.pipelineCount,
+        static_cast<double>(stats.hitNanoseconds + stats.missNanoseconds) / 1e6,
+        stats.savedMilliseconds
+    );
+}
+
+bool VulkanPipelineCache::Validate(const char* data, size_t size) const
+{
+    if (size < sizeof(VkPipelineCacheHeaderVersionOne)) {
+        return false;
+    }
+    VkPipelineCacheHeaderVersionOne header;
+    memcpy(&header, data, sizeof(VkPipelineCacheHeaderVersionOne));
+    return header.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne)
+        && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == m_GpuProps.vendorID
+        && header.deviceID == m_GpuProps.deviceID
+        && memcmp(header.pipelineCacheUUID, m_GpuProps.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+}
@@ -2,14 +2,22 @@
 #include "glm/ext/matrix_transform.hpp"
 #include "serious/graphics/Objects.hpp"
 #include "serious/graphics/vulkan/VulkanDevice.hpp"
+#include "serious/graphics/vulkan/Vertex.hpp"
 
+#include <algorithm>
 #include <string>
 #include <array>
+#include <chrono>
+#include <cstring>
+#include <latch>
+#include <map>
+#include <unordered_map>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <Tracy.hpp>
+#include <SDL3/SDL_vulkan.h>
 
 namespace serious
 {
@@ -55,8 +63,71 @@ static inline void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUti
 // ----------
 // Vulkan RHI
 // ----------
+// Below this many draws per partition recording on the workers costs more than it saves
+static constexpr size_t MinDrawsPerPartition = 512;
+// Must match local_size_x of the culling shader
+static constexpr uint32_t CullGroupSize = 64;
+
+// Push constants of the culling shader
+struct CullConstants
+{
+    glm::vec4 planes[6];
+    uint32_t objectCount;
+};
+
+// Larger static updates get a staging buffer of their own, the frame allocator also holds the uniforms
+static constexpr VkDeviceSize MaxFrameStagingSize = 64 * 1024;
+
+static VkBufferUsageFlags GetBufferUsageFlags(BufferUsage usage)
+{
+    switch (usage) {
+        case BufferUsage::Vertex:   return VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        case BufferUsage::Index:    return VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+        case BufferUsage::Uniform:  return VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        case BufferUsage::Instance: return VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        case BufferUsage::Storage:  return VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    }
+    return 0;
+}
+
+// Stages and accesses of the frame reading a buffer, guarded by the barriers around its updates
+static void GetBufferConsumer(BufferUsage usage, VkPipelineStageFlags2* stages, VkAccessFlags2* access)
+{
+    switch (usage) {
+        case BufferUsage::Vertex:
+        case BufferUsage::Instance:
+            *stages = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT;
+            *access = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT;
+            break;
+        case BufferUsage::Index:
+            *stages = VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT;
+            *access = VK_ACCESS_2_INDEX_READ_BIT;
+            break;
+        case BufferUsage::Uniform:
+            *stages = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+            *access = VK_ACCESS_2_UNIFORM_READ_BIT;
+            break;
+        case BufferUsage::Storage:
+            *stages = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+            *access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+            break;
+    }
+}
+
+// Offset alignment of a buffer bound from inside a larger one
+static VkDeviceSize GetBindAlignment(const VkPhysicalDeviceLimits& limits, BufferUsage usage)
+{
+    if (usage == BufferUsage::Storage) {
+        return std::max(limits.minStorageBufferOffsetAlignment, limits.minUniformBufferOffsetAlignment);
+    }
+    // Index buffers need 4 bytes, below any uniform alignment
+    return std::max<VkDeviceSize>(limits.minUniformBufferOffsetAlignment, 4);
+}
+
 VulkanRHI::VulkanRHI(const Settings& settings)
     : m_Settings(settings)
+    , m_ThreadPool(settings.workerThreads)
+    , m_DecodeThreadPool(std::max(settings.decodeThreads, 1u))
     , m_Instance(VK_NULL_HANDLE)
     , m_DebugUtilsMessenger(VK_NULL_HANDLE)
     , m_Device(nullptr)
@@ -64,23 +135,36 @@ VulkanRHI::VulkanRHI(const Settings& settings)
     , m_Swapchain({})
     , m_SwapchainImageCount(0)
     , m_SwapchainImageIndex(0)
+    , m_FramesInFlight(std::max(settings.framesInFlight, 1u))
     , m_GfxCmdPool({})
-    , m_TsfCmdPool({})
     , m_GfxCmdBufs({})
+    , m_SecondaryCmds({})
     , m_CurrentFrame(0)
+    , m_FrameWritesBegun(false)
     , m_Fences({})
     , m_ImageAvailableSems({})
     , m_RenderFinishedSems({})
-    , m_DepthImage({})
+    , m_GpuProfiler()
+    , m_DynamicRendering(false)
     , m_RenderPass(VK_NULL_HANDLE)
-    , m_Framebuffers({})
-    , m_ShaderModules({})
-    , m_DescriptorSets({})
-    , m_TextureImage({})
+    , m_RenderGraph()
+    , m_BackbufferResource(0)
+    , m_ShaderModules()
+    , m_Pipelines()
+    , m_CullPipelines()
+    , m_RetiredPipelines({})
+    , m_RetiredShaderModules({})
+    , m_FrameDescriptorAllocators({})
+    , m_CullSetLayout(VK_NULL_HANDLE)
+    , m_TextureStreamer()
+    , m_Texture()
     , m_ClearValues{ {}, {} }
-    , m_UniformBuffers({})
-    , m_UniformBufferMapped({})
+    , m_FrameAllocator({})
+    , m_DrawUniformOffsets({})
+    , m_RenderQueue()
+    , m_DrawStats({})
     , m_BoundPipline(nullptr)
+    , m_PendingPipelines({})
     , m_Viewport({})
     , m_Scissor({})
 {
@@ -90,14 +174,20 @@ VulkanRHI::VulkanRHI(const Settings& settings)
 void VulkanRHI::Init(void* window)
 {
     CreateInstance();
-    m_Device = CreateRef<VulkanDevice>(m_Instance);
+    m_Device = CreateRef<VulkanDevice>(m_Instance, !m_Settings.headless);
+    m_Device->GetPipelineCache().Load(std::string(m_Settings.pipelineCachePath));
 
     // Create swapchain
     m_Swapchain.SetContext(m_Instance, m_Device.get());
-    m_Swapchain.InitSurface(window);
     m_PlatformWindow = window;
-    m_Swapchain.Create(&m_Settings.height, &m_Settings.height, m_Settings.vsync);
+    if (m_Settings.headless) {
+        m_Swapchain.CreateOffscreen(m_Settings.width, m_Settings.height);
+    } else {
+        m_Swapchain.InitSurface(window);
+        m_Swapchain.Create(&m_Settings.width, &m_Settings.height, m_Settings.vsync);
+    }
     m_SwapchainImageCount = m_Swapchain.GetImageCount();
+    SEInfo("-- {} frame(s) in flight over {} {} image(s)", m_FramesInFlight, m_SwapchainImageCount, m_Settings.headless ? "offscreen" : "swapchain");
     VkExtent2D extent = m_Swapchain.GetExtent();
     m_Viewport.x = 0.0f;
     m_Viewport.y = 0.0f;
@@ -110,87 +200,190 @@ void VulkanRHI::Init(void* window)
 
     CreateCommandPool();
     CreateSyncObjects();
+    if (m_Settings.gpuProfiling) {
+        m_GpuProfiler.Init(m_Device.get(), m_GfxCmdPool, m_FramesInFlight, m_Settings.pipelineStatistics);
+    }
 
     // Pipeline resources
-    auto gfxCmd = m_GfxCmdPool.Allocate();
-    m_Device->CreateDepthImage(m_DepthImage, m_Swapchain.GetExtent(), gfxCmd);
-    m_GfxCmdPool.Free(gfxCmd);
-
-    CreateRenderPass();
-    CreateFramebuffers();
+    m_DynamicRendering = m_Settings.dynamicRendering && m_Device->IsDynamicRenderingSupported();
+    SEInfo("-- Rendering path: {}", m_DynamicRendering ? "dynamic rendering" : "render pass objects");
+    if (!m_DynamicRendering) {
+        CreateRenderPass();
+    }
+    m_RenderGraph.Init(m_Device.get(), m_DynamicRendering);
+    m_RenderGraph.SetProfiler(m_GpuProfiler.IsEnabled() ? &m_GpuProfiler : nullptr);
+    BuildRenderGraph();
     SetDescriptorResources();
+    m_TextureStreamer.Init(m_Device.get(), &m_DecodeThreadPool, m_Settings.textureUploadBudget);
 
     m_Camera.SetPerspective(60.0f, static_cast<float>(extent.width) / static_cast<float>(extent.height), 0.1f, 1000.0f);
     m_Camera.SetPosition(glm::vec3(0.0f, 0.0f, -2.0f));
 }
 
 bool VulkanRHI::AssureResource()
-{   
-    auto tsfCmd = m_TsfCmdPool.Allocate();
-    for (size_t i = 0; i < m_Buffers.size(); ++i) {
-        VulkanBuffer& buffer = m_Buffers[i];
-        BufferDescription& description = m_BufferDescriptions[i];
-        VkBufferUsageFlags usageFlag;
-        switch (description.usage) {
-            case BufferUsage::Vertex:
-                usageFlag = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-                break;
-            case BufferUsage::Index:
-                usageFlag = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+{
+    ZoneScoped;
+    auto start = std::chrono::high_resolution_clock::now();
+    VulkanUploader& uploader = m_Device->GetUploader();
+    const uint64_t uploadedBytes = uploader.GetUploadedBytes();
+    const uint32_t submitCount = uploader.GetSubmitCount();
+    m_ResourceReport = {};
+    DispatchPipelines();
+
+    // Every pending creation is recorded first and submitted together
+    uploader.BeginBatch();
+    m_Buffers.ForEach([this](BufferHandle, BufferResource& resource) {
+        VulkanBuffer& buffer = resource.buffer;
+        if (buffer.buffer != VK_NULL_HANDLE) {
+            return;
+        }
+        const BufferDescription& description = resource.description;
+        const VkBufferUsageFlags usageFlag = GetBufferUsageFlags(description.usage);
+        switch (description.hint) {
+            case BufferUpdateHint::Static:
+                // Updates are copied in on the graphics queue
+                m_Device->CreateDeviceBuffer(
+                    buffer,
+                    description.size,
+                    description.data,
+                    usageFlag | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                );
                 break;
-            case BufferUsage::Uniform:
-                usageFlag = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+            case BufferUpdateHint::Dynamic: {
+                const VkDeviceSize alignment = GetBindAlignment(m_Device->GetGpuProperties().limits, description.usage);
+                resource.copyStride = (description.size + alignment - 1) / alignment * alignment;
+                m_Device->CreateBuffer(
+                    buffer,
+                    resource.copyStride * m_FramesInFlight,
+                    usageFlag,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                );
+                m_Device->MapBuffer(buffer, resource.copyStride * m_FramesInFlight, 0);
+                resource.shadow.assign(description.size, 0);
+                if (description.data) {
+                    memcpy(resource.shadow.data(), description.data, description.size);
+                }
+                for (uint32_t i = 0; i < m_FramesInFlight; ++i) {
+                    memcpy(static_cast<char*>(buffer.mapped) + resource.copyStride * i, resource.shadow.data(), description.size);
+                }
                 break;
+            }
+            case BufferUpdateHint::Stream:
+                // Backed by the frame allocator once written
+                return;
         }
-        m_Device->CreateDeviceBuffer(
-            buffer,
-            description.size,
-            description.data,
-            usageFlag,
-            tsfCmd
+        m_ResourceReport.bufferCount++;
+    });
+    if (m_DefaultInstanceBuffer.buffer == VK_NULL_HANDLE) {
+        InstanceData instance = {};
+        m_Device->CreateDeviceBuffer(m_DefaultInstanceBuffer, sizeof(InstanceData), &instance, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    }
+    if (!m_Texture) {
+        // Decoded on the workers and uploaded by the frames that follow, the whole screen samples it
+        m_Texture = m_TextureStreamer.Request(
+            "D:/w6rsty/dev/Cpp/serious/assets/viking_room.png",
+            m_Swapchain.GetColorFormat(),
+            m_Swapchain.GetComponentMapping(),
+            static_cast<float>(m_Settings.width * m_Settings.height)
         );
-
+        m_ResourceReport.textureCount++;
     }
-    m_TsfCmdPool.Free(tsfCmd);
-
+    uploader.Wait(uploader.EndBatch());
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    m_ResourceReport.uploadBytes = static_cast<size_t>(uploader.GetUploadedBytes() - uploadedBytes);
+    m_ResourceReport.submitCount = uploader.GetSubmitCount() - submitCount;
+    m_ResourceReport.milliseconds = elapsed.count();
+    SEInfo("-- Resources: {} buffer(s), {} texture(s), {} byte(s) in {} submit(s), {:.3f} ms",
+        m_ResourceReport.bufferCount,
+        m_ResourceReport.textureCount,
+        m_ResourceReport.uploadBytes,
+        m_ResourceReport.submitCount,
+        m_ResourceReport.milliseconds
+    );
     return true;
 }
 
 void VulkanRHI::Shutdown()
 {    
     VkDevice device = m_Device->GetHandle();
+    m_ThreadPool.WaitIdle();
+    m_DecodeThreadPool.WaitIdle();
     m_Device->WaitIdle();
+    m_Device->GetPipelineCache().Save(std::string(m_Settings.pipelineCachePath));
 
-    m_Device->DestroyTextureImage(m_TextureImage);
+    m_TextureStreamer.Destroy();
+    m_Textures.Clear();
 
+    for (DescriptorAllocator& allocator : m_FrameDescriptorAllocators) {
+        allocator.Destroy();
+    }
     m_Device->DestroyDescriptorResources();
-    for (VulkanBuffer& buffer : m_UniformBuffers) {
-        m_Device->DestroyBuffer(buffer);
+    m_FrameAllocator.Destroy();
+    for (std::vector<IndirectBuffers>& frameBuffers : m_IndirectBuffers) {
+        for (IndirectBuffers& buffers : frameBuffers) {
+            if (buffers.capacity > 0) {
+                m_Device->DestroyBuffer(buffers.commands);
+                m_Device->DestroyBuffer(buffers.count);
+                m_Device->DestroyBuffer(buffers.instances);
+            }
+        }
     }
 
-    for (VulkanBuffer& buffer : m_Buffers) {
-        m_Device->DestroyBuffer(buffer);
+    m_Buffers.ForEach([this](BufferHandle, BufferResource& resource) {
+        if (resource.buffer.buffer != VK_NULL_HANDLE) {
+            m_Device->DestroyBuffer(resource.buffer);
+        }
+    });
+    m_Buffers.Clear();
+    m_PendingBufferCopies.clear();
+    m_DirtyBuffers.clear();
+    m_Device->DestroyBuffer(m_DefaultInstanceBuffer);
+
+    // Pipelines the application did not destroy, the workers are idle
+    m_Pipelines.ForEach([](PipelineHandle, std::unique_ptr<VulkanPipeline>& pipeline) {
+        pipeline->Destroy();
+    });
+    m_Pipelines.Clear();
+    for (std::unique_ptr<VulkanPipeline>& pipeline : m_RetiredPipelines) {
+        pipeline->Destroy();
     }
-
-    for (VulkanShaderModule& shaderModule : m_ShaderModules) {
+    m_RetiredPipelines.clear();
+    m_PendingPipelines.clear();
+    m_BoundPipline = nullptr;
+    m_CullPipelines.ForEach([](CullPipelineHandle, std::unique_ptr<VulkanComputePipeline>& pipeline) {
+        pipeline->Destroy();
+    });
+    m_CullPipelines.Clear();
+    m_ShaderModules.ForEach([this](ShaderHandle, VulkanShaderModule& shaderModule) {
+        m_Device->DestroyShaderModule(shaderModule);
+    });
+    m_ShaderModules.Clear();
+    for (VulkanShaderModule& shaderModule : m_RetiredShaderModules) {
         m_Device->DestroyShaderModule(shaderModule);
     }
-    for (VkFramebuffer& framebuffer : m_Framebuffers) {
-        vkDestroyFramebuffer(device, framebuffer, nullptr);
-    }
+    m_RetiredShaderModules.clear();
+    m_RenderGraph.Destroy();
     vkDestroyRenderPass(device, m_RenderPass, nullptr);
+    m_GpuProfiler.Destroy();
 
-    m_Device->DestroyTextureImage(m_DepthImage);
-
-    for (uint32_t i = 0; i < m_Swapchain.GetImageCount(); ++i) {
+    for (uint32_t i = 0; i < m_FramesInFlight; ++i) {
         m_Device->DestroyFence(m_Fences[i]);
         vkDestroySemaphore(device, m_ImageAvailableSems[i], nullptr);
-        vkDestroySemaphore(device, m_RenderFinishedSems[i], nullptr);
+    }
+    for (VkSemaphore semaphore : m_RenderFinishedSems) {
+        vkDestroySemaphore(device, semaphore, nullptr);
     }
     
+    for (SecondaryCommands& secondaryCmds : m_SecondaryCmds) {
+        for (VulkanCommandPool& pool : secondaryCmds.pools) {
+            m_Device->DestroyCommandPool(pool);
+        }
+    }
     m_Device->DestroyCommandPool(m_GfxCmdPool);
-    m_Device->DestroyCommandPool(m_TsfCmdPool);
     
+    // Retired swapchains must go before their surface
+    m_Device->GetDeletionQueue().Flush();
     m_Swapchain.Cleanup();
     // Core resources
     m_Device->Destroy();
@@ -202,28 +395,33 @@ void VulkanRHI::Shutdown()
 
 void VulkanRHI::WindowResize()
 {
-    m_Device->WaitIdle();
-    int width = 0, height = 0;
-    SDL_GetWindowSizeInPixels(static_cast<SDL_Window*>(m_PlatformWindow), &width, &height);
-    m_Settings.width = static_cast<uint32_t>(width);
-    m_Settings.height = static_cast<uint32_t>(height);
-    m_Swapchain.Create(&m_Settings.width, &m_Settings.height, m_Settings.vsync);
-    m_Camera.SetPerspective(m_Camera.fov, static_cast<float>(m_Settings.width) / static_cast<float>(m_Settings.height), m_Camera.zNear, m_Camera.zFar);
-
-    m_Device->DestroyTextureImage(m_DepthImage);
-    auto gfxCmd = m_GfxCmdPool.Allocate();
-    m_Device->CreateDepthImage(m_DepthImage, m_Swapchain.GetExtent(), gfxCmd);
-    m_GfxCmdPool.Free(gfxCmd);
-
-    for (VkFramebuffer& framebuffer : m_Framebuffers) {
-        vkDestroyFramebuffer(m_Device->GetHandle(), framebuffer, nullptr);
+    ZoneScoped;
+    // No device wait, the retired swapchain and render targets go through the deletion queue
+    if (m_Settings.headless) {
+        // No window to follow, the target keeps the size of the settings
+        m_Swapchain.CreateOffscreen(m_Settings.width, m_Settings.height);
+    } else {
+        int width = 0, height = 0;
+        SDL_GetWindowSizeInPixels(static_cast<SDL_Window*>(m_PlatformWindow), &width, &height);
+        m_Settings.width = static_cast<uint32_t>(width);
+        m_Settings.height = static_cast<uint32_t>(height);
+        m_Swapchain.Create(&m_Settings.width, &m_Settings.height, m_Settings.vsync);
+    }
+    if (m_Swapchain.GetImageCount() != m_SwapchainImageCount) {
+        m_SwapchainImageCount = m_Swapchain.GetImageCount();
+        CreatePresentSemaphores();
     }
-    CreateFramebuffers();
+    m_Camera.SetPerspective(m_Camera.fov, static_cast<float>(m_Settings.width) / static_cast<float>(m_Settings.height), m_Camera.zNear, m_Camera.zFar);
+    BuildRenderGraph();
 }
 
 void VulkanRHI::PrepareFrame()
 {
     ZoneScoped;
+    if (m_Swapchain.IsOffscreen()) {
+        m_SwapchainImageIndex = 0;
+        return;
+    }
 
     VkResult result = m_Swapchain.AcquireNextImage(m_ImageAvailableSems[m_CurrentFrame], &m_SwapchainImageIndex);
 	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
@@ -240,8 +438,11 @@ void VulkanRHI::PrepareFrame()
 void VulkanRHI::SubmitFrame()
 {
     ZoneScoped;
+    if (m_Swapchain.IsOffscreen()) {
+        return;
+    }
 
-    VkResult result = m_Swapchain.Present(&m_RenderFinishedSems[m_CurrentFrame], m_SwapchainImageIndex);
+    VkResult result = m_Swapchain.Present(&m_RenderFinishedSems[m_SwapchainImageIndex], m_SwapchainImageIndex);
 	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
 		WindowResize();
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -255,65 +456,447 @@ void VulkanRHI::SubmitFrame()
 
 void VulkanRHI::Update()
 {
+    ReleaseRetired();
+    DispatchPipelines();
+
+    // Already waited on when the application updated buffers since the last frame
+    BeginFrameWrites();
+    m_Fences[m_CurrentFrame].Reset();
+    // Every frame up to the one that last used this slot has completed
+    VulkanDeletionQueue& deletionQueue = m_Device->GetDeletionQueue();
+    if (deletionQueue.GetFrame() >= m_FramesInFlight) {
+        deletionQueue.Collect(deletionQueue.GetFrame() - m_FramesInFlight);
+    }
     UpdateUniforms();
-
-    m_Fences[m_CurrentFrame].WaitAndReset();
+    BuildRenderQueue();
+    PrepareIndirectBuffers();
+    m_FrameDescriptorAllocators[m_CurrentFrame].Reset();
+    m_Device->GetBindlessTable().NextFrame();
+    for (VulkanCommandPool& pool : m_SecondaryCmds[m_CurrentFrame].pools) {
+        pool.Reset();
+    }
 
     PrepareFrame();
 
+    // Uploads flushed here are acquired by this frame, published by a later one
+    m_TextureStreamer.Update();
+
     auto gfxCmd = m_GfxCmdBufs[m_CurrentFrame];    
     gfxCmd.BeginSingle();
+    // Results of the last frame recorded into this slot are read back here, the fence was waited on
+    m_GpuProfiler.BeginFrame(gfxCmd, m_CurrentFrame);
+    // Take ownership of uploads finished on the transfer queue
+    VulkanUploadWait uploadWait = m_Device->GetUploader().AcquireOnGraphics(gfxCmd);
+    RecordBufferCopies(gfxCmd);
     {
-        VkExtent2D extent = m_Swapchain.GetExtent();
-        m_Viewport.width = static_cast<float>(extent.width);
-        m_Viewport.height = static_cast<float>(extent.height);
-        gfxCmd.SetViewport(m_Viewport);
-        m_Scissor.extent = extent;
-        gfxCmd.SetScissor(m_Scissor);
- 
-        VkRenderPassBeginInfo beginInfo = {};
-        beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        beginInfo.renderPass = m_RenderPass;
-        beginInfo.framebuffer = m_Framebuffers[m_SwapchainImageIndex];
-        beginInfo.renderArea = m_Scissor;
-        beginInfo.clearValueCount = 2;
-        beginInfo.pClearValues = m_ClearValues;
-
-        for (const auto& pass : m_PassDescriptions) {
-            gfxCmd.BeginRenderPass(beginInfo, VK_SUBPASS_CONTENTS_INLINE);
-            gfxCmd.BindGraphicsPipeline(m_BoundPipline->GetHandle());
-            gfxCmd.BindVertexBuffer(m_Buffers[pass.vertexBuffer].buffer, 0);
-            gfxCmd.BindIndexBuffer(m_Buffers[pass.indexBuffer].buffer, 0, VK_INDEX_TYPE_UINT32);
-            gfxCmd.BindDescriptorSet(m_BoundPipline->GetPipelineLayout(), m_DescriptorSets[m_SwapchainImageIndex]);
-            gfxCmd.DrawIndexed(pass.size, 1, 0, 0, 0);
-            gfxCmd.EndRenderPass();
-        }
+        VulkanGpuScope zone(m_GpuProfiler, gfxCmd, "culling");
+        RecordCulling(gfxCmd);
     }
+    // Barriers and layout transitions of the attachments are emitted by the graph
+    m_RenderGraph.SetImportedImage(m_BackbufferResource, m_Swapchain.GetImage(m_SwapchainImageIndex), m_Swapchain.GetImageView(m_SwapchainImageIndex));
+    m_RenderGraph.Execute(gfxCmd);
+    m_GpuProfiler.EndFrame(gfxCmd);
     gfxCmd.End();
 
     std::array cmds = {gfxCmd.GetHandle()};
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    // Only wait on the upload timeline when this frame consumes new uploads
+    std::array waitSems = { m_ImageAvailableSems[m_CurrentFrame], m_Device->GetUploader().GetSemaphore() };
+    std::array<VkPipelineStageFlags, 2> waitStages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, uploadWait.stages };
+    std::array<uint64_t, 2> waitValues = { 0, uploadWait.value };
+    uint32_t waitCount = uploadWait.value > 0 ? 2 : 1;
+    // Nothing is acquired or presented offscreen, only the upload timeline remains
+    const uint32_t firstWait = m_Swapchain.IsOffscreen() ? 1 : 0;
+    waitCount -= firstWait;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = waitCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues.data() + firstWait;
+
     // Graphics queue submit
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &m_ImageAvailableSems[m_CurrentFrame];
-    submitInfo.pWaitDstStageMask = waitStages;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = waitCount;
+    submitInfo.pWaitSemaphores = waitSems.data() + firstWait;
+    submitInfo.pWaitDstStageMask = waitStages.data() + firstWait;
     submitInfo.commandBufferCount = static_cast<uint32_t>(cmds.size());
     submitInfo.pCommandBuffers = cmds.data();
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &m_RenderFinishedSems[m_CurrentFrame];
+    submitInfo.signalSemaphoreCount = m_Swapchain.IsOffscreen() ? 0 : 1;
+    // Presentation may still hold the semaphore of another image, so it is picked by image
+    submitInfo.pSignalSemaphores = &m_RenderFinishedSems[m_SwapchainImageIndex];
 
     m_Device->GetGraphicsQueue()->Submit(submitInfo, m_Fences[m_CurrentFrame].GetHandle());
     
     SubmitFrame();
 
-    m_CurrentFrame = (m_CurrentFrame + 1) % m_SwapchainImageCount;
+    m_FrameWritesBegun = false;
+    deletionQueue.NextFrame();
+    m_CurrentFrame = (m_CurrentFrame + 1) % m_FramesInFlight;
 
     FrameMark;
 }
 
-RHIResourceIdx VulkanRHI::CreateShader(const ShaderDescription& description)
+std::vector<uint8_t> VulkanRHI::ReadbackFrame()
+{
+    ZoneScoped;
+    if (!m_Swapchain.IsOffscreen()) {
+        SEWarn("Frame readback is only available in headless mode");
+        return {};
+    }
+    // Every frame in flight writes the same image, the last one is complete once the device is idle
+    m_Device->WaitIdle();
+    VkExtent2D extent = m_Swapchain.GetExtent();
+    std::vector<uint8_t> pixels(static_cast<size_t>(extent.width) * extent.height * 4);
+    VulkanCommandBuffer cmd = m_GfxCmdPool.Allocate();
+    m_Device->ReadImage(m_Swapchain.GetImage(0), extent, pixels.data(), cmd);
+    m_GfxCmdPool.Free(cmd);
+    return pixels;
+}
+
+void VulkanRHI::PrepareIndirectBuffers()
+{
+    std::vector<IndirectBuffers>& frameBuffers = m_IndirectBuffers[m_CurrentFrame];
+    if (frameBuffers.size() < m_IndirectPassDescriptions.size()) {
+        frameBuffers.resize(m_IndirectPassDescriptions.size());
+    }
+    for (size_t i = 0; i < m_IndirectPassDescriptions.size(); ++i) {
+        const uint32_t objectCount = m_IndirectPassDescriptions[i].objectCount;
+        IndirectBuffers& buffers = frameBuffers[i];
+        if (objectCount <= buffers.capacity) {
+            continue;
+        }
+        // The fence of this frame slot has been waited on, the old buffers are idle
+        if (buffers.capacity > 0) {
+            m_Device->DestroyBuffer(buffers.commands);
+            m_Device->DestroyBuffer(buffers.count);
+            m_Device->DestroyBuffer(buffers.instances);
+        }
+        m_Device->CreateBuffer(
+            buffers.commands,
+            sizeof(VkDrawIndexedIndirectCommand) * objectCount,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        );
+        m_Device->CreateBuffer(
+            buffers.count,
+            sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        );
+        m_Device->CreateBuffer(
+            buffers.instances,
+            sizeof(InstanceData) * objectCount,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        );
+        buffers.capacity = objectCount;
+    }
+}
+
+void VulkanRHI::RecordCulling(VulkanCommandBuffer& cmd)
+{
+    if (m_IndirectPassDescriptions.empty()) {
+        return;
+    }
+    ZoneScoped;
+    std::vector<IndirectBuffers>& frameBuffers = m_IndirectBuffers[m_CurrentFrame];
+    for (size_t i = 0; i < m_IndirectPassDescriptions.size(); ++i) {
+        if (frameBuffers[i].capacity > 0) {
+            cmd.FillBuffer(frameBuffers[i].count.buffer, 0, sizeof(uint32_t));
+        }
+    }
+    VkMemoryBarrier resetBarrier {};
+    resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    cmd.PipelineMemoryBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, &resetBarrier);
+
+    CullConstants constants = {};
+    std::array<glm::vec4, 6> planes = m_Camera.GetFrustumPlanes();
+    std::copy(planes.begin(), planes.end(), constants.planes);
+    for (size_t i = 0; i < m_IndirectPassDescriptions.size(); ++i) {
+        const IndirectPassDescription& pass = m_IndirectPassDescriptions[i];
+        const IndirectBuffers& buffers = frameBuffers[i];
+        const std::unique_ptr<VulkanComputePipeline>* pipelineSlot = m_CullPipelines.TryGet(pass.cullPipeline);
+        const BufferResource* objectBuffer = m_Buffers.TryGet(pass.objectBuffer);
+        const BufferBinding objectBinding = objectBuffer ? GetBufferBinding(*objectBuffer) : BufferBinding {};
+        if (!pipelineSlot || objectBinding.buffer == VK_NULL_HANDLE || buffers.capacity == 0) {
+            continue;
+        }
+        VulkanComputePipeline* pipeline = pipelineSlot->get();
+
+        VkDescriptorSet cullSet = m_FrameDescriptorAllocators[m_CurrentFrame].Allocate(m_CullSetLayout);
+        std::array<VkDescriptorBufferInfo, 4> bufferInfos = {{
+            {objectBinding.buffer, objectBinding.offset, objectBuffer->description.size},
+            {buffers.commands.buffer, 0, VK_WHOLE_SIZE},
+            {buffers.count.buffer, 0, VK_WHOLE_SIZE},
+            {buffers.instances.buffer, 0, VK_WHOLE_SIZE},
+        }};
+        std::array<VkWriteDescriptorSet, 4> descriptorWrites {};
+        for (uint32_t binding = 0; binding < descriptorWrites.size(); ++binding) {
+            descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = cullSet;
+            descriptorWrites[binding].dstBinding = binding;
+            descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[binding].descriptorCount = 1;
+            descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        vkUpdateDescriptorSets(m_Device->GetHandle(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+        constants.objectCount = pass.objectCount;
+        cmd.BindComputePipeline(pipeline->GetHandle());
+        cmd.BindComputeDescriptorSet(pipeline->GetPipelineLayout(), cullSet);
+        cmd.PushConstants(pipeline->GetPipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT, sizeof(CullConstants), &constants);
+        cmd.Dispatch((pass.objectCount + CullGroupSize - 1) / CullGroupSize);
+    }
+
+    VkMemoryBarrier cullBarrier {};
+    cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    cmd.PipelineMemoryBarrier(
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        &cullBarrier
+    );
+}
+
+void VulkanRHI::RecordIndirectDraws(VulkanCommandBuffer& cmd, VkDescriptorSet frameDescriptorSet)
+{
+    if (m_IndirectPassDescriptions.empty()) {
+        return;
+    }
+    ZoneScoped;
+    const std::vector<IndirectBuffers>& frameBuffers = m_IndirectBuffers[m_CurrentFrame];
+    for (size_t i = 0; i < m_IndirectPassDescriptions.size(); ++i) {
+        const IndirectPassDescription& pass = m_IndirectPassDescriptions[i];
+        const IndirectBuffers& buffers = frameBuffers[i];
+        VulkanPipeline* pipeline = GetReadyPipeline(pass.pipeline);
+        const BufferResource* vertexBuffer = m_Buffers.TryGet(pass.vertexBuffer);
+        const BufferResource* indexBuffer = m_Buffers.TryGet(pass.indexBuffer);
+        if (!pass.pipeline || !pipeline || !vertexBuffer || !indexBuffer || buffers.capacity == 0 || m_IndirectUniformOffsets[i] == UINT32_MAX) {
+            continue;
+        }
+        const BufferBinding vertexBinding = GetBufferBinding(*vertexBuffer);
+        const BufferBinding indexBinding = GetBufferBinding(*indexBuffer);
+        if (vertexBinding.buffer == VK_NULL_HANDLE || indexBinding.buffer == VK_NULL_HANDLE) {
+            continue;
+        }
+        cmd.BindGraphicsPipeline(pipeline->GetHandle());
+        if (m_Device->GetBindlessTable().IsEnabled()) {
+            cmd.BindDescriptorSet(pipeline->GetPipelineLayout(), m_Device->GetBindlessTable().GetSet(), 1);
+        }
+        cmd.BindDescriptorSet(pipeline->GetPipelineLayout(), frameDescriptorSet, 0, m_IndirectUniformOffsets[i]);
+        cmd.BindVertexBuffer(vertexBinding.buffer, vertexBinding.offset, Vertex::VertexBinding);
+        cmd.BindVertexBuffer(buffers.instances.buffer, 0, Vertex::InstanceBinding);
+        cmd.BindIndexBuffer(indexBinding.buffer, indexBinding.offset, VK_INDEX_TYPE_UINT32);
+        DrawConstants constants {};
+        constants.textureIndex = GetTextureBindlessIndex(pass.texture);
+        cmd.PushConstants(pipeline->GetPipelineLayout(), VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(DrawConstants), &constants);
+        cmd.DrawIndexedIndirectCount(
+            buffers.commands.buffer, 0,
+            buffers.count.buffer, 0,
+            pass.objectCount,
+            sizeof(VkDrawIndexedIndirectCommand)
+        );
+    }
+}
+
+void VulkanRHI::BuildRenderQueue()
+{
+    ZoneScoped;
+    m_RenderQueue.Clear();
+    // Ids in order of first appearance keep the key fields narrow
+    std::unordered_map<VulkanPipeline*, uint32_t> pipelineIds;
+    std::unordered_map<BufferHandle, uint32_t> materialIds;
+    std::map<std::pair<BufferHandle, BufferHandle>, uint32_t> meshIds;
+    const glm::mat4& view = m_Camera.matrices.view;
+    const float depthRange = std::max(m_Camera.zFar - m_Camera.zNear, 1e-4f);
+    const auto bindable = [this](BufferHandle handle) {
+        const BufferResource* resource = m_Buffers.TryGet(handle);
+        return resource && GetBufferBinding(*resource).buffer != VK_NULL_HANDLE;
+    };
+    for (size_t i = 0; i < m_PassDescriptions.size(); ++i) {
+        const RenderPassDescription& pass = m_PassDescriptions[i];
+        VulkanPipeline* pipeline = GetReadyPipeline(pass.pipeline);
+        // Draws whose pipeline is still compiling in the background are skipped, as are draws
+        // referencing destroyed resources or stream buffers not written this frame, so recording
+        // never sees a stale handle or an unbound buffer
+        if (!pipeline || m_DrawUniformOffsets[i] == UINT32_MAX) {
+            continue;
+        }
+        if (!bindable(pass.vertexBuffer) || !bindable(pass.indexBuffer) || (pass.instanceBuffer && !bindable(pass.instanceBuffer))) {
+            continue;
+        }
+        const uint32_t pipelineId = pipelineIds.try_emplace(pipeline, static_cast<uint32_t>(pipelineIds.size())).first->second;
+        // The instance buffer is the only per draw state besides the mesh
+        const uint32_t materialId = materialIds.try_emplace(pass.instanceBuffer, static_cast<uint32_t>(materialIds.size())).first->second;
+        const uint32_t meshId = meshIds.try_emplace(std::make_pair(pass.vertexBuffer, pass.indexBuffer), static_cast<uint32_t>(meshIds.size())).first->second;
+        // View space distance of the pass origin
+        const float distance = glm::length(glm::vec3(view * pass.transform[3]));
+        const float depth = (distance - m_Camera.zNear) / depthRange;
+        const uint64_t key = pipeline->GetBlendingMode() == ColorBlendingMode::None
+            ? RenderQueue::MakeOpaqueKey(pipelineId, materialId, meshId, depth)
+            : RenderQueue::MakeBlendedKey(pipelineId, materialId, meshId, depth);
+        m_RenderQueue.Push(key, static_cast<uint32_t>(i));
+    }
+    m_RenderQueue.Sort();
+}
+
+void VulkanRHI::RecordDraws(VulkanCommandBuffer& cmd, size_t first, size_t last, VkDescriptorSet frameDescriptorSet, DrawStats& stats)
+{
+    ZoneScoped;
+    cmd.SetViewport(m_Viewport);
+    cmd.SetScissor(m_Scissor);
+
+    // Returns true when the state differs from the bound one and has to be bound
+    const auto track = [&stats](auto& bound, auto value) {
+        if (bound == value) {
+            stats.bindsSkipped++;
+            return false;
+        }
+        bound = value;
+        stats.bindsIssued++;
+        return true;
+    };
+
+    // Bound sets survive pipeline switches as long as the pipeline layout stays the same
+    VulkanPipeline* boundPipeline = nullptr;
+    VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+    // Stream buffers share the frame allocator buffer, so the offset is part of the bound state
+    BufferBinding boundVertexBuffer;
+    BufferBinding boundInstanceBuffer;
+    BufferBinding boundIndexBuffer;
+    const bool bindless = m_Device->GetBindlessTable().IsEnabled();
+    const std::vector<RenderQueueEntry>& entries = m_RenderQueue.GetEntries();
+    for (size_t i = first; i < last; ++i) {
+        const uint32_t draw = entries[i].draw;
+        const RenderPassDescription& pass = m_PassDescriptions[draw];
+        VulkanPipeline* pipeline = GetReadyPipeline(pass.pipeline);
+        if (track(boundPipeline, pipeline)) {
+            cmd.BindGraphicsPipeline(pipeline->GetHandle());
+        }
+        const VkPipelineLayout layout = pipeline->GetPipelineLayout();
+        if (bindless && track(boundLayout, layout)) {
+            cmd.BindDescriptorSet(layout, m_Device->GetBindlessTable().GetSet(), 1);
+        }
+        // Only the dynamic offset changes between draws, the set itself is shared
+        cmd.BindDescriptorSet(layout, frameDescriptorSet, 0, m_DrawUniformOffsets[draw]);
+        stats.bindsIssued++;
+        if (track(boundVertexBuffer, GetBufferBinding(m_Buffers.Get(pass.vertexBuffer)))) {
+            cmd.BindVertexBuffer(boundVertexBuffer.buffer, boundVertexBuffer.offset, Vertex::VertexBinding);
+        }
+        const BufferBinding instanceBuffer = pass.instanceBuffer
+            ? GetBufferBinding(m_Buffers.Get(pass.instanceBuffer))
+            : BufferBinding {m_DefaultInstanceBuffer.buffer, 0};
+        if (track(boundInstanceBuffer, instanceBuffer)) {
+            cmd.BindVertexBuffer(boundInstanceBuffer.buffer, boundInstanceBuffer.offset, Vertex::InstanceBinding);
+        }
+        if (track(boundIndexBuffer, GetBufferBinding(m_Buffers.Get(pass.indexBuffer)))) {
+            cmd.BindIndexBuffer(boundIndexBuffer.buffer, boundIndexBuffer.offset, VK_INDEX_TYPE_UINT32);
+        }
+        DrawConstants constants {};
+        constants.textureIndex = GetTextureBindlessIndex(pass.texture);
+        cmd.PushConstants(layout, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(DrawConstants), &constants);
+        // Every instance of the pass goes out in a single draw
+        const uint32_t instanceCount = pass.instanceBuffer ? pass.instanceCount : 1;
+        cmd.DrawIndexed(pass.size, instanceCount, 0, 0, 0);
+        stats.drawCount++;
+    }
+}
+
+void VulkanRHI::RecordScene(VulkanCommandBuffer& cmd, const RenderGraphContext& context)
+{
+    ZoneScoped;
+    VkExtent2D extent = context.dynamicRendering ? context.renderingInfo.renderArea.extent : context.beginInfo.renderArea.extent;
+    m_Viewport.width = static_cast<float>(extent.width);
+    m_Viewport.height = static_cast<float>(extent.height);
+    m_Scissor.extent = extent;
+
+    // All passes are drawn in a single render pass instance
+    VkDescriptorSet frameDescriptorSet = AllocateFrameDescriptorSet();
+    const size_t drawCount = m_RenderQueue.GetSize();
+    const uint32_t partitionCount = static_cast<uint32_t>(std::min<size_t>(
+        m_SecondaryCmds[m_CurrentFrame].cmdBufs.size(),
+        (drawCount + MinDrawsPerPartition - 1) / MinDrawsPerPartition
+    ));
+    // An open statistics query the secondaries cannot inherit keeps the recording inline
+    const bool secondary = partitionCount > 1 && m_GpuProfiler.CanExecuteSecondary();
+    if (context.dynamicRendering) {
+        VkRenderingInfo renderingInfo = context.renderingInfo;
+        renderingInfo.flags = secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+        cmd.BeginRendering(renderingInfo);
+    } else {
+        cmd.BeginRenderPass(context.beginInfo, secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    }
+    if (secondary) {
+        cmd.ExecuteCommands(RecordDrawsParallel(partitionCount, frameDescriptorSet, context));
+    } else {
+        DrawStats stats;
+        RecordDraws(cmd, 0, drawCount, frameDescriptorSet, stats);
+        m_DrawStats = stats;
+        RecordIndirectDraws(cmd, frameDescriptorSet);
+    }
+    if (context.dynamicRendering) {
+        cmd.EndRendering();
+    } else {
+        cmd.EndRenderPass();
+    }
+}
+
+std::vector<VkCommandBuffer> VulkanRHI::RecordDrawsParallel(uint32_t partitionCount, VkDescriptorSet frameDescriptorSet, const RenderGraphContext& context)
+{
+    ZoneScoped;
+    SecondaryCommands& secondaryCmds = m_SecondaryCmds[m_CurrentFrame];
+    const size_t drawCount = m_RenderQueue.GetSize();
+    const size_t partitionSize = (drawCount + partitionCount - 1) / partitionCount;
+    // Each partition starts with nothing bound, its counters are summed once all are recorded
+    std::vector<DrawStats> partitionStats(partitionCount);
+
+    // Each partition records into its own pool, so no pool is ever used by two threads.
+    // The calling thread records the last partition while the workers take the others
+    std::latch recorded(partitionCount - 1);
+    const VkQueryPipelineStatisticFlags statistics = m_GpuProfiler.GetActiveStatistics();
+    const auto record = [&](uint32_t partition) {
+        VulkanCommandBuffer& cmd = secondaryCmds.cmdBufs[partition];
+        size_t first = std::min(partition * partitionSize, drawCount);
+        size_t last = std::min(first + partitionSize, drawCount);
+        if (context.dynamicRendering) {
+            cmd.BeginSecondary(context.inheritanceInfo, statistics);
+        } else {
+            cmd.BeginSecondary(context.renderPass, 0, context.framebuffer, statistics);
+        }
+        RecordDraws(cmd, first, last, frameDescriptorSet, partitionStats[partition]);
+        if (partition + 1 == partitionCount) {
+            RecordIndirectDraws(cmd, frameDescriptorSet);
+        }
+        cmd.End();
+    };
+    for (uint32_t partition = 0; partition + 1 < partitionCount; ++partition) {
+        m_ThreadPool.Enqueue([&record, &recorded, partition] {
+            record(partition);
+            recorded.count_down();
+        });
+    }
+    record(partitionCount - 1);
+    recorded.wait();
+
+    m_DrawStats = {};
+    for (const DrawStats& stats : partitionStats) {
+        m_DrawStats.drawCount += stats.drawCount;
+        m_DrawStats.bindsIssued += stats.bindsIssued;
+        m_DrawStats.bindsSkipped += stats.bindsSkipped;
+    }
+
+    std::vector<VkCommandBuffer> handles(partitionCount);
+    for (uint32_t partition = 0; partition < partitionCount; ++partition) {
+        handles[partition] = secondaryCmds.cmdBufs[partition].GetHandle();
+    }
+    return handles;
+}
+
+ShaderHandle VulkanRHI::CreateShader(const ShaderDescription& description)
 {
     VkShaderStageFlagBits stage;
     switch (description.stage) {
@@ -327,33 +910,311 @@ RHIResourceIdx VulkanRHI::CreateShader(const ShaderDescription& description)
             stage = VK_SHADER_STAGE_COMPUTE_BIT;
             break;
     }
-    m_ShaderModules.push_back(m_Device->CreateShaderModule(std::string(description.file), stage, description.entry));
-    return m_ShaderModules.size() - 1;
+    return m_ShaderModules.Create(m_Device->CreateShaderModule(std::string(description.file), stage, description.entry));
+}
+
+void VulkanRHI::DestroyShader(ShaderHandle shader)
+{
+    if (!m_ShaderModules.IsValid(shader)) {
+        SEWarn("Destroying a stale shader handle");
+        return;
+    }
+    // Pipelines hold a copy of the module, only their compile reads it
+    m_RetiredShaderModules.push_back(m_ShaderModules.Destroy(shader));
+}
+
+PipelineHandle VulkanRHI::CreatePipeline(const PipelineDescription& description)
+{
+    std::unique_ptr<VulkanPipeline> pipeline(NewPipeline(description));
+    pipeline->Create();
+    return m_Pipelines.Create(std::move(pipeline));
+}
+
+PipelineHandle VulkanRHI::CreatePipelineAsync(const PipelineDescription& description)
+{
+    std::unique_ptr<VulkanPipeline> pipeline(NewPipeline(description));
+    m_PendingPipelines.push_back(pipeline.get());
+    return m_Pipelines.Create(std::move(pipeline));
+}
+
+bool VulkanRHI::IsPipelineReady(PipelineHandle pipeline) const
+{
+    const std::unique_ptr<VulkanPipeline>* slot = m_Pipelines.TryGet(pipeline);
+    return slot && (*slot)->IsReady();
+}
+
+VulkanPipeline* VulkanRHI::GetReadyPipeline(PipelineHandle pipeline) const
+{
+    VulkanPipeline* vulkanPipeline = m_BoundPipline;
+    if (pipeline) {
+        const std::unique_ptr<VulkanPipeline>* slot = m_Pipelines.TryGet(pipeline);
+        vulkanPipeline = slot ? slot->get() : nullptr;
+    }
+    return vulkanPipeline && vulkanPipeline->IsReady() ? vulkanPipeline : nullptr;
 }
 
-RHIResource VulkanRHI::CreatePipeline(const PipelineDescription& description)
+VulkanPipeline* VulkanRHI::NewPipeline(const PipelineDescription& description)
 {
     std::vector<VulkanShaderModule> shaderModules;
-    for (RHIResourceIdx shaderIdx : description.shaders) {
-        shaderModules.push_back(m_ShaderModules[shaderIdx]);
+    for (ShaderHandle shader : description.shaders) {
+        shaderModules.push_back(m_ShaderModules.Get(shader));
+    }
+    // Render passes of the graph are compatible with m_RenderPass, dynamic rendering only needs the formats
+    VulkanRenderingFormats renderingFormats = {m_Swapchain.GetColorFormat(), m_Swapchain.GetDepthFormat()};
+    return new VulkanPipeline(m_Device.get(), shaderModules, description.blendingMode, m_RenderPass, renderingFormats);
+}
+
+void VulkanRHI::DispatchPipelines()
+{
+    if (m_PendingPipelines.empty()) {
+        return;
+    }
+    ZoneScoped;
+    const size_t batchCount = std::min<size_t>(m_ThreadPool.GetThreadCount(), m_PendingPipelines.size());
+    const size_t batchSize = (m_PendingPipelines.size() + batchCount - 1) / batchCount;
+    for (size_t first = 0; first < m_PendingPipelines.size(); first += batchSize) {
+        size_t last = std::min(first + batchSize, m_PendingPipelines.size());
+        std::vector<VulkanPipeline*> batch(m_PendingPipelines.begin() + first, m_PendingPipelines.begin() + last);
+        m_ThreadPool.Enqueue([device = m_Device.get(), batch = std::move(batch)] {
+            VulkanPipeline::CreateBatch(device, batch);
+        });
+    }
+    m_PendingPipelines.clear();
+}
+
+void VulkanRHI::ReleaseRetired()
+{
+    std::erase_if(m_RetiredPipelines, [](std::unique_ptr<VulkanPipeline>& pipeline) {
+        if (!pipeline->IsReady()) {
+            return false;
+        }
+        pipeline->Destroy();
+        return true;
+    });
+    if (m_RetiredShaderModules.empty() || !m_RetiredPipelines.empty() || !m_PendingPipelines.empty()) {
+        return;
+    }
+    // Pipelines created before the shaders were destroyed may still be on a worker
+    bool compiling = false;
+    m_Pipelines.ForEach([&compiling](PipelineHandle, std::unique_ptr<VulkanPipeline>& pipeline) {
+        compiling |= !pipeline->IsReady();
+    });
+    if (compiling) {
+        return;
+    }
+    for (VulkanShaderModule& shaderModule : m_RetiredShaderModules) {
+        m_Device->DestroyShaderModule(shaderModule);
+    }
+    m_RetiredShaderModules.clear();
+}
+BufferHandle VulkanRHI::CreateBuffer(const BufferDescription& description)
+{
+    return m_Buffers.Create({description, {}});
+}
+
+void VulkanRHI::DestroyBuffer(BufferHandle buffer)
+{
+    if (!m_Buffers.IsValid(buffer)) {
+        SEWarn("Destroying a stale buffer handle");
+        return;
+    }
+    BufferResource resource = m_Buffers.Destroy(buffer);
+    // Not created yet when AssureResource has not run since
+    if (resource.buffer.buffer != VK_NULL_HANDLE) {
+        m_Device->DeferDestroyBuffer(resource.buffer);
+    }
+}
+
+TextureHandle VulkanRHI::CreateTexture(const TextureDescription& description)
+{
+    return m_Textures.Create(m_TextureStreamer.Request(
+        description.file,
+        m_Swapchain.GetColorFormat(),
+        m_Swapchain.GetComponentMapping(),
+        description.priority
+    ));
+}
+
+void VulkanRHI::DestroyTexture(TextureHandle texture)
+{
+    if (!m_Textures.IsValid(texture)) {
+        SEWarn("Destroying a stale texture handle");
+        return;
+    }
+    m_TextureStreamer.Release(m_Textures.Destroy(texture));
+}
+
+uint32_t VulkanRHI::GetTextureBindlessIndex(TextureHandle texture) const
+{
+    const StreamedTexture* streamed = m_Textures.TryGet(texture);
+    if (!streamed) {
+        return VulkanBindlessTable::InvalidIndex;
+    }
+    // The placeholder slot until the texture is streamed in
+    return m_TextureStreamer.GetBindlessIndex(*streamed);
+}
+
+void VulkanRHI::UpdateBuffer(BufferHandle buffer, const void* data, size_t size, size_t offset)
+{
+    ZoneScoped;
+    void* mapped = MapBuffer(buffer, offset, size);
+    if (mapped) {
+        memcpy(mapped, data, size);
+        UnmapBuffer(buffer);
+    }
+}
+
+void* VulkanRHI::MapBuffer(BufferHandle buffer, size_t offset, size_t size)
+{
+    BufferResource* resource = m_Buffers.TryGet(buffer);
+    if (!resource) {
+        SEWarn("Mapping a stale buffer handle");
+        return nullptr;
     }
-    return new VulkanPipeline(m_Device.get(), shaderModules, description.blendingMode, m_RenderPass, m_Swapchain);
+    if (resource->mapped) {
+        SEWarn("Mapping a buffer that is already mapped");
+        return nullptr;
+    }
+    if (size == 0 || offset + size > resource->description.size) {
+        SEWarn("Mapping [{}, {}) of a {} byte(s) buffer", offset, offset + size, resource->description.size);
+        return nullptr;
+    }
+    const BufferUpdateHint hint = resource->description.hint;
+    if (hint != BufferUpdateHint::Stream && resource->buffer.buffer == VK_NULL_HANDLE) {
+        SEWarn("Mapping a buffer before AssureResource created it");
+        return nullptr;
+    }
+    BeginFrameWrites();
+
+    void* mapped = nullptr;
+    switch (hint) {
+        case BufferUpdateHint::Static:
+            // Staged here, copied by the next frame before anything reads the buffer
+            if (size <= MaxFrameStagingSize) {
+                VulkanFrameAllocation staging = m_FrameAllocator.Allocate(size);
+                resource->stagingBuffer = staging.buffer;
+                resource->stagingOffset = staging.offset;
+                mapped = staging.mapped;
+            }
+            if (!mapped) {
+                VulkanBuffer staging;
+                m_Device->CreateBuffer(staging, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+                m_Device->MapBuffer(staging, size, 0);
+                resource->stagingBuffer = staging.buffer;
+                resource->stagingOffset = 0;
+                mapped = staging.mapped;
+                // Outlives the frame recording the copy
+                m_Device->DeferDestroyBuffer(staging);
+            }
+            break;
+        case BufferUpdateHint::Dynamic:
+            // Written to the shadow, Unmap copies the range into the copy of this frame slot
+            mapped = resource->shadow.data() + offset;
+            break;
+        case BufferUpdateHint::Stream: {
+            // The whole buffer is allocated by the first write of the frame
+            const uint64_t frame = m_Device->GetDeletionQueue().GetFrame();
+            if (resource->streamFrame != frame) {
+                const VkDeviceSize alignment = GetBindAlignment(m_Device->GetGpuProperties().limits, resource->description.usage);
+                VulkanFrameAllocation allocation = m_FrameAllocator.Allocate(resource->description.size, alignment);
+                if (!allocation.mapped) {
+                    return nullptr;
+                }
+                resource->streamAllocation = allocation;
+                resource->streamFrame = frame;
+            }
+            mapped = static_cast<char*>(resource->streamAllocation.mapped) + offset;
+            break;
+        }
+    }
+    resource->mapped = true;
+    resource->mapOffset = offset;
+    resource->mapSize = size;
+    return mapped;
 }
-RHIResourceIdx VulkanRHI::CreateBuffer(const BufferDescription& description)
+
+void VulkanRHI::UnmapBuffer(BufferHandle buffer)
 {
-    m_BufferDescriptions.push_back(description);
-    m_Buffers.emplace_back(VulkanBuffer {});
-    return m_Buffers.size() - 1;
+    BufferResource* resource = m_Buffers.TryGet(buffer);
+    if (!resource || !resource->mapped) {
+        SEWarn("Unmapping a buffer that is not mapped");
+        return;
+    }
+    resource->mapped = false;
+    switch (resource->description.hint) {
+        case BufferUpdateHint::Static:
+            m_PendingBufferCopies.push_back({
+                resource->stagingBuffer,
+                resource->stagingOffset,
+                resource->buffer.buffer,
+                resource->mapOffset,
+                resource->mapSize,
+                resource->description.usage
+            });
+            break;
+        case BufferUpdateHint::Dynamic: {
+            // The fence of this slot was waited on by MapBuffer, the other slots catch up as their frames begin
+            char* copy = static_cast<char*>(resource->buffer.mapped) + resource->copyStride * m_CurrentFrame;
+            memcpy(copy + resource->mapOffset, resource->shadow.data() + resource->mapOffset, resource->mapSize);
+            if (m_FramesInFlight == 1) {
+                break;
+            }
+            const size_t end = resource->mapOffset + resource->mapSize;
+            if (resource->staleCopies == 0) {
+                resource->dirtyBegin = resource->mapOffset;
+                resource->dirtyEnd = end;
+                m_DirtyBuffers.push_back(buffer);
+            } else {
+                resource->dirtyBegin = std::min(resource->dirtyBegin, resource->mapOffset);
+                resource->dirtyEnd = std::max(resource->dirtyEnd, end);
+            }
+            resource->staleCopies = m_FramesInFlight - 1;
+            break;
+        }
+        case BufferUpdateHint::Stream:
+            // Coherent memory, nothing to flush
+            break;
+    }
 }
 
-void VulkanRHI::BindPipeline(RHIResource pipeline)
+VulkanRHI::BufferBinding VulkanRHI::GetBufferBinding(const BufferResource& resource) const
 {
-    m_BoundPipline = (VulkanPipeline*)pipeline;
+    switch (resource.description.hint) {
+        case BufferUpdateHint::Dynamic:
+            return {resource.buffer.buffer, static_cast<uint32_t>(resource.copyStride * m_CurrentFrame)};
+        case BufferUpdateHint::Stream:
+            if (resource.streamFrame != m_Device->GetDeletionQueue().GetFrame()) {
+                return {};
+            }
+            return {resource.streamAllocation.buffer, resource.streamAllocation.offset};
+        default:
+            return {resource.buffer.buffer, 0};
+    }
 }
 
-void VulkanRHI::DestroyPipeline(RHIResource pipeline)
+void VulkanRHI::BindPipeline(PipelineHandle pipeline)
 {
-    ((VulkanPipeline*)pipeline)->Destroy();
+    std::unique_ptr<VulkanPipeline>* slot = m_Pipelines.TryGet(pipeline);
+    m_BoundPipline = slot ? slot->get() : nullptr;
+}
+
+void VulkanRHI::DestroyPipeline(PipelineHandle pipeline)
+{
+    if (!m_Pipelines.IsValid(pipeline)) {
+        SEWarn("Destroying a stale pipeline handle");
+        return;
+    }
+    std::unique_ptr<VulkanPipeline> owned = m_Pipelines.Destroy(pipeline);
+    if (m_BoundPipline == owned.get()) {
+        m_BoundPipline = nullptr;
+    }
+    const bool dispatched = std::erase(m_PendingPipelines, owned.get()) == 0;
+    if (dispatched && !owned->IsReady()) {
+        // A worker is still compiling it, destroyed by ReleaseRetired once done
+        m_RetiredPipelines.push_back(std::move(owned));
+        return;
+    }
+    owned->Destroy();
 }
 
 void VulkanRHI::SetPasses(const std::vector<RenderPassDescription>& descriptions)
@@ -361,6 +1222,35 @@ void VulkanRHI::SetPasses(const std::vector<RenderPassDescription>& descriptions
     m_PassDescriptions = descriptions;
 }
 
+CullPipelineHandle VulkanRHI::CreateCullPipeline(ShaderHandle computeShader)
+{
+    VkPushConstantRange pushConstantRange {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullConstants);
+    auto pipeline = std::make_unique<VulkanComputePipeline>(m_Device.get(), m_ShaderModules.Get(computeShader), std::vector<VkDescriptorSetLayout> {m_CullSetLayout}, std::vector<VkPushConstantRange> {pushConstantRange});
+    pipeline->Create();
+    return m_CullPipelines.Create(std::move(pipeline));
+}
+
+void VulkanRHI::DestroyCullPipeline(CullPipelineHandle pipeline)
+{
+    if (!m_CullPipelines.IsValid(pipeline)) {
+        SEWarn("Destroying a stale cull pipeline handle");
+        return;
+    }
+    m_CullPipelines.Destroy(pipeline)->Destroy();
+}
+
+void VulkanRHI::SetIndirectPasses(const std::vector<IndirectPassDescription>& descriptions)
+{
+    if (!m_Device->IsDrawIndirectCountSupported()) {
+        SEWarn("Indirect passes ignored, GPU culled passes not supported");
+        return;
+    }
+    m_IndirectPassDescriptions = descriptions;
+}
+
 void VulkanRHI::SetClearColor(float r, float g, float b, float a)
 {
     m_ClearValues[0].color = {{r, g, b, a}};
@@ -378,10 +1268,16 @@ void VulkanRHI::CreateInstance()
     VK_CHECK_RESULT(vkEnumerateInstanceExtensionProperties(nullptr, &instanceExtensionCount, nullptr));
     std::vector<VkExtensionProperties> supportedInstanceExtensions(instanceExtensionCount);
     VK_CHECK_RESULT(vkEnumerateInstanceExtensionProperties(nullptr, &instanceExtensionCount, supportedInstanceExtensions.data()));
-    std::vector<const char*> requiredInstanceExtensions = {
-        VK_KHR_SURFACE_EXTENSION_NAME,
-        "VK_KHR_win32_surface"
-    };
+    std::vector<const char*> requiredInstanceExtensions;
+    if (!m_Settings.headless) {
+        // Surface extensions of the platform, SDL knows which the window needs
+        Uint32 surfaceExtensionCount = 0;
+        const char* const* surfaceExtensions = SDL_Vulkan_GetInstanceExtensions(&surfaceExtensionCount);
+        if (!surfaceExtensions) {
+            SEFatal("Failed to query surface extensions: {}", SDL_GetError());
+        }
+        requiredInstanceExtensions.assign(surfaceExtensions, surfaceExtensions + surfaceExtensionCount);
+    }
     if (m_Settings.validation) {
         requiredInstanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
@@ -432,19 +1328,45 @@ void VulkanRHI::CreateInstance()
 void VulkanRHI::CreateCommandPool()
 {
     m_GfxCmdPool = m_Device->CreateCommandPool(*m_Device->GetGraphicsQueue());
-    m_TsfCmdPool = m_Device->CreateCommandPool(*m_Device->GetTransferQueue());
-    m_GfxCmdBufs.resize(m_SwapchainImageCount);
+    m_GfxCmdBufs.resize(m_FramesInFlight);
     
-    for (uint32_t i = 0; i < m_SwapchainImageCount; ++i) {
+    for (uint32_t i = 0; i < m_FramesInFlight; ++i) {
         m_GfxCmdBufs[i] = m_GfxCmdPool.Allocate();
     }
+
+    // One partition per worker plus the calling thread
+    const uint32_t partitionCount = m_ThreadPool.GetThreadCount() + 1;
+    m_SecondaryCmds.resize(m_FramesInFlight);
+    for (SecondaryCommands& secondaryCmds : m_SecondaryCmds) {
+        for (uint32_t i = 0; i < partitionCount; ++i) {
+            VulkanCommandPool pool = m_Device->CreateCommandPool(*m_Device->GetGraphicsQueue());
+            secondaryCmds.cmdBufs.push_back(pool.Allocate(VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+            secondaryCmds.pools.push_back(pool);
+        }
+    }
 }
 
 void VulkanRHI::CreateSyncObjects()
 {
-    for (uint32_t i = 0; i < m_SwapchainImageCount; ++i) {
+    for (uint32_t i = 0; i < m_FramesInFlight; ++i) {
         m_Fences.push_back(m_Device->CreateFence(VK_FENCE_CREATE_SIGNALED_BIT));
         m_ImageAvailableSems.push_back(m_Device->CreateSemaphore());
+    }
+    CreatePresentSemaphores();
+}
+
+void VulkanRHI::CreatePresentSemaphores()
+{
+    if (!m_RenderFinishedSems.empty()) {
+        // Presentation of the retired images may still wait on them
+        m_Device->GetDeletionQueue().Push([device = m_Device->GetHandle(), semaphores = m_RenderFinishedSems] {
+            for (VkSemaphore semaphore : semaphores) {
+                vkDestroySemaphore(device, semaphore, nullptr);
+            }
+        });
+    }
+    m_RenderFinishedSems.clear();
+    for (uint32_t i = 0; i < m_SwapchainImageCount; ++i) {
         m_RenderFinishedSems.push_back(m_Device->CreateSemaphore());
     }
 }
@@ -487,15 +1409,7 @@ void VulkanRHI::CreateRenderPass()
     subpassDesc.pColorAttachments = &colorAttachmentRef;
     subpassDesc.pDepthStencilAttachment = &depthAttachmentRef;
 
-    VkSubpassDependency subpassDepend {};
-    subpassDepend.srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpassDepend.dstSubpass = 0;
-    subpassDepend.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    subpassDepend.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    subpassDepend.srcAccessMask = 0;
-    subpassDepend.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    subpassDepend.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
+    // No dependencies, so the render passes of the graph stay compatible with this one
     std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
 
     VkRenderPassCreateInfo passInfo {};
@@ -504,57 +1418,42 @@ void VulkanRHI::CreateRenderPass()
     passInfo.pSubpasses = &subpassDesc;
     passInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
     passInfo.pAttachments = attachments.data();
-    passInfo.dependencyCount = 1;
-    passInfo.pDependencies = &subpassDepend;
 
     VK_CHECK_RESULT(vkCreateRenderPass(m_Device->GetHandle(), &passInfo, nullptr, &m_RenderPass));
 }
 
-void VulkanRHI::CreateFramebuffers()
+void VulkanRHI::BuildRenderGraph()
 {
+    m_RenderGraph.Reset();
     VkExtent2D extent = m_Swapchain.GetExtent();
-    VkImageView depthImageView = m_DepthImage.imageView;
-    m_Framebuffers.resize(m_SwapchainImageCount, VK_NULL_HANDLE);
-    for (uint32_t i = 0; i < m_SwapchainImageCount; ++i) {
-        std::vector<VkImageView> attachments = {
-            m_Swapchain.GetImageView(i),
-            depthImageView,
-        };
-        m_Framebuffers[i] = m_Device->CreateFramebuffer(extent, m_RenderPass, attachments);
-    }
+    // The image available semaphore is waited on at the color output stage. Offscreen the single
+    // image is shared by every frame in flight and is left ready for readback
+    const bool offscreen = m_Swapchain.IsOffscreen();
+    m_BackbufferResource = m_RenderGraph.ImportImage(
+        "backbuffer",
+        {m_Swapchain.GetColorFormat(), extent, VK_IMAGE_ASPECT_COLOR_BIT},
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        offscreen ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        offscreen ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+    );
+    RenderGraphResource depth = m_RenderGraph.CreateImage("depth", {m_Swapchain.GetDepthFormat(), extent, VK_IMAGE_ASPECT_DEPTH_BIT});
+
+    uint32_t scene = m_RenderGraph.AddPass("scene", [this](VulkanCommandBuffer& cmd, const RenderGraphContext& context) {
+        RecordScene(cmd, context);
+    });
+    m_RenderGraph.WriteColor(scene, m_BackbufferResource, &m_ClearValues[0]);
+    m_RenderGraph.WriteDepth(scene, depth, &m_ClearValues[1]);
+    m_RenderGraph.Compile();
 }
 
 void VulkanRHI::SetDescriptorResources()
 {    
-    VkDeviceSize uboSize = sizeof(UniformBufferObject);
-    m_UniformBuffers.resize(m_SwapchainImageCount, {});
-    m_UniformBufferMapped.resize(m_SwapchainImageCount, nullptr);    
-    for (uint32_t i = 0; i < m_SwapchainImageCount; ++i) {
-        VulkanBuffer& uniformBuffer = m_UniformBuffers[i];
-        m_Device->CreateBuffer(
-            uniformBuffer,
-            uboSize,
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        );
-        m_Device->MapBuffer(uniformBuffer, uboSize, 0);
-        m_UniformBufferMapped[i] = uniformBuffer.mapped;
-    }
-
-    auto gfxCmd = m_GfxCmdPool.Allocate();
-    m_Device->CreateTextureImage(
-        m_TextureImage,
-        "D:/w6rsty/dev/Cpp/serious/assets/viking_room.png",
-        m_Swapchain.GetColorFormat(),
-        m_Swapchain.GetComponentMapping(),
-        gfxCmd
-    );
-    m_GfxCmdPool.Free(gfxCmd);
+    m_FrameAllocator.Init(m_Device.get(), m_FramesInFlight);
 
     VkDescriptorSetLayoutBinding uboLayoutBinding {};
     uboLayoutBinding.binding = 0;
     uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
     VkDescriptorSetLayoutBinding samplerLayoutBinding {};
@@ -569,63 +1468,175 @@ void VulkanRHI::SetDescriptorResources()
         samplerLayoutBinding
     });
 
-    m_Device->SetDescriptorPool(
-        {
-            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, m_SwapchainImageCount},
-            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_SwapchainImageCount}
-        },
-        m_SwapchainImageCount
+    if (m_Device->IsBindlessSupported()) {
+        m_Device->GetBindlessTable().Init(m_Device.get(), VulkanBindlessTable::DefaultCapacity, m_FramesInFlight);
+    }
+
+    std::vector<VkDescriptorSetLayoutBinding> cullBindings(4);
+    for (uint32_t binding = 0; binding < cullBindings.size(); ++binding) {
+        cullBindings[binding].binding = binding;
+        cullBindings[binding].descriptorCount = 1;
+        cullBindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cullBindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    m_CullSetLayout = m_Device->GetDescriptorSetLayoutCache().Get(cullBindings);
+    m_IndirectBuffers.resize(m_FramesInFlight);
+
+    m_FrameDescriptorAllocators.resize(m_FramesInFlight);
+    for (DescriptorAllocator& allocator : m_FrameDescriptorAllocators) {
+        allocator.Init(m_Device->GetHandle(), 64, {
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.0f}
+        });
+    }
+}
+
+VkDescriptorSet VulkanRHI::AllocateFrameDescriptorSet()
+{
+    VkDescriptorSet descriptorSet = m_FrameDescriptorAllocators[m_CurrentFrame].Allocate(m_Device->GetDescriptorSetLayout());
+    VkDescriptorBufferInfo bufferInfo {};
+    // Each draw selects its block with a dynamic offset
+    bufferInfo.buffer = m_FrameAllocator.GetBuffer();
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(UniformBufferObject);
+
+    const VulkanTexture& texture = m_TextureStreamer.GetTexture(m_Texture);
+    VkDescriptorImageInfo imageInfo {};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = texture.imageView;
+    imageInfo.sampler = texture.sampler;
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites {};
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = descriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = descriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(
+        m_Device->GetHandle(),
+        static_cast<uint32_t>(descriptorWrites.size()),
+        descriptorWrites.data(),
+        0,
+        nullptr
     );
+    return descriptorSet;
+}
 
-    m_DescriptorSets.resize(m_SwapchainImageCount, VK_NULL_HANDLE);
-    m_Device->AllocateDescriptorSets(m_DescriptorSets);
+void VulkanRHI::BeginFrameWrites()
+{
+    if (m_FrameWritesBegun) {
+        return;
+    }
+    m_Fences[m_CurrentFrame].Wait();
+    // Resources of this frame slot are no longer in use by the GPU, CPU writes are safe from here
+    m_FrameAllocator.BeginFrame(m_CurrentFrame);
+    FlushDynamicBuffers();
+    m_FrameWritesBegun = true;
+}
 
-    for (uint32_t i = 0; i < m_SwapchainImageCount; ++i) {
-        VkDescriptorBufferInfo bufferInfo {};
-        bufferInfo.buffer = m_UniformBuffers[i].buffer;
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
-
-        VkDescriptorImageInfo imageInfo {};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = m_TextureImage.imageView;
-        imageInfo.sampler = m_TextureImage.sampler;
-
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites {};
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = m_DescriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = m_DescriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageInfo;
-
-        vkUpdateDescriptorSets(
-            m_Device->GetHandle(),
-            static_cast<uint32_t>(descriptorWrites.size()),
-            descriptorWrites.data(),
-            0,
-            nullptr
-        );
+void VulkanRHI::FlushDynamicBuffers()
+{
+    if (m_DirtyBuffers.empty()) {
+        return;
     }
+    ZoneScoped;
+    std::erase_if(m_DirtyBuffers, [this](BufferHandle handle) {
+        BufferResource* resource = m_Buffers.TryGet(handle);
+        if (!resource) {
+            return true;
+        }
+        char* copy = static_cast<char*>(resource->buffer.mapped) + resource->copyStride * m_CurrentFrame;
+        memcpy(copy + resource->dirtyBegin, resource->shadow.data() + resource->dirtyBegin, resource->dirtyEnd - resource->dirtyBegin);
+        return --resource->staleCopies == 0;
+    });
+}
+
+void VulkanRHI::RecordBufferCopies(VulkanCommandBuffer& cmd)
+{
+    if (m_PendingBufferCopies.empty()) {
+        return;
+    }
+    ZoneScoped;
+    // Earlier frames on this queue may still read or copy into the ranges
+    std::vector<VkBufferMemoryBarrier2> barriers(m_PendingBufferCopies.size());
+    for (size_t i = 0; i < m_PendingBufferCopies.size(); ++i) {
+        const BufferCopy& copy = m_PendingBufferCopies[i];
+        VkBufferMemoryBarrier2& barrier = barriers[i];
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        // Reads only need the execution dependency, earlier copies also their writes
+        VkAccessFlags2 readAccess = 0;
+        GetBufferConsumer(copy.usage, &barrier.srcStageMask, &readAccess);
+        barrier.srcStageMask |= VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = copy.dst;
+        barrier.offset = copy.dstOffset;
+        barrier.size = copy.size;
+    }
+    cmd.PipelineBarriers2(barriers, {});
+
+    for (size_t i = 0; i < m_PendingBufferCopies.size(); ++i) {
+        const BufferCopy& copy = m_PendingBufferCopies[i];
+        // Copies into overlapping ranges land in the order of the updates
+        for (size_t j = 0; j < i; ++j) {
+            const BufferCopy& previous = m_PendingBufferCopies[j];
+            if (previous.dst == copy.dst && previous.dstOffset < copy.dstOffset + copy.size && copy.dstOffset < previous.dstOffset + previous.size) {
+                VkBufferMemoryBarrier2 barrier = barriers[i];
+                barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+                cmd.PipelineBarriers2({barrier}, {});
+                break;
+            }
+        }
+        cmd.CopyBuffer(copy.src, copy.dst, copy.size, copy.srcOffset, copy.dstOffset);
+    }
+
+    for (size_t i = 0; i < m_PendingBufferCopies.size(); ++i) {
+        VkBufferMemoryBarrier2& barrier = barriers[i];
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        GetBufferConsumer(m_PendingBufferCopies[i].usage, &barrier.dstStageMask, &barrier.dstAccessMask);
+    }
+    cmd.PipelineBarriers2(barriers, {});
+    m_PendingBufferCopies.clear();
 }
 
 void VulkanRHI::UpdateUniforms()
 {
     ZoneScoped;
+    m_DrawUniformOffsets.resize(m_PassDescriptions.size());
+
     UniformBufferObject ubo = {};
-    ubo.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(100.0f));
     ubo.view = m_Camera.matrices.view;
     ubo.proj = m_Camera.matrices.projection;
-    memcpy(m_UniformBufferMapped[m_CurrentFrame], &ubo, sizeof(UniformBufferObject));
+    for (size_t i = 0; i < m_PassDescriptions.size(); ++i) {
+        ubo.model = m_PassDescriptions[i].transform;
+        VulkanFrameAllocation allocation = m_FrameAllocator.Push(ubo);
+        // Draws that did not get uniform space are skipped
+        m_DrawUniformOffsets[i] = allocation.mapped ? allocation.offset : UINT32_MAX;
+    }
+
+    // Indirect passes take their transforms from the culled instances
+    ubo.model = glm::mat4(1.0f);
+    m_IndirectUniformOffsets.resize(m_IndirectPassDescriptions.size());
+    for (size_t i = 0; i < m_IndirectPassDescriptions.size(); ++i) {
+        VulkanFrameAllocation allocation = m_FrameAllocator.Push(ubo);
+        m_IndirectUniformOffsets[i] = allocation.mapped ? allocation.offset : UINT32_MAX;
+    }
 }
 
 }
\ No newline at end of file
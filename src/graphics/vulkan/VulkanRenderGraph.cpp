@@ -0,0 +1,639 @@
+#include "serious/graphics/vulkan/VulkanRenderGraph.hpp"
+#include "serious/graphics/vulkan/VulkanDevice.hpp"
+#include "serious/graphics/vulkan/VulkanGpuProfiler.hpp"
+
+#include <Tracy.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <queue>
+
+namespace serious
+{
+
+static constexpr VkAccessFlags2 WriteAccessMask =
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_SHADER_WRITE_BIT |
+    VK_ACCESS_2_TRANSFER_WRITE_BIT;
+
+VulkanRenderGraph::VulkanRenderGraph()
+    : m_Device(nullptr)
+    , m_DynamicRendering(false)
+    , m_Resources({})
+    , m_Passes({})
+    , m_Order({})
+    , m_Slots({})
+    , m_Stats({})
+    , m_Profiler(nullptr)
+{
+}
+
+void VulkanRenderGraph::Init(VulkanDevice* device, bool dynamicRendering)
+{
+    m_Device = device;
+    m_DynamicRendering = dynamicRendering;
+}
+
+void VulkanRenderGraph::Reset()
+{
+    ReleaseCompiled();
+    m_Resources.clear();
+    m_Passes.clear();
+    m_Order.clear();
+    m_Stats = {};
+}
+
+void VulkanRenderGraph::Destroy()
+{
+    Reset();
+}
+
+RenderGraphResource VulkanRenderGraph::ImportImage(
+    const std::string& name,
+    const RenderGraphImageDescription& description,
+    VkImageLayout initialLayout,
+    VkPipelineStageFlags2 initialStages,
+    VkImageLayout finalLayout)
+{
+    Resource resource;
+    resource.name = name;
+    resource.description = description;
+    resource.imported = true;
+    resource.initialLayout = initialLayout;
+    resource.initialStages = initialStages;
+    resource.finalLayout = finalLayout;
+    m_Resources.push_back(std::move(resource));
+    return static_cast<RenderGraphResource>(m_Resources.size() - 1);
+}
+
+void VulkanRenderGraph::SetImportedImage(RenderGraphResource resource, VkImage image, VkImageView view)
+{
+    assert(m_Resources[resource].imported);
+    m_Resources[resource].image = image;
+    m_Resources[resource].view = view;
+}
+
+RenderGraphResource VulkanRenderGraph::CreateImage(const std::string& name, const RenderGraphImageDescription& description)
+{
+    Resource resource;
+    resource.name = name;
+    resource.description = description;
+    m_Resources.push_back(std::move(resource));
+    return static_cast<RenderGraphResource>(m_Resources.size() - 1);
+}
+
+uint32_t VulkanRenderGraph::AddPass(const std::string& name, ExecuteFunc execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    m_Passes.push_back(std::move(pass));
+    return static_cast<uint32_t>(m_Passes.size() - 1);
+}
+
+void VulkanRenderGraph::WriteColor(uint32_t pass, RenderGraphResource resource, const VkClearValue* clear)
+{
+    m_Passes[pass].writes.push_back({resource, RenderGraphAccess::ColorAttachment, clear});
+}
+
+void VulkanRenderGraph::WriteDepth(uint32_t pass, RenderGraphResource resource, const VkClearValue* clear)
+{
+    m_Passes[pass].writes.push_back({resource, RenderGraphAccess::DepthAttachment, clear});
+}
+
+void VulkanRenderGraph::Read(uint32_t pass, RenderGraphResource resource)
+{
+    m_Passes[pass].reads.push_back(resource);
+}
+
+void VulkanRenderGraph::SetSideEffect(uint32_t pass)
+{
+    m_Passes[pass].sideEffect = true;
+}
+
+void VulkanRenderGraph::Compile()
+{
+    ZoneScoped;
+    ReleaseCompiled();
+    m_Stats = {};
+    m_Stats.passCount = static_cast<uint32_t>(m_Passes.size());
+
+    SortPasses();
+    CullPasses();
+
+    // Lifetimes and usages over the passes that survived, in execution order
+    for (Resource& resource : m_Resources) {
+        resource.usage = 0;
+        resource.firstPass = UINT32_MAX;
+        resource.lastPass = 0;
+        resource.slot = UINT32_MAX;
+    }
+    const auto use = [this](RenderGraphResource r, uint32_t passIndex, VkImageUsageFlags usage) {
+        Resource& resource = m_Resources[r];
+        resource.usage |= usage;
+        resource.firstPass = std::min(resource.firstPass, passIndex);
+        resource.lastPass = std::max(resource.lastPass, passIndex);
+    };
+    for (uint32_t p = 0; p < m_Order.size(); ++p) {
+        const Pass& pass = m_Passes[m_Order[p]];
+        if (pass.culled) {
+            continue;
+        }
+        for (const Attachment& write : pass.writes) {
+            use(write.resource, p, write.access == RenderGraphAccess::DepthAttachment
+                ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+                : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+        }
+        for (RenderGraphResource read : pass.reads) {
+            use(read, p, VK_IMAGE_USAGE_SAMPLED_BIT);
+        }
+    }
+
+    AllocateTransients();
+    for (uint32_t p = 0; p < m_Order.size(); ++p) {
+        if (!m_Passes[m_Order[p]].culled) {
+            CreateRenderPass(m_Passes[m_Order[p]], p);
+        }
+    }
+
+    SEInfo("-- Render graph: {} pass(es), {} culled, {} transient image(s) in {} slot(s), {} KiB instead of {} KiB",
+        m_Stats.passCount,
+        m_Stats.culledPassCount,
+        m_Stats.transientImageCount,
+        m_Stats.memorySlotCount,
+        m_Stats.allocatedBytes / 1024,
+        m_Stats.requestedBytes / 1024
+    );
+}
+
+void VulkanRenderGraph::SortPasses()
+{
+    // A pass sampling an image runs after every pass writing it, passes writing the same image
+    // keep their declaration order. Independent passes also keep it, so a graph declared in
+    // a valid order runs unchanged
+    const uint32_t passCount = static_cast<uint32_t>(m_Passes.size());
+    std::vector<std::vector<uint32_t>> successors(passCount);
+    std::vector<uint32_t> predecessorCount(passCount, 0);
+    const auto depend = [&](uint32_t before, uint32_t after) {
+        successors[before].push_back(after);
+        predecessorCount[after]++;
+    };
+    std::vector<std::vector<uint32_t>> writers(m_Resources.size());
+    for (uint32_t p = 0; p < passCount; ++p) {
+        for (const Attachment& write : m_Passes[p].writes) {
+            std::vector<uint32_t>& resourceWriters = writers[write.resource];
+            if (!resourceWriters.empty()) {
+                depend(resourceWriters.back(), p);
+            }
+            resourceWriters.push_back(p);
+        }
+    }
+    for (uint32_t p = 0; p < passCount; ++p) {
+        for (RenderGraphResource read : m_Passes[p].reads) {
+            for (uint32_t writer : writers[read]) {
+                if (writer != p) {
+                    depend(writer, p);
+                }
+            }
+        }
+    }
+
+    m_Order.clear();
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+    for (uint32_t p = 0; p < passCount; ++p) {
+        if (predecessorCount[p] == 0) {
+            ready.push(p);
+        }
+    }
+    while (!ready.empty()) {
+        uint32_t p = ready.top();
+        ready.pop();
+        m_Order.push_back(p);
+        for (uint32_t next : successors[p]) {
+            if (--predecessorCount[next] == 0) {
+                ready.push(next);
+            }
+        }
+    }
+    if (m_Order.size() != passCount) {
+        SEError("Render graph has a dependency cycle, passes run in declaration order");
+        m_Order.resize(passCount);
+        for (uint32_t p = 0; p < passCount; ++p) {
+            m_Order[p] = p;
+        }
+    }
+}
+
+void VulkanRenderGraph::CullPasses()
+{
+    // Walk backwards from the imported images, a pass survives when one of its writes is consumed later
+    std::vector<bool> needed(m_Resources.size(), false);
+    for (size_t r = 0; r < m_Resources.size(); ++r) {
+        needed[r] = m_Resources[r].imported;
+    }
+    for (size_t p = m_Order.size(); p-- > 0;) {
+        Pass& pass = m_Passes[m_Order[p]];
+        bool used = pass.sideEffect;
+        for (const Attachment& write : pass.writes) {
+            used = used || needed[write.resource];
+        }
+        pass.culled = !used;
+        if (pass.culled) {
+            SETrace("Render graph culled pass {}", pass.name);
+            m_Stats.culledPassCount++;
+            continue;
+        }
+        // A cleared write does not depend on what earlier passes left in the image
+        for (const Attachment& write : pass.writes) {
+            if (write.clear) {
+                needed[write.resource] = false;
+            }
+        }
+        for (RenderGraphResource read : pass.reads) {
+            needed[read] = true;
+        }
+    }
+}
+
+void VulkanRenderGraph::AllocateTransients()
+{
+    VkDevice device = m_Device->GetHandle();
+    std::vector<RenderGraphResource> transients;
+    std::vector<VkMemoryRequirements> requirements(m_Resources.size(), VkMemoryRequirements {});
+    for (RenderGraphResource r = 0; r < m_Resources.size(); ++r) {
+        Resource& resource = m_Resources[r];
+        if (resource.imported || resource.firstPass == UINT32_MAX) {
+            continue;
+        }
+        VkImageCreateInfo imageInfo {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {resource.description.extent.width, resource.description.extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = resource.description.format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = resource.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        VK_CHECK_RESULT(vkCreateImage(device, &imageInfo, nullptr, &resource.image));
+        vkGetImageMemoryRequirements(device, resource.image, &requirements[r]);
+
+        transients.push_back(r);
+        m_Stats.transientImageCount++;
+        m_Stats.requestedBytes += requirements[r].size;
+    }
+
+    // Largest first, each image goes to the first slot whose images are all dead or not yet born
+    std::sort(transients.begin(), transients.end(), [&requirements](RenderGraphResource a, RenderGraphResource b) {
+        return requirements[a].size > requirements[b].size;
+    });
+    for (RenderGraphResource r : transients) {
+        Resource& resource = m_Resources[r];
+        const VkMemoryRequirements& required = requirements[r];
+        for (uint32_t s = 0; s < m_Slots.size() && resource.slot == UINT32_MAX; ++s) {
+            MemorySlot& slot = m_Slots[s];
+            if ((slot.requirements.memoryTypeBits & required.memoryTypeBits) == 0) {
+                continue;
+            }
+            bool overlaps = false;
+            for (RenderGraphResource other : slot.resources) {
+                const Resource& occupant = m_Resources[other];
+                overlaps = overlaps || !(occupant.lastPass < resource.firstPass || resource.lastPass < occupant.firstPass);
+            }
+            if (overlaps) {
+                continue;
+            }
+            slot.requirements.size = std::max(slot.requirements.size, required.size);
+            slot.requirements.alignment = std::max(slot.requirements.alignment, required.alignment);
+            slot.requirements.memoryTypeBits &= required.memoryTypeBits;
+            slot.resources.push_back(r);
+            resource.slot = s;
+        }
+        if (resource.slot == UINT32_MAX) {
+            MemorySlot slot;
+            slot.requirements = required;
+            slot.resources.push_back(r);
+            resource.slot = static_cast<uint32_t>(m_Slots.size());
+            m_Slots.push_back(std::move(slot));
+        }
+    }
+
+    for (MemorySlot& slot : m_Slots) {
+        slot.allocation = m_Device->GetAllocator().AllocateMemory(slot.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        m_Stats.allocatedBytes += slot.requirements.size;
+        for (RenderGraphResource r : slot.resources) {
+            Resource& resource = m_Resources[r];
+            VK_CHECK_RESULT(vkBindImageMemory(device, resource.image, slot.allocation.memory, slot.allocation.offset));
+            resource.view = m_Device->CreateImageView(resource.image, resource.description.format, resource.description.aspect);
+        }
+    }
+    m_Stats.memorySlotCount = static_cast<uint32_t>(m_Slots.size());
+}
+
+void VulkanRenderGraph::CreateRenderPass(Pass& pass, uint32_t passIndex)
+{
+    if (pass.writes.empty()) {
+        return;
+    }
+    pass.colorAttachments.clear();
+    pass.colorFormats.clear();
+    pass.hasDepth = false;
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkAttachmentReference> colorRefs;
+    VkAttachmentReference depthRef {};
+    bool hasDepth = false;
+    for (const Attachment& write : pass.writes) {
+        const Resource& resource = m_Resources[write.resource];
+        const ResourceState target = GetTargetState(write.access);
+        // Nothing to load when the image is cleared or holds no meaningful contents yet
+        const bool undefinedBefore = resource.firstPass == passIndex && (!resource.imported || resource.initialLayout == VK_IMAGE_LAYOUT_UNDEFINED);
+        const bool consumedAfter = resource.imported || resource.lastPass > passIndex;
+
+        VkAttachmentDescription attachment {};
+        attachment.format = resource.description.format;
+        attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        attachment.loadOp = write.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : (undefinedBefore ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD);
+        attachment.storeOp = consumedAfter ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        // Layout transitions are done by the graph barriers
+        attachment.initialLayout = target.layout;
+        attachment.finalLayout = target.layout;
+
+        VkAttachmentReference reference {static_cast<uint32_t>(attachments.size()), target.layout};
+        VkRenderingAttachmentInfo rendering {};
+        rendering.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        rendering.imageLayout = target.layout;
+        rendering.loadOp = attachment.loadOp;
+        rendering.storeOp = attachment.storeOp;
+        if (write.access == RenderGraphAccess::DepthAttachment) {
+            depthRef = reference;
+            hasDepth = true;
+            pass.depthAttachment = rendering;
+            pass.hasDepth = true;
+            pass.depthFormat = attachment.format;
+        } else {
+            colorRefs.push_back(reference);
+            pass.colorAttachments.push_back(rendering);
+            pass.colorFormats.push_back(attachment.format);
+        }
+        attachments.push_back(attachment);
+        pass.extent = resource.description.extent;
+    }
+    if (m_DynamicRendering) {
+        return;
+    }
+
+    VkSubpassDescription subpassDesc {};
+    subpassDesc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpassDesc.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+    subpassDesc.pColorAttachments = colorRefs.data();
+    subpassDesc.pDepthStencilAttachment = hasDepth ? &depthRef : nullptr;
+
+    VkRenderPassCreateInfo passInfo {};
+    passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    passInfo.subpassCount = 1;
+    passInfo.pSubpasses = &subpassDesc;
+    passInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    passInfo.pAttachments = attachments.data();
+    VK_CHECK_RESULT(vkCreateRenderPass(m_Device->GetHandle(), &passInfo, nullptr, &pass.renderPass));
+    pass.clearValues.resize(attachments.size(), VkClearValue {});
+}
+
+VkFramebuffer VulkanRenderGraph::GetFramebuffer(Pass& pass)
+{
+    std::vector<VkImageView> views;
+    for (const Attachment& write : pass.writes) {
+        views.push_back(m_Resources[write.resource].view);
+    }
+    auto it = pass.framebuffers.find(views);
+    if (it != pass.framebuffers.end()) {
+        return it->second;
+    }
+    VkFramebuffer framebuffer = m_Device->CreateFramebuffer(pass.extent, pass.renderPass, views);
+    pass.framebuffers.emplace(std::move(views), framebuffer);
+    return framebuffer;
+}
+
+void VulkanRenderGraph::Execute(VulkanCommandBuffer& cmd)
+{
+    ZoneScoped;
+    m_Stats.barrierBatchCount = 0;
+    m_Stats.imageBarrierCount = 0;
+    for (Resource& resource : m_Resources) {
+        if (resource.imported) {
+            resource.state = {resource.initialLayout, resource.initialStages, VK_ACCESS_2_NONE};
+        }
+    }
+
+    VulkanBarrierBatch barriers;
+    const auto transition = [&](RenderGraphResource r, const ResourceState& target, uint32_t passIndex) {
+        Resource& resource = m_Resources[r];
+        ResourceState& state = resource.state;
+        if (!resource.imported && passIndex == resource.firstPass) {
+            // Contents are discarded, but the memory may still be in use by the previous occupant of the slot
+            const MemorySlot& slot = m_Slots[resource.slot];
+            state = {VK_IMAGE_LAYOUT_UNDEFINED, slot.stages, slot.access};
+        }
+        const bool hazard = state.layout != target.layout
+            || (target.access & WriteAccessMask)
+            || (state.access & WriteAccessMask);
+        if (hazard) {
+            VkImageMemoryBarrier2 barrier {};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrier.srcStageMask = state.stages;
+            barrier.srcAccessMask = state.access & WriteAccessMask;
+            barrier.dstStageMask = target.stages;
+            barrier.dstAccessMask = target.access;
+            barrier.oldLayout = state.layout;
+            barrier.newLayout = target.layout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = resource.image;
+            barrier.subresourceRange = {resource.description.aspect, 0, 1, 0, 1};
+            barriers.AddImage(barrier);
+            state = target;
+        } else {
+            // Read after read in the same layout only widens the scope of the next barrier
+            state.stages |= target.stages;
+            state.access |= target.access;
+        }
+        if (!resource.imported) {
+            m_Slots[resource.slot].stages = state.stages;
+            m_Slots[resource.slot].access = state.access;
+        }
+    };
+    const auto flush = [&]() {
+        if (barriers.IsEmpty()) {
+            return;
+        }
+        m_Stats.barrierBatchCount++;
+        m_Stats.imageBarrierCount += static_cast<uint32_t>(barriers.GetImageBarrierCount());
+        barriers.Flush(cmd);
+    };
+
+    for (uint32_t p = 0; p < m_Order.size(); ++p) {
+        Pass& pass = m_Passes[m_Order[p]];
+        if (pass.culled) {
+            continue;
+        }
+        for (const Attachment& write : pass.writes) {
+            transition(write.resource, GetTargetState(write.access), p);
+        }
+        for (RenderGraphResource read : pass.reads) {
+            transition(read, GetTargetState(RenderGraphAccess::Sampled), p);
+        }
+        flush();
+
+        RenderGraphContext context;
+        if (m_DynamicRendering && !pass.writes.empty()) {
+            uint32_t color = 0;
+            for (const Attachment& write : pass.writes) {
+                VkRenderingAttachmentInfo& attachment = write.access == RenderGraphAccess::DepthAttachment
+                    ? pass.depthAttachment
+                    : pass.colorAttachments[color++];
+                attachment.imageView = m_Resources[write.resource].view;
+                attachment.clearValue = write.clear ? *write.clear : VkClearValue {};
+            }
+            context.dynamicRendering = true;
+            context.renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+            context.renderingInfo.renderArea = {{0, 0}, pass.extent};
+            context.renderingInfo.layerCount = 1;
+            context.renderingInfo.colorAttachmentCount = static_cast<uint32_t>(pass.colorAttachments.size());
+            context.renderingInfo.pColorAttachments = pass.colorAttachments.data();
+            context.renderingInfo.pDepthAttachment = pass.hasDepth ? &pass.depthAttachment : nullptr;
+            context.inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+            context.inheritanceInfo.colorAttachmentCount = static_cast<uint32_t>(pass.colorFormats.size());
+            context.inheritanceInfo.pColorAttachmentFormats = pass.colorFormats.data();
+            context.inheritanceInfo.depthAttachmentFormat = pass.depthFormat;
+            context.inheritanceInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        } else if (pass.renderPass != VK_NULL_HANDLE) {
+            for (size_t i = 0; i < pass.writes.size(); ++i) {
+                pass.clearValues[i] = pass.writes[i].clear ? *pass.writes[i].clear : VkClearValue {};
+            }
+            context.renderPass = pass.renderPass;
+            context.framebuffer = GetFramebuffer(pass);
+            context.beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            context.beginInfo.renderPass = pass.renderPass;
+            context.beginInfo.framebuffer = context.framebuffer;
+            context.beginInfo.renderArea = {{0, 0}, pass.extent};
+            context.beginInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+            context.beginInfo.pClearValues = pass.clearValues.data();
+        }
+        if (m_Profiler) {
+            VulkanGpuScope zone(*m_Profiler, cmd, pass.name.c_str());
+            pass.execute(cmd, context);
+        } else {
+            pass.execute(cmd, context);
+        }
+    }
+
+    // Hand imported images back in the layout the outside world expects
+    for (Resource& resource : m_Resources) {
+        if (!resource.imported || resource.state.layout == resource.finalLayout) {
+            continue;
+        }
+        VkImageMemoryBarrier2 barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = resource.state.stages;
+        barrier.srcAccessMask = resource.state.access & WriteAccessMask;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+        barrier.dstAccessMask = VK_ACCESS_2_NONE;
+        barrier.oldLayout = resource.state.layout;
+        barrier.newLayout = resource.finalLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = resource.image;
+        barrier.subresourceRange = {resource.description.aspect, 0, 1, 0, 1};
+        barriers.AddImage(barrier);
+    }
+    flush();
+}
+
+void VulkanRenderGraph::ReleaseCompiled()
+{
+    if (!m_Device) {
+        return;
+    }
+    // Recompiling happens between frames that may still be in flight, release with the frames
+    std::vector<VkFramebuffer> framebuffers;
+    std::vector<VkRenderPass> renderPasses;
+    std::vector<VkImageView> views;
+    std::vector<VkImage> images;
+    std::vector<VulkanAllocation> allocations;
+    for (Pass& pass : m_Passes) {
+        for (auto& [attachments, framebuffer] : pass.framebuffers) {
+            framebuffers.push_back(framebuffer);
+        }
+        pass.framebuffers.clear();
+        if (pass.renderPass != VK_NULL_HANDLE) {
+            renderPasses.push_back(pass.renderPass);
+            pass.renderPass = VK_NULL_HANDLE;
+        }
+    }
+    for (Resource& resource : m_Resources) {
+        if (resource.imported) {
+            continue;
+        }
+        if (resource.view != VK_NULL_HANDLE) {
+            views.push_back(resource.view);
+        }
+        if (resource.image != VK_NULL_HANDLE) {
+            images.push_back(resource.image);
+        }
+        resource.view = VK_NULL_HANDLE;
+        resource.image = VK_NULL_HANDLE;
+    }
+    for (MemorySlot& slot : m_Slots) {
+        allocations.push_back(slot.allocation);
+    }
+    m_Slots.clear();
+    if (framebuffers.empty() && renderPasses.empty() && views.empty() && images.empty() && allocations.empty()) {
+        return;
+    }
+
+    m_Device->GetDeletionQueue().Push([
+        device = m_Device,
+        framebuffers = std::move(framebuffers),
+        renderPasses = std::move(renderPasses),
+        views = std::move(views),
+        images = std::move(images),
+        allocations = std::move(allocations)
+    ]() mutable {
+        VkDevice handle = device->GetHandle();
+        for (VkFramebuffer framebuffer : framebuffers) {
+            vkDestroyFramebuffer(handle, framebuffer, nullptr);
+        }
+        for (VkRenderPass renderPass : renderPasses) {
+            vkDestroyRenderPass(handle, renderPass, nullptr);
+        }
+        for (VkImageView view : views) {
+            vkDestroyImageView(handle, view, nullptr);
+        }
+        for (VkImage image : images) {
+            vkDestroyImage(handle, image, nullptr);
+        }
+        for (VulkanAllocation& allocation : allocations) {
+            device->GetAllocator().Free(allocation);
+        }
+    });
+}
+
+VulkanRenderGraph::ResourceState VulkanRenderGraph::GetTargetState(RenderGraphAccess access)
+{
+    switch (access) {
+        case RenderGraphAccess::ColorAttachment:
+            return VulkanImageTracker::GetUsageState(VulkanImageUsage::ColorAttachment);
+        case RenderGraphAccess::DepthAttachment:
+            return VulkanImageTracker::GetUsageState(VulkanImageUsage::DepthAttachment);
+        case RenderGraphAccess::Sampled:
+            return VulkanImageTracker::GetUsageState(VulkanImageUsage::Sampled);
+    }
+    return {};
+}
+
+}
@@ -0,0 +1,110 @@
+#include "serious/graphics/vulkan/VulkanStagingRing.hpp"
+#include "serious/graphics/vulkan/VulkanDevice.hpp"
+
+namespace serious
+{
+
+static inline VkDeviceSize AlignTo(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+VulkanStagingRing::VulkanStagingRing()
+    : m_Device(nullptr)
+    , m_Buffer({})
+    , m_Size(0)
+    , m_Head(0)
+    , m_Tail(0)
+    , m_Used(0)
+    , m_OpenBytes(0)
+    , m_Retired({})
+{
+}
+
+void VulkanStagingRing::Init(VulkanDevice* device, VkDeviceSize size)
+{
+    m_Device = device;
+    m_Size = size;
+    m_Device->CreateBuffer(
+        m_Buffer,
+        m_Size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    );
+    m_Device->MapBuffer(m_Buffer, m_Size, 0);
+}
+
+void VulkanStagingRing::Destroy()
+{
+    if (m_Used != 0) {
+        SEWarn("Staging ring destroyed with {} byte(s) in flight", m_Used);
+    }
+    m_Device->DestroyBuffer(m_Buffer);
+    m_Retired.clear();
+}
+
+VulkanStagingRegion VulkanStagingRing::Allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    if (size == 0 || size > m_Size) {
+        return {};
+    }
+    if (m_Used == 0) {
+        m_Head = 0;
+        m_Tail = 0;
+    }
+
+    VkDeviceSize offset = AlignTo(m_Head, alignment);
+    VkDeviceSize consumed = 0;
+    if ((m_Used == 0) || (m_Head > m_Tail)) {
+        // Free space is [head, size) followed by [0, tail)
+        if (offset + size <= m_Size) {
+            consumed = offset + size - m_Head;
+        } else if (size <= m_Tail) {
+            // The end of the ring is too small, waste it and wrap around
+            consumed = (m_Size - m_Head) + size;
+            offset = 0;
+        } else {
+            return {};
+        }
+    } else if (m_Head < m_Tail) {
+        if (offset + size > m_Tail) {
+            return {};
+        }
+        consumed = offset + size - m_Head;
+    } else {
+        // Head caught up with tail
+        return {};
+    }
+
+    m_Head = offset + size;
+    m_Used += consumed;
+    m_OpenBytes += consumed;
+
+    VulkanStagingRegion region;
+    region.buffer = m_Buffer.buffer;
+    region.offset = offset;
+    region.size = size;
+    region.mapped = static_cast<char*>(m_Buffer.mapped) + offset;
+    return region;
+}
+
+void VulkanStagingRing::Retire(uint64_t value)
+{
+    if (m_OpenBytes == 0) {
+        return;
+    }
+    m_Retired.push_back({m_Head, m_OpenBytes, value});
+    m_OpenBytes = 0;
+}
+
+void VulkanStagingRing::Reclaim(uint64_t completedValue)
+{
+    while (!m_Retired.empty() && m_Retired.front().value <= completedValue) {
+        const RetiredSpan& span = m_Retired.front();
+        m_Tail = span.end;
+        m_Used -= span.bytes;
+        m_Retired.pop_front();
+    }
+}
+
+}
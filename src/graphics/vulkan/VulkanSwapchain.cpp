@@ -23,6 +23,7 @@ VulkanSwapchain::VulkanSwapchain()
     , m_DepthFormat(VK_FORMAT_D32_SFLOAT)
     , m_Images({})
     , m_ImageViews({})
+    , m_OffscreenImage({})
 {
 }
 
@@ -45,13 +46,48 @@ void VulkanSwapchain::Cleanup()
     for (VkImageView& imageView : m_ImageViews) {
         vkDestroyImageView(device, imageView, nullptr);
     }
+    m_ImageViews.clear();
+    m_Images.clear();
 
-    vkDestroySwapchainKHR(device, m_Swapchain, nullptr);
-    m_Swapchain = VK_NULL_HANDLE;
+    if (IsOffscreen()) {
+        m_Device->DestroyImage(m_OffscreenImage);
+        m_OffscreenImage = {};
+    }
+    if (m_Swapchain != VK_NULL_HANDLE) {
+        vkDestroySwapchainKHR(device, m_Swapchain, nullptr);
+        m_Swapchain = VK_NULL_HANDLE;
+    }
     
     if (m_Surface != VK_NULL_HANDLE) {
         vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr);
+        m_Surface = VK_NULL_HANDLE;
+    }
+}
+
+void VulkanSwapchain::CreateOffscreen(uint32_t width, uint32_t height)
+{
+    if (IsOffscreen()) {
+        m_Device->GetDeletionQueue().Push([device = m_Device, view = m_ImageViews[0], image = m_OffscreenImage]() mutable {
+            vkDestroyImageView(device->GetHandle(), view, nullptr);
+            device->DestroyImage(image);
+        });
     }
+
+    m_Extent = {width, height};
+    m_ImageCount = 1;
+    // Readback expects tightly packed RGBA8
+    m_ColorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    m_OffscreenImage = m_Device->CreateImage(
+        width, height,
+        m_ColorFormat,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        true
+    );
+    m_Images = {m_OffscreenImage.image};
+    m_ImageViews = {m_Device->CreateImageView(m_OffscreenImage.image, m_ColorFormat, VK_IMAGE_ASPECT_COLOR_BIT)};
+    SETrace("Create offscreen target {} | {}x{}", VulkanFormatString(m_ColorFormat), width, height);
 }
 
 void VulkanSwapchain::Create(uint32_t* width, uint32_t* height, bool vsync)
@@ -157,10 +193,13 @@ void VulkanSwapchain::Create(uint32_t* width, uint32_t* height, bool vsync)
     );
 
     if (oldSwapchain != VK_NULL_HANDLE) {
-        for (VkImageView& imageView : m_ImageViews) {
-            vkDestroyImageView(device, imageView, nullptr);
-        }
-        vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+        // Frames in flight may still render to or present the retired images
+        m_Device->GetDeletionQueue().Push([device, oldSwapchain, imageViews = m_ImageViews] {
+            for (VkImageView imageView : imageViews) {
+                vkDestroyImageView(device, imageView, nullptr);
+            }
+            vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+        });
     }
 
     m_Images.resize(m_ImageCount, VK_NULL_HANDLE);
@@ -0,0 +1,248 @@
+#include "serious/graphics/vulkan/VulkanTextureStreamer.hpp"
+#include "serious/graphics/vulkan/VulkanDevice.hpp"
+
+#include <Tracy.hpp>
+
+#include <algorithm>
+
+namespace serious
+{
+
+VulkanTextureStreamer::VulkanTextureStreamer()
+    : m_Device(nullptr)
+    , m_ThreadPool(nullptr)
+    , m_UploadBudget(0)
+    , m_Placeholder({})
+    , m_PlaceholderIndex(VulkanBindlessTable::InvalidIndex)
+    , m_Textures()
+    , m_Released({})
+    , m_FrameUploadBytes(0)
+{
+}
+
+void VulkanTextureStreamer::Init(VulkanDevice* device, ThreadPool* threadPool, VkDeviceSize uploadBudget)
+{
+    m_Device = device;
+    m_ThreadPool = threadPool;
+    m_UploadBudget = uploadBudget;
+
+    VulkanTexturePixels placeholder;
+    placeholder.width = 1;
+    placeholder.height = 1;
+    placeholder.levels.push_back({VulkanTexturePixels::ErrorTexel});
+    m_Device->CreateTextureImage(m_Placeholder, placeholder, VK_FORMAT_R8G8B8A8_UNORM, {});
+    // Every texture still streaming in shares this slot
+    VulkanBindlessTable& bindless = m_Device->GetBindlessTable();
+    if (bindless.IsEnabled()) {
+        m_PlaceholderIndex = bindless.Register(m_Placeholder.imageView, m_Placeholder.sampler);
+    }
+}
+
+void VulkanTextureStreamer::Destroy()
+{
+    VulkanBindlessTable& bindless = m_Device->GetBindlessTable();
+    auto destroy = [&](Entry& entry) {
+        if (entry.bindlessIndex != m_PlaceholderIndex) {
+            bindless.Release(entry.bindlessIndex);
+        }
+        if (entry.texture.image.image != VK_NULL_HANDLE) {
+            m_Device->DestroyTextureImage(entry.texture);
+        }
+    };
+    m_Textures.ForEach([&](StreamedTexture, std::unique_ptr<Entry>& entry) { destroy(*entry); });
+    for (std::unique_ptr<Entry>& entry : m_Released) {
+        destroy(*entry);
+    }
+    m_Textures.Clear();
+    m_Released.clear();
+    bindless.Release(m_PlaceholderIndex);
+    m_PlaceholderIndex = VulkanBindlessTable::InvalidIndex;
+    m_Device->DestroyTextureImage(m_Placeholder);
+}
+
+StreamedTexture VulkanTextureStreamer::Request(const std::string& path, VkFormat format, VkComponentMapping mapping, float priority)
+{
+    auto owned = std::make_unique<Entry>();
+    Entry* entry = owned.get();
+    entry->path = path;
+    entry->format = format;
+    entry->mapping = mapping;
+    entry->priority = priority;
+    entry->state = StreamState::Decoding;
+    entry->texture = {};
+    entry->token = 0;
+    entry->bindlessIndex = m_PlaceholderIndex;
+    StreamedTexture texture;
+    {
+        // GetStats may walk the slots from another thread
+        std::lock_guard lock(m_Mutex);
+        texture = m_Textures.Create(std::move(owned));
+    }
+
+    m_ThreadPool->Enqueue([this, entry] {
+        ZoneScopedN("Texture decode");
+        VulkanTexturePixels pixels = m_Device->LoadTexturePixels(entry->path, entry->format);
+        std::lock_guard lock(m_Mutex);
+        entry->pixels = std::move(pixels);
+        entry->state = StreamState::Decoded;
+    });
+    return texture;
+}
+
+void VulkanTextureStreamer::Release(StreamedTexture texture)
+{
+    if (!m_Textures.IsValid(texture)) {
+        return;
+    }
+    std::unique_ptr<Entry> entry;
+    {
+        // Handles held elsewhere turn stale at once
+        std::lock_guard lock(m_Mutex);
+        entry = m_Textures.Destroy(texture);
+    }
+    if (IsBusy(*entry)) {
+        m_Released.push_back(std::move(entry));
+    } else {
+        Reclaim(*entry);
+    }
+}
+
+void VulkanTextureStreamer::SetPriority(StreamedTexture texture, float priority)
+{
+    Entry* entry = Find(texture);
+    if (!entry) {
+        return;
+    }
+    std::lock_guard lock(m_Mutex);
+    entry->priority = priority;
+}
+
+void VulkanTextureStreamer::Update()
+{
+    ZoneScoped;
+    std::erase_if(m_Released, [this](std::unique_ptr<Entry>& entry) {
+        if (IsBusy(*entry)) {
+            return false;
+        }
+        Reclaim(*entry);
+        return true;
+    });
+
+    VulkanUploader& uploader = m_Device->GetUploader();
+    std::vector<Entry*> decoded;
+    std::vector<Entry*> uploading;
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Textures.ForEach([&](StreamedTexture, std::unique_ptr<Entry>& entry) {
+            if (entry->state == StreamState::Decoded) {
+                decoded.push_back(entry.get());
+            } else if (entry->state == StreamState::Uploading) {
+                uploading.push_back(entry.get());
+            }
+        });
+    }
+
+    // Publish first, the uploads of this frame cannot be complete yet
+    VulkanBindlessTable& bindless = m_Device->GetBindlessTable();
+    for (Entry* entry : uploading) {
+        if (!uploader.IsComplete(entry->token)) {
+            continue;
+        }
+        // A fresh slot, the placeholder slot is still sampled by the frames in flight
+        if (bindless.IsEnabled()) {
+            const uint32_t index = bindless.Register(entry->texture.imageView, entry->texture.sampler);
+            if (index != VulkanBindlessTable::InvalidIndex) {
+                entry->bindlessIndex = index;
+            }
+        }
+        std::lock_guard lock(m_Mutex);
+        entry->state = StreamState::Ready;
+    }
+
+    std::stable_sort(decoded.begin(), decoded.end(), [](const Entry* a, const Entry* b) {
+        return a->priority > b->priority;
+    });
+    m_FrameUploadBytes = 0;
+    uploader.BeginBatch();
+    for (Entry* entry : decoded) {
+        const VkDeviceSize size = entry->pixels.GetSize();
+        if (m_FrameUploadBytes > 0 && m_FrameUploadBytes + size > m_UploadBudget) {
+            break;
+        }
+        m_Device->CreateTextureImage(entry->texture, entry->pixels, entry->format, entry->mapping);
+        m_FrameUploadBytes += size;
+        std::lock_guard lock(m_Mutex);
+        entry->pixels = {};
+        entry->state = StreamState::Uploading;
+    }
+    const VulkanUploadToken token = uploader.EndBatch();
+    for (Entry* entry : decoded) {
+        std::lock_guard lock(m_Mutex);
+        if (entry->state == StreamState::Uploading) {
+            entry->token = token;
+        }
+    }
+}
+
+bool VulkanTextureStreamer::IsReady(StreamedTexture texture) const
+{
+    const Entry* entry = Find(texture);
+    if (!entry) {
+        return false;
+    }
+    std::lock_guard lock(m_Mutex);
+    return entry->state == StreamState::Ready;
+}
+
+const VulkanTexture& VulkanTextureStreamer::GetTexture(StreamedTexture texture) const
+{
+    return IsReady(texture) ? m_Textures.Get(texture)->texture : m_Placeholder;
+}
+
+uint32_t VulkanTextureStreamer::GetBindlessIndex(StreamedTexture texture) const
+{
+    const Entry* entry = Find(texture);
+    return entry ? entry->bindlessIndex : VulkanBindlessTable::InvalidIndex;
+}
+
+TextureStreamStats VulkanTextureStreamer::GetStats() const
+{
+    std::lock_guard lock(m_Mutex);
+    TextureStreamStats stats;
+    m_Textures.ForEach([&](StreamedTexture, const std::unique_ptr<Entry>& entry) {
+        switch (entry->state) {
+            case StreamState::Decoding:  stats.decoding++; break;
+            case StreamState::Decoded:   stats.waitingUpload++; break;
+            case StreamState::Uploading: stats.uploading++; break;
+            case StreamState::Ready:     stats.ready++; break;
+        }
+    });
+    stats.frameUploadBytes = m_FrameUploadBytes;
+    return stats;
+}
+
+VulkanTextureStreamer::Entry* VulkanTextureStreamer::Find(StreamedTexture texture) const
+{
+    const std::unique_ptr<Entry>* entry = m_Textures.TryGet(texture);
+    return entry ? entry->get() : nullptr;
+}
+
+bool VulkanTextureStreamer::IsBusy(const Entry& entry) const
+{
+    std::lock_guard lock(m_Mutex);
+    return entry.state == StreamState::Decoding
+        || (entry.state == StreamState::Uploading && !m_Device->GetUploader().IsComplete(entry.token));
+}
+
+void VulkanTextureStreamer::Reclaim(Entry& entry)
+{
+    if (entry.bindlessIndex != m_PlaceholderIndex) {
+        m_Device->GetBindlessTable().Release(entry.bindlessIndex);
+    }
+    if (entry.texture.image.image != VK_NULL_HANDLE) {
+        // The frames in flight may still sample it
+        m_Device->DeferDestroyTextureImage(entry.texture);
+    }
+}
+
+}
@@ -0,0 +1,422 @@
+#include "serious/graphics/vulkan/VulkanUploader.hpp"
+#include "serious/graphics/vulkan/VulkanDevice.hpp"
+
+#include <Tracy.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace serious
+{
+
+static void GetBufferConsumer(VkBufferUsageFlags usage, VkPipelineStageFlags* stages, VkAccessFlags* access)
+{
+    *stages = 0;
+    *access = 0;
+    if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) {
+        *stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+        *access |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    }
+    if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) {
+        *stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+        *access |= VK_ACCESS_INDEX_READ_BIT;
+    }
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+        *stages |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        *access |= VK_ACCESS_UNIFORM_READ_BIT;
+    }
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+        *stages |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        *access |= VK_ACCESS_SHADER_READ_BIT;
+    }
+    if (usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) {
+        *stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+        *access |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    }
+    if (*stages == 0) {
+        *stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        *access = VK_ACCESS_MEMORY_READ_BIT;
+    }
+}
+
+VulkanUploader::VulkanUploader()
+    : m_Device(nullptr)
+    , m_StagingRing(nullptr)
+    , m_Queue(nullptr)
+    , m_SrcFamilyIndex(0)
+    , m_DstFamilyIndex(0)
+    , m_CmdPool({})
+    , m_Cmd({})
+    , m_Recording(false)
+    , m_InFlightCmds({})
+    , m_FreeCmds({})
+    , m_Timeline(VK_NULL_HANDLE)
+    , m_SubmittedValue(0)
+    , m_GraphicsWaitedValue(0)
+    , m_RecordingStages(0)
+    , m_SubmittedStages(0)
+    , m_Barriers({})
+    , m_BufferAcquires({})
+    , m_ImageAcquires({})
+    , m_PendingMips({})
+    , m_BatchDepth(0)
+    , m_UploadedBytes(0)
+    , m_SubmitCount(0)
+{
+}
+
+void VulkanUploader::Init(VulkanDevice* device, VulkanStagingRing* stagingRing)
+{
+    m_Device = device;
+    m_StagingRing = stagingRing;
+    m_Queue = m_Device->GetTransferQueue();
+    m_SrcFamilyIndex = m_Queue->GetFamilyIndex();
+    m_DstFamilyIndex = m_Device->GetGraphicsQueue()->GetFamilyIndex();
+    m_CmdPool = m_Device->CreateCommandPool(*m_Queue);
+    m_Timeline = m_Device->CreateTimelineSemaphore();
+    if (NeedsOwnershipTransfer()) {
+        SEInfo("-- Uploads transfer ownership from family {} to {}", m_SrcFamilyIndex, m_DstFamilyIndex);
+    }
+}
+
+void VulkanUploader::Destroy()
+{
+    if (m_Recording) {
+        Submit();
+    }
+    Wait(m_SubmittedValue);
+    Recycle();
+    for (VulkanCommandBuffer& cmd : m_FreeCmds) {
+        m_CmdPool.Free(cmd);
+    }
+    m_FreeCmds.clear();
+    m_Device->DestroyCommandPool(m_CmdPool);
+    vkDestroySemaphore(m_Device->GetHandle(), m_Timeline, nullptr);
+}
+
+void VulkanUploader::UploadBuffer(
+    VkBuffer dst,
+    VkBufferUsageFlags usage,
+    VkDeviceSize dstOffset,
+    const void* data,
+    VkDeviceSize size)
+{
+    ZoneScoped;
+    BeginRecording();
+    // Uploads larger than a quarter of the ring are split into chunks
+    const VkDeviceSize maxChunk = m_StagingRing->GetSize() / 4;
+    VkDeviceSize copied = 0;
+    while (copied < size) {
+        VkDeviceSize chunk = std::min(size - copied, maxChunk);
+        VulkanStagingRegion region = AcquireStaging(chunk, 4);
+        memcpy(region.mapped, static_cast<const char*>(data) + copied, chunk);
+        m_Cmd.CopyBuffer(region.buffer, dst, chunk, region.offset, dstOffset + copied);
+        copied += chunk;
+    }
+    m_UploadedBytes += size;
+
+    VkPipelineStageFlags dstStages;
+    VkAccessFlags dstAccess;
+    GetBufferConsumer(usage, &dstStages, &dstAccess);
+    m_RecordingStages |= dstStages;
+    if (NeedsOwnershipTransfer()) {
+        VkBufferMemoryBarrier2 release {};
+        release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        release.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        release.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+        release.dstAccessMask = VK_ACCESS_2_NONE;
+        release.srcQueueFamilyIndex = m_SrcFamilyIndex;
+        release.dstQueueFamilyIndex = m_DstFamilyIndex;
+        release.buffer = dst;
+        release.offset = dstOffset;
+        release.size = size;
+        m_Barriers.AddBuffer(release);
+
+        // Stages of the acquire are filled in by AcquireOnGraphics
+        VkBufferMemoryBarrier2 acquire = release;
+        acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        acquire.srcAccessMask = VK_ACCESS_2_NONE;
+        acquire.dstAccessMask = dstAccess;
+        m_BufferAcquires.push_back({acquire, 0});
+    }
+}
+
+void VulkanUploader::UploadImage(VkImage image, uint32_t width, uint32_t height, const std::vector<const void*>& levels)
+{
+    ZoneScoped;
+    BeginRecording();
+
+    // Previous contents are replaced entirely
+    VulkanImageTracker& tracker = m_Device->GetImageTracker();
+    const uint32_t mipLevels = tracker.GetMipLevels(image);
+    const uint32_t givenLevels = std::min(static_cast<uint32_t>(levels.size()), mipLevels);
+    assert(givenLevels > 0);
+    if (m_Barriers.ContainsImage(image)) {
+        // Barriers in a single call are unordered, the pending one of this image lands first
+        m_Barriers.Flush(m_Cmd);
+    }
+    // Generated levels are written too, the whole image starts as a transfer destination
+    tracker.Discard(image);
+    // Pending barriers of earlier uploads are recorded together with this one
+    tracker.Transition(m_Barriers, image, VulkanImageUsage::TransferDst);
+    m_Barriers.Flush(m_Cmd);
+
+    const VkDeviceSize alignment = std::max<VkDeviceSize>(4, m_Device->GetGpuProperties().limits.optimalBufferCopyOffsetAlignment);
+    for (uint32_t level = 0; level < givenLevels; ++level) {
+        const uint32_t levelWidth = std::max(1u, width >> level);
+        const uint32_t levelHeight = std::max(1u, height >> level);
+        // Images larger than a quarter of the ring are uploaded in bands of rows
+        const VkDeviceSize rowPitch = static_cast<VkDeviceSize>(levelWidth) * 4;
+        const uint32_t rowsPerChunk = static_cast<uint32_t>(std::max<VkDeviceSize>(1, (m_StagingRing->GetSize() / 4) / rowPitch));
+        for (uint32_t row = 0; row < levelHeight; row += rowsPerChunk) {
+            uint32_t rows = std::min(rowsPerChunk, levelHeight - row);
+            VkDeviceSize chunk = rows * rowPitch;
+            VulkanStagingRegion staging = AcquireStaging(chunk, alignment);
+            memcpy(staging.mapped, static_cast<const char*>(levels[level]) + row * rowPitch, chunk);
+
+            VkBufferImageCopy region {};
+            region.bufferOffset = staging.offset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {0, static_cast<int32_t>(row), 0};
+            region.imageExtent = {levelWidth, rows, 1};
+            m_Cmd.CopyBufferToImage(staging.buffer, image, &region);
+        }
+        m_UploadedBytes += rowPitch * levelHeight;
+    }
+
+    m_RecordingStages |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    if (NeedsOwnershipTransfer()) {
+        // Blits need a graphics queue, the missing levels are generated after the acquire
+        m_ImageAcquires.push_back({tracker.Release(m_Barriers, image, VulkanImageUsage::Sampled, m_SrcFamilyIndex, m_DstFamilyIndex), 0});
+        if (givenLevels < mipLevels) {
+            m_PendingMips.push_back({image, width, height, givenLevels, 0});
+        }
+    } else if (givenLevels < mipLevels) {
+        RecordMipBlits(m_Cmd, m_Barriers, image, width, height, givenLevels);
+    } else {
+        // Visibility to the graphics queue is provided by the timeline semaphore wait
+        tracker.Transition(m_Barriers, image, VulkanImageUsage::Sampled);
+    }
+}
+
+VulkanUploadToken VulkanUploader::Flush()
+{
+    if (m_BatchDepth > 0) {
+        return m_Recording ? m_SubmittedValue + 1 : m_SubmittedValue;
+    }
+    return Submit();
+}
+
+void VulkanUploader::BeginBatch()
+{
+    m_BatchDepth++;
+}
+
+VulkanUploadToken VulkanUploader::EndBatch()
+{
+    assert(m_BatchDepth > 0);
+    m_BatchDepth--;
+    return Flush();
+}
+
+VulkanUploadToken VulkanUploader::Submit()
+{
+    if (!m_Recording) {
+        return m_SubmittedValue;
+    }
+    ZoneScoped;
+    m_Barriers.Flush(m_Cmd);
+    m_Cmd.End();
+
+    const uint64_t signalValue = m_SubmittedValue + 1;
+    VkTimelineSemaphoreSubmitInfo timelineInfo {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkCommandBuffer cmdBuf = m_Cmd.GetHandle();
+    VkSubmitInfo submitInfo {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmdBuf;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &m_Timeline;
+    m_Queue->Submit(submitInfo);
+
+    m_SubmittedValue = signalValue;
+    m_SubmitCount++;
+    m_StagingRing->Retire(signalValue);
+    m_InFlightCmds.push_back({m_Cmd, signalValue});
+    for (auto& acquire : m_BufferAcquires) {
+        if (acquire.value == 0) {
+            acquire.value = signalValue;
+        }
+    }
+    for (auto& acquire : m_ImageAcquires) {
+        if (acquire.value == 0) {
+            acquire.value = signalValue;
+        }
+    }
+    for (PendingMips& mips : m_PendingMips) {
+        if (mips.value == 0) {
+            mips.value = signalValue;
+        }
+    }
+    m_SubmittedStages |= m_RecordingStages;
+    m_RecordingStages = 0;
+    m_Recording = false;
+    return signalValue;
+}
+
+bool VulkanUploader::IsComplete(VulkanUploadToken token) const
+{
+    return GetCompletedValue() >= token;
+}
+
+void VulkanUploader::Wait(VulkanUploadToken token)
+{
+    if (IsComplete(token)) {
+        return;
+    }
+    ZoneScopedN("Upload wait");
+    VkSemaphoreWaitInfo waitInfo {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_Timeline;
+    waitInfo.pValues = &token;
+    VK_CHECK_RESULT(vkWaitSemaphores(m_Device->GetHandle(), &waitInfo, UINT64_MAX));
+}
+
+VulkanUploadWait VulkanUploader::AcquireOnGraphics(VulkanCommandBuffer& gfxCmd)
+{
+    VulkanUploadWait wait;
+    if (m_SubmittedValue <= m_GraphicsWaitedValue) {
+        return wait;
+    }
+    wait.value = m_SubmittedValue;
+    wait.stages = m_SubmittedStages ? m_SubmittedStages : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    // The source scope chains with the semaphore wait on the same stages
+    VulkanBarrierBatch acquires;
+    std::erase_if(m_BufferAcquires, [&acquires, &wait](const auto& acquire) {
+        if (acquire.value == 0) {
+            return false;
+        }
+        VkBufferMemoryBarrier2 barrier = acquire.barrier;
+        barrier.srcStageMask = wait.stages;
+        barrier.dstStageMask = wait.stages;
+        acquires.AddBuffer(barrier);
+        return true;
+    });
+    std::erase_if(m_ImageAcquires, [&acquires, &wait](const auto& acquire) {
+        if (acquire.value == 0) {
+            return false;
+        }
+        VkImageMemoryBarrier2 barrier = acquire.barrier;
+        barrier.srcStageMask = wait.stages;
+        acquires.AddImage(barrier);
+        return true;
+    });
+    acquires.Flush(gfxCmd);
+    std::erase_if(m_PendingMips, [this, &acquires, &gfxCmd](const PendingMips& mips) {
+        if (mips.value == 0) {
+            return false;
+        }
+        RecordMipBlits(gfxCmd, acquires, mips.image, mips.width, mips.height, mips.baseLevel);
+        return true;
+    });
+
+    m_GraphicsWaitedValue = m_SubmittedValue;
+    m_SubmittedStages = 0;
+    return wait;
+}
+
+void VulkanUploader::BeginRecording()
+{
+    if (m_Recording) {
+        return;
+    }
+    Recycle();
+    if (m_FreeCmds.empty()) {
+        m_Cmd = m_CmdPool.Allocate();
+    } else {
+        m_Cmd = m_FreeCmds.back();
+        m_FreeCmds.pop_back();
+    }
+    m_Cmd.BeginSingle();
+    m_Recording = true;
+}
+
+void VulkanUploader::RecordMipBlits(
+    VulkanCommandBuffer& cmd,
+    VulkanBarrierBatch& batch,
+    VkImage image,
+    uint32_t width, uint32_t height,
+    uint32_t baseLevel)
+{
+    VulkanImageTracker& tracker = m_Device->GetImageTracker();
+    const uint32_t mipLevels = tracker.GetMipLevels(image);
+    for (uint32_t level = baseLevel; level < mipLevels; ++level) {
+        const VkImageSubresourceRange srcRange {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1, 0, 1};
+        const VkImageSubresourceRange dstRange {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        tracker.Transition(batch, image, VulkanImageUsage::TransferSrc, &srcRange);
+        tracker.Transition(batch, image, VulkanImageUsage::TransferDst, &dstRange);
+        batch.Flush(cmd);
+
+        VkImageBlit blit {};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+        blit.srcOffsets[1] = {static_cast<int32_t>(std::max(1u, width >> (level - 1))), static_cast<int32_t>(std::max(1u, height >> (level - 1))), 1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        blit.dstOffsets[1] = {static_cast<int32_t>(std::max(1u, width >> level)), static_cast<int32_t>(std::max(1u, height >> level)), 1};
+        cmd.BlitImage(image, image, blit, VK_FILTER_LINEAR);
+    }
+    // Every level but the last one is a transfer source by now
+    tracker.Transition(batch, image, VulkanImageUsage::Sampled);
+    batch.Flush(cmd);
+}
+
+VulkanStagingRegion VulkanUploader::AcquireStaging(VkDeviceSize size, VkDeviceSize alignment)
+{
+    VulkanStagingRegion region = m_StagingRing->Allocate(size, alignment);
+    while (!region.mapped) {
+        // Ring exhausted, submit what is recorded and wait for the oldest upload still reading it
+        Submit();
+        if (m_StagingRing->HasRetired()) {
+            Wait(m_StagingRing->GetOldestRetiredValue());
+        }
+        Recycle();
+        region = m_StagingRing->Allocate(size, alignment);
+    }
+    BeginRecording();
+    return region;
+}
+
+uint64_t VulkanUploader::GetCompletedValue() const
+{
+    uint64_t value = 0;
+    VK_CHECK_RESULT(vkGetSemaphoreCounterValue(m_Device->GetHandle(), m_Timeline, &value));
+    return value;
+}
+
+void VulkanUploader::Recycle()
+{
+    const uint64_t completed = GetCompletedValue();
+    m_StagingRing->Reclaim(completed);
+    std::erase_if(m_InFlightCmds, [this, completed](const InFlightCmd& inFlight) {
+        if (inFlight.value > completed) {
+            return false;
+        }
+        m_FreeCmds.push_back(inFlight.cmd);
+        return true;
+    });
+}
+
+}